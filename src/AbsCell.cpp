@@ -147,9 +147,9 @@ wxString AbsCell::ToMathML()
 //  return wxT("<apply><abs/><ci>") + m_innerCell->ListToMathML() + wxT("</ci></apply>");
 }
 
-wxString AbsCell::ToXML()
+wxString AbsCell::ToXML(WXMXImageList &images)
 {
-  return wxT("<a>") + m_innerCell->ListToXML() + wxT("</a>");
+  return wxT("<a>") + m_innerCell->ListToXML(images) + wxT("</a>");
 }
 
 void AbsCell::SelectInner(wxRect& rect, MathCell **first, MathCell **last)
@@ -155,10 +155,10 @@ wxString AtCell::ToMathML()
     m_indexCell->ListToMathML() + wxT("</msub>\n");
 }
 
-wxString AtCell::ToXML()
+wxString AtCell::ToXML(WXMXImageList &images)
 {
-  return wxT("<at><r>") + m_baseCell->ListToXML() + wxT("</r><r>") +
-    m_indexCell->ListToXML() + wxT("</r></at>");
+  return wxT("<at><r>") + m_baseCell->ListToXML(images) + wxT("</r><r>") +
+    m_indexCell->ListToXML(images) + wxT("</r></at>");
 }
 
 void AtCell::SelectInner(wxRect& rect, MathCell** first, MathCell** last)
@@ -38,7 +38,7 @@ public:
   void Draw(CellParser& parser, wxPoint point, int fontsize);
   wxString ToString();
   wxString ToTeX();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   wxString ToMathML();
   void SelectInner(wxRect& rect, MathCell** first, MathCell** last);
   void SetParent(MathCell *parent);
@@ -23,111 +23,305 @@
 #include "Dirstructure.h"
 
 #include <wx/textfile.h>
+#include <wx/filename.h>
+#include <wx/file.h>
+#include <wx/mstream.h>
+#include <wx/wfstream.h>
+#include <wx/datstrm.h>
+
+//! The first thing that is written to an autocompletion index
+#define AUTOCOMPLETE_INDEX_MAGIC wxT("wxMaxima autocompletion index")
+//! Needs to be increased each time the format of the index or FixTemplate() changes
+#define AUTOCOMPLETE_INDEX_VERSION 1
+
+class AutoComplete::LoaderThread : public wxThread
+{
+public:
+  LoaderThread(AutoComplete *autocomplete, wxString file, wxString privateList, wxString indexFile) :
+    wxThread(wxTHREAD_JOINABLE)
+    {
+      m_autocomplete = autocomplete;
+      m_file = file;
+      m_privateList = privateList;
+      m_indexFile = indexFile;
+    }
+protected:
+  virtual ExitCode Entry()
+    {
+      m_autocomplete->LoadWordLists(m_file, m_privateList, m_indexFile);
+      return 0;
+    }
+private:
+  AutoComplete *m_autocomplete;
+  wxString m_file;
+  wxString m_privateList;
+  wxString m_indexFile;
+};
 
 AutoComplete::AutoComplete()
 {
+  m_loader = NULL;
   m_args.Compile(wxT("[[]<([^>]*)>[]]"));
 }
 
+AutoComplete::~AutoComplete()
+{
+  WaitForLoader();
+}
+
+void AutoComplete::WaitForLoader()
+{
+  if (m_loader == NULL)
+    return;
+  m_loader->Wait();
+  delete m_loader;
+  m_loader = NULL;
+}
+
 bool AutoComplete::LoadSymbols(wxString file)
 {
   if (!wxFileExists(file))
     return false;
 
+  WaitForLoader();
+
+  Dirstructure dirstruct;
+  wxString privateList = dirstruct.UserAutocompleteFile();
+  wxString indexFile = dirstruct.AutocompleteIndexFile();
+
+  m_loader = new LoaderThread(this, file, privateList, indexFile);
+  if ((m_loader->Create() != wxTHREAD_NO_ERROR) ||
+      (m_loader->Run() != wxTHREAD_NO_ERROR))
+  {
+    // If we cannot start a thread we have to load the symbols ourself.
+    delete m_loader;
+    m_loader = NULL;
+    LoadWordLists(file, privateList, indexFile);
+  }
+
+  return true;
+}
+
+void AutoComplete::LoadWordLists(wxString file, wxString privateList, wxString indexFile)
+{
+  // We don't want a failure to read or write the index to cause an error message.
+  wxLogNull logNull;
+
+  // The regular expression m_args is used by the main thread, too.
+  wxRegEx args(wxT("[[]<([^>]*)>[]]"));
+  wxArrayString wordList[3];
+
+  if (!ReadIndex(indexFile, file, wordList))
+  {
+    ParseSymbolFile(file, wordList, args);
+    for(int i=command;i<=unit;i++)
+      SortAndUnique(wordList[i]);
+    WriteIndex(indexFile, file, wordList);
+  }
+
+  AddBuiltinSymbols(wordList);
+
+  /// Load private symbol list (do something different on Windows).
+  if (wxFileExists(privateList))
+    ParseSymbolFile(privateList, wordList, args);
+
+  for(int i=command;i<=unit;i++)
+    SortAndUnique(wordList[i]);
+
+  wxCriticalSectionLocker lock(m_lock);
+
+  // Keep the symbols maxima has told us about while we were loading.
   for(int i=command;i<=unit;i++)
   {
-    if (m_wordList[i].GetCount()!=0)
-      m_wordList[i].Clear();
+    for(size_t j=0;j<m_wordList[i].GetCount();j++)
+      InsertWord(wordList[i], m_wordList[i][j], (autoCompletionType) i);
+    m_wordList[i] = wordList[i];
   }
- 
+}
+
+void AutoComplete::ParseSymbolFile(wxString file, wxArrayString *wordList, wxRegEx &args)
+{
   wxString line;
-  wxString rest, function;
   wxTextFile index(file);
 
-  index.Open();
+  if (!index.Open())
+    return;
 
   for(line = index.GetFirstLine(); !index.Eof(); line = index.GetNextLine())
   {
     if (line.StartsWith(wxT("FUNCTION: ")) ||
         line.StartsWith(wxT("OPTION  : ")))
-      m_wordList[command].Add(line.Mid(10));
+      wordList[command].Add(line.Mid(10));
     else if (line.StartsWith(wxT("TEMPLATE: ")))
-      m_wordList[tmplte].Add(FixTemplate(line.Mid(10)));
+      wordList[tmplte].Add(FixTemplate(line.Mid(10), args));
     else if (line.StartsWith(wxT("UNIT: ")))
-      m_wordList[unit].Add(FixTemplate(line.Mid(6)));
+      wordList[unit].Add(FixTemplate(line.Mid(6), args));
   }
 
   index.Close();
+}
 
+void AutoComplete::AddBuiltinSymbols(wxArrayString *wordList)
+{
   /// Add wxMaxima functions
-  m_wordList[command].Add(wxT("wxanimate_framerate"));
-  m_wordList[command].Add(wxT("wxplot_pngcairo"));
-  m_wordList[command].Add(wxT("set_display"));
-  m_wordList[command].Add(wxT("wxplot2d"));
-  m_wordList[tmplte].Add(wxT("wxplot2d(<expr>,<x_range>)"));
-  m_wordList[command].Add(wxT("wxplot3d"));
-  m_wordList[tmplte].Add(wxT("wxplot3d(<expr>,<x_range>,<y_range>)"));
-  m_wordList[command].Add(wxT("wximplicit_plot"));
-  m_wordList[command].Add(wxT("wxcontour_plot"));
-  m_wordList[command].Add(wxT("wxanimate"));
-  m_wordList[command].Add(wxT("wxanimate_draw"));
-  m_wordList[command].Add(wxT("wxanimate_draw3d"));
-  m_wordList[command].Add(wxT("with_slider"));
-  m_wordList[tmplte].Add(wxT("with_slider(<a_var>,<a_list>,<expr>,<x_range>)"));
-  m_wordList[command].Add(wxT("with_slider_draw"));
-  m_wordList[command].Add(wxT("with_slider_draw3d"));
-  m_wordList[command].Add(wxT("wxdraw"));
-  m_wordList[command].Add(wxT("wxdraw2d"));
-  m_wordList[command].Add(wxT("wxdraw3d"));
-  m_wordList[command].Add(wxT("wxfilename"));
-  m_wordList[command].Add(wxT("wxhistogram"));
-  m_wordList[command].Add(wxT("wxscatterplot"));
-  m_wordList[command].Add(wxT("wxbarsplot"));
-  m_wordList[command].Add(wxT("wxpiechart"));
-  m_wordList[command].Add(wxT("wxboxplot"));
-  m_wordList[command].Add(wxT("wxplot_size"));
-  m_wordList[command].Add(wxT("wxdraw_list"));
-  m_wordList[command].Add(wxT("wxbuild_info"));
-  m_wordList[command].Add(wxT("show_image"));
-  m_wordList[tmplte ].Add(wxT("show_image(<imagename>)"));
-  m_wordList[command].Add(wxT("table_form"));
-  m_wordList[tmplte].Add(wxT("table_form(<data>)"));
-  m_wordList[tmplte].Add(wxT("table_form(<data>,<[options]>)"));
-  m_wordList[command].Add(wxT("wxsubscripts"));
-  m_wordList[command].Add(wxT("wxdeclare_subscripted"));
-  m_wordList[tmplte].Add(wxT("wxdeclare_subscripted(<name>,<[false]>)"));
+  wordList[command].Add(wxT("wxanimate_framerate"));
+  wordList[command].Add(wxT("wxplot_pngcairo"));
+  wordList[command].Add(wxT("set_display"));
+  wordList[command].Add(wxT("wxplot2d"));
+  wordList[tmplte].Add(wxT("wxplot2d(<expr>,<x_range>)"));
+  wordList[command].Add(wxT("wxplot3d"));
+  wordList[tmplte].Add(wxT("wxplot3d(<expr>,<x_range>,<y_range>)"));
+  wordList[command].Add(wxT("wximplicit_plot"));
+  wordList[command].Add(wxT("wxcontour_plot"));
+  wordList[command].Add(wxT("wxanimate"));
+  wordList[command].Add(wxT("wxanimate_draw"));
+  wordList[command].Add(wxT("wxanimate_draw3d"));
+  wordList[command].Add(wxT("with_slider"));
+  wordList[tmplte].Add(wxT("with_slider(<a_var>,<a_list>,<expr>,<x_range>)"));
+  wordList[command].Add(wxT("with_slider_draw"));
+  wordList[command].Add(wxT("with_slider_draw3d"));
+  wordList[command].Add(wxT("wxdraw"));
+  wordList[command].Add(wxT("wxdraw2d"));
+  wordList[command].Add(wxT("wxdraw3d"));
+  wordList[command].Add(wxT("wxfilename"));
+  wordList[command].Add(wxT("wxhistogram"));
+  wordList[command].Add(wxT("wxscatterplot"));
+  wordList[command].Add(wxT("wxbarsplot"));
+  wordList[command].Add(wxT("wxpiechart"));
+  wordList[command].Add(wxT("wxboxplot"));
+  wordList[command].Add(wxT("wxplot_size"));
+  wordList[command].Add(wxT("wxdraw_list"));
+  wordList[command].Add(wxT("wxbuild_info"));
+  wordList[command].Add(wxT("show_image"));
+  wordList[tmplte ].Add(wxT("show_image(<imagename>)"));
+  wordList[command].Add(wxT("table_form"));
+  wordList[tmplte].Add(wxT("table_form(<data>)"));
+  wordList[tmplte].Add(wxT("table_form(<data>,<[options]>)"));
+  wordList[command].Add(wxT("wxsubscripts"));
+  wordList[command].Add(wxT("wxdeclare_subscripted"));
+  wordList[tmplte].Add(wxT("wxdeclare_subscripted(<name>,<[false]>)"));
+}
 
-  /// Load private symbol list (do something different on Windows).
-  wxString privateList;
-  Dirstructure dirstruct;
-  
-  privateList = dirstruct.UserAutocompleteFile();
+bool AutoComplete::ReadIndex(wxString indexFile, wxString file, wxArrayString *wordList)
+{
+  if (!wxFileExists(indexFile))
+    return false;
 
-  if (wxFileExists(privateList))
+  // Read the whole index at once and parse it from memory.
+  wxFile input(indexFile);
+  if (!input.IsOpened())
+    return false;
+  wxFileOffset length = input.Length();
+  if (length <= 0)
+    return false;
+  wxMemoryBuffer buffer(length);
+  if (input.Read(buffer.GetWriteBuf(length), length) != length)
+    return false;
+  buffer.UngetWriteBuf(length);
+  input.Close();
+
+  wxMemoryInputStream istream(buffer.GetData(), buffer.GetDataLen());
+  wxDataInputStream data(istream);
+
+  if (data.ReadString() != AUTOCOMPLETE_INDEX_MAGIC)
+    return false;
+  if (data.Read32() != AUTOCOMPLETE_INDEX_VERSION)
+    return false;
+
+  // Is this the index for the current version of file?
+  wxFileName source(file);
+  if (data.ReadString() != source.GetFullPath())
+    return false;
+  if (data.Read64() != wxUint64(source.GetModificationTime().GetValue().GetValue()))
+    return false;
+  if (data.Read64() != wxUint64(source.GetSize().GetValue()))
+    return false;
+
+  for(int i=command;i<=unit;i++)
+  {
+    wxUint32 count = data.Read32();
+    if (!istream.IsOk())
+      return false;
+    wordList[i].Alloc(count);
+    for(wxUint32 j=0;j<count;j++)
+      wordList[i].Add(data.ReadString());
+  }
+
+  if (!istream.IsOk())
   {
-    wxTextFile priv(privateList);
+    for(int i=command;i<=unit;i++)
+      wordList[i].Clear();
+    return false;
+  }
+  return true;
+}
+
+void AutoComplete::WriteIndex(wxString indexFile, wxString file, wxArrayString *wordList)
+{
+  // Write to a temporary file first so no other wxMaxima can read a half-written
+  // index.
+  wxString tempFile = indexFile + wxT("~");
+  {
+    wxFileOutputStream ostream(tempFile);
+    if (!ostream.IsOk())
+      return;
+    wxDataOutputStream data(ostream);
 
-    priv.Open();
+    data.WriteString(AUTOCOMPLETE_INDEX_MAGIC);
+    data.Write32(AUTOCOMPLETE_INDEX_VERSION);
 
-    for(line = priv.GetFirstLine(); !priv.Eof(); line = priv.GetNextLine())
+    wxFileName source(file);
+    data.WriteString(source.GetFullPath());
+    data.Write64(wxUint64(source.GetModificationTime().GetValue().GetValue()));
+    data.Write64(wxUint64(source.GetSize().GetValue()));
+
+    for(int i=command;i<=unit;i++)
+    {
+      data.Write32(wordList[i].GetCount());
+      for(size_t j=0;j<wordList[i].GetCount();j++)
+        data.WriteString(wordList[i][j]);
+    }
+
+    if (!ostream.Close())
     {
-      if (line.StartsWith(wxT("FUNCTION: ")) ||
-          line.StartsWith(wxT("OPTION  : ")))
-        m_wordList[command].Add(line.Mid(10));
-      else if (line.StartsWith(wxT("TEMPLATE: ")))
-        m_wordList[tmplte].Add(FixTemplate(line.Mid(10)));
-      else if (line.StartsWith(wxT("UNIT: ")))
-        m_wordList[unit].Add(FixTemplate(line.Mid(6)));      
+      wxRemoveFile(tempFile);
+      return;
     }
+  }
+  if (!wxRenameFile(tempFile, indexFile, true))
+    wxRemoveFile(tempFile);
+}
 
-    priv.Close();
+size_t AutoComplete::LowerBound(const wxArrayString &words, const wxString &word)
+{
+  size_t low = 0, high = words.GetCount();
+  while (low < high)
+  {
+    size_t mid = (low + high) / 2;
+    if (words[mid].Cmp(word) < 0)
+      low = mid + 1;
+    else
+      high = mid;
   }
+  return low;
+}
 
-  m_wordList[command].Sort();
-  m_wordList[tmplte].Sort();
-  m_wordList[unit].Sort();
+void AutoComplete::SortAndUnique(wxArrayString &words)
+{
+  words.Sort();
 
-  return false;
+  size_t count = 0;
+  for (size_t i = 0; i < words.GetCount(); i++)
+  {
+    if ((count == 0) || (words[i] != words[count - 1]))
+    {
+      if (i != count)
+        words[count] = words[i];
+      count++;
+    }
+  }
+  if (count < words.GetCount())
+    words.RemoveAt(count, words.GetCount() - count);
 }
 
 /// Returns a string array with functions which start with partial.
@@ -137,29 +331,20 @@ wxArrayString AutoComplete::CompleteSymbol(wxString partial, autoCompletionType
   wxArrayString perfectCompletions;
 
   wxASSERT_MSG((type>=command)&&(type<=unit),_("Bug: Autocompletion requested for unknown type of item."));
-  
-  if (type != tmplte) {
-    for (int i=0; i<m_wordList[type].GetCount(); i++)
-    {
-      if (m_wordList[type][i].StartsWith(partial) &&
-          completions.Index(m_wordList[type][i]) == wxNOT_FOUND)
-        completions.Add(m_wordList[type][i]);
-    }
-  }
 
-  else {
-    for (int i=0; i<m_wordList[type].GetCount(); i++)
-    {
-      wxString templ = m_wordList[type][i];
-      if (templ.StartsWith(partial))
-      {
-        if (completions.Index(templ) == wxNOT_FOUND)
-          completions.Add(templ);
-        if (templ.SubString(0, templ.Find(wxT("(")) - 1) == partial &&
-            perfectCompletions.Index(templ) == wxNOT_FOUND)
-          perfectCompletions.Add(templ);
-      }
-    }
+  wxCriticalSectionLocker lock(m_lock);
+
+  // The word list is sorted and free of duplicates, so all matches follow
+  // each other starting at the first word that isn't smaller than partial.
+  for (size_t i = LowerBound(m_wordList[type], partial);
+       (i < m_wordList[type].GetCount()) && m_wordList[type][i].StartsWith(partial);
+       i++)
+  {
+    wxString word = m_wordList[type][i];
+    completions.Add(word);
+    if ((type == tmplte) &&
+        (word.SubString(0, word.Find(wxT("(")) - 1) == partial))
+      perfectCompletions.Add(word);
   }
 
   if (perfectCompletions.Count() > 0)
@@ -186,35 +371,48 @@ void AutoComplete::AddSymbol(wxString fun, autoCompletionType type)
     type = unit;
   }
 
+  if (type == tmplte)
+    fun = FixTemplate(fun);
+
+  wxCriticalSectionLocker lock(m_lock);
+  InsertWord(m_wordList[type], fun, type);
+}
+
+void AutoComplete::InsertWord(wxArrayString &words, wxString word, autoCompletionType type)
+{
   /// Add symbols
-  if ((type != tmplte) && m_wordList[type].Index(fun, true, true) == wxNOT_FOUND)
-    m_wordList[type].Add(fun);
+  if (type != tmplte)
+  {
+    size_t pos = LowerBound(words, word);
+    if ((pos == words.GetCount()) || (words[pos] != word))
+      words.Insert(word, pos);
+  }
 
   /// Add templates - for given function and given argument count we
   /// only add one template. We count the arguments by counting '<'
   if (type == tmplte)
   {
-    fun = FixTemplate(fun);
-    wxString funName = fun.SubString(0, fun.Find(wxT("(")));
-    int count = fun.Freq('<'), i=0;
-    for (i=0; i<m_wordList[type].GetCount(); i++)
+    wxString funName = word.SubString(0, word.Find(wxT("(")));
+    int count = word.Freq('<');
+    size_t i;
+    for (i = LowerBound(words, funName);
+         (i < words.GetCount()) && words[i].StartsWith(funName);
+         i++)
     {
-      wxString t = m_wordList[type][i];
-      if (t.StartsWith(funName) && t.Freq('<') == count)
-        break;
+      if (words[i].Freq('<') == count)
+        return;
     }
-    if (i == m_wordList[type].GetCount())
-      m_wordList[type].Add(fun);
+    words.Insert(word, LowerBound(words, word));
   }
 }
 
-wxString AutoComplete::FixTemplate(wxString templ)
+wxString AutoComplete::FixTemplate(wxString templ, wxRegEx &args)
 {
   templ.Replace(wxT(" "), wxEmptyString);
   templ.Replace(wxT(",..."), wxEmptyString);
 
   /// This will change optional arguments
-  m_args.ReplaceAll(&templ, wxT("<[\\1]>"));
+  args.ReplaceAll(&templ, wxT("<[\\1]>"));
 
   return templ;
 }
@@ -25,6 +25,7 @@
 #include <wx/wx.h>
 #include <wx/arrstr.h>
 #include <wx/regex.h>
+#include <wx/thread.h>
 
 class AutoComplete
 {
@@ -38,12 +39,81 @@ public:
   };
     
   AutoComplete();
+  //! Waits for a background thread LoadSymbols() might have started.
+  ~AutoComplete();
+  /*! Load the words that can be completed
+
+    The words are loaded in a background thread so this function returns 
+    immediately. Until the thread has finished only the words AddSymbol()
+    has been called for can be completed.
+
+    Parsing file is slow since every template has to be run through a regular
+    expression. Therefore the parsed version of file is cached in a binary
+    index (Dirstructure::AutocompleteIndexFile()) that is used as long as file
+    doesn't change. The user's private list of words (see 
+    Dirstructure::UserAutocompleteFile()) is small and therefore is read
+    every time instead.
+
+    \return false, if file doesn't exist.
+   */
   bool LoadSymbols(wxString file);
+  /*! Add a symbol to the list of words that can be completed
+
+    Inserting a symbol that is already known does nothing. For templates only 
+    one template per function name and number of arguments is kept.
+   */
   void AddSymbol(wxString fun, autoCompletionType type=command);
+  //! All words of the type type that start with partial
   wxArrayString CompleteSymbol(wxString partial, autoCompletionType type=command);
-  wxString FixTemplate(wxString templ);
+  wxString FixTemplate(wxString templ){return FixTemplate(templ, m_args);}
+  //! A version of FixTemplate() that can be used by more than one thread
+  static wxString FixTemplate(wxString templ, wxRegEx &args);
+  /*! The index of the first entry of the sorted list words that isn't smaller than word
+
+    As words is sorted all words that start with a given prefix
+    begin at the index this function returns for the prefix.
+   */
+  static size_t LowerBound(const wxArrayString &words, const wxString &word);
+  //! Sort words and drop all words that are in there twice.
+  static void SortAndUnique(wxArrayString &words);
 private:
+  //! The thread LoadSymbols() loads the words in
+  class LoaderThread;
+  /*! Load the words from all sources and replace m_wordList by them
+
+    This is what the thread LoadSymbols() starts does.
+   */
+  void LoadWordLists(wxString file, wxString privateList, wxString indexFile);
+  //! Wait until the thread LoadSymbols() has started has finished
+  void WaitForLoader();
+  //! Add the words from a file in the format of autocomplete.txt to wordList
+  static void ParseSymbolFile(wxString file, wxArrayString *wordList, wxRegEx &args);
+  //! Add the functions wxMaxima defines itself to wordList
+  static void AddBuiltinSymbols(wxArrayString *wordList);
+  /*! Read the word lists from the index that has been created for file
+
+    \return false, if there is no index or it has been created for a different
+    version of file.
+   */
+  static bool ReadIndex(wxString indexFile, wxString file, wxArrayString *wordList);
+  //! Write the word lists parsed from file to an index
+  static void WriteIndex(wxString indexFile, wxString file, wxArrayString *wordList);
+  /*! Add word to the sorted list words
+
+    Inserting a word that is already known does nothing. For templates only 
+    one template per function name and number of arguments is kept.
+   */
+  static void InsertWord(wxArrayString &words, wxString word, autoCompletionType type);
+  /*! The words we can complete
+
+    Each list is sorted and doesn't contain any word twice which allows us to
+    find all words starting with a given prefix by a binary search.
+   */
   wxArrayString m_wordList[3];
+  //! Protects m_wordList against being accessed by the loader thread and us at once
+  wxCriticalSection m_lock;
+  //! The thread LoadSymbols() has started or NULL
+  LoaderThread *m_loader;
   wxRegEx m_args;
 };
 
@@ -259,7 +259,25 @@ void Bitmap::Draw()
   m_ppi.y *= m_scale;
 }
 
-wxSize Bitmap::ToFile(wxString file)
+//! Writes a .png file in a background thread
+class PNGFileJob : public WorkerPool::Job
+{
+public:
+  PNGFileJob(wxString file, const wxImage &image) : m_image(image)
+    {
+      // We mustn't share string data with the thread that created us.
+      m_file = file.Clone();
+    }
+  virtual void Run()
+    {
+      m_ok = m_image.SaveFile(m_file, wxBITMAP_TYPE_PNG);
+    }
+private:
+  wxString m_file;
+  wxImage m_image;
+};
+
+wxSize Bitmap::ToFile(wxString file, WorkerPool *pool)
 {
   bool success = false;
   if (file.Right(4) == wxT(".bmp"))
@@ -272,7 +290,16 @@ wxSize Bitmap::ToFile(wxString file)
   {
     if (file.Right(4) != wxT(".png"))
       file = file + wxT(".png");
-    success = m_bmp.SaveFile(file, wxBITMAP_TYPE_PNG);
+    if (pool != NULL)
+    {
+      // Converting the bitmap is fast, compressing the image is what takes long.
+      wxImage image = m_bmp.ConvertToImage();
+      success = image.IsOk();
+      if (success)
+        pool->Add(new PNGFileJob(file, image));
+    }
+    else
+      success = m_bmp.SaveFile(file, wxBITMAP_TYPE_PNG);
   }
 
   wxSize retval;
@@ -23,6 +23,7 @@
 #define BITMAP_H
 
 #include "MathCell.h"
+#include "WorkerPool.h"
 
 class Bitmap
 {
@@ -32,9 +33,14 @@ public:
   void SetData(MathCell* tree);
   /*! Exports this bitmap to a file
 
+    \param file The name of the file
+    \param pool If this isn't NULL and a .png file is to be created the png
+    compression is left to this pool. The file therefore only exists after
+    pool->Run() has been called and only pool->Run() can tell if writing it
+    has succeeded.
     \return The size of the bitmap in millimeters. Sizes <0 indicate that the export has failed.
    */
-  wxSize ToFile(wxString file);
+  wxSize ToFile(wxString file, WorkerPool *pool = NULL);
   bool ToClipboard();
 protected:
   void DestroyTree();
@@ -84,6 +84,39 @@ CellParser::CellParser(wxDC& dc, double scale) : m_dc(dc)
 CellParser::~CellParser()
 {}
 
+void CellParser::GetTextExtent(const wxString &text, wxCoord *width, wxCoord *height)
+{
+  // The same font can produce different sizes on a printer and on the screen
+  // and a bitmap that is drawn at a user scale measures text in its own
+  // coordinates => the resolution and the scale are part of the key.
+  wxSize ppi = m_dc.GetPPI();
+  double scaleX, scaleY;
+  m_dc.GetUserScale(&scaleX, &scaleY);
+  wxString key = wxString::Format(wxT("%i,%i,%g,%g:"), ppi.x, ppi.y, scaleX, scaleY) +
+    m_dc.GetFont().GetNativeFontInfoDesc() + wxT("\n") + text;
+
+  std::map<wxString, wxSize>::iterator it = m_textExtentCache.find(key);
+  if(it != m_textExtentCache.end())
+  {
+    *width  = it->second.x;
+    *height = it->second.y;
+    return;
+  }
+
+  m_dc.GetTextExtent(text, width, height);
+
+  if(m_textExtentCache.size() >= m_textExtentCacheMaxSize)
+    m_textExtentCache.clear();
+  m_textExtentCache[key] = wxSize(*width, *height);
+}
+
+void CellParser::ClearTextExtentCache()
+{
+  m_textExtentCache.clear();
+}
+
+std::map<wxString, wxSize> CellParser::m_textExtentCache;
+
 wxString CellParser::GetFontName(int type)
 {
   if (type == TS_TITLE || type == TS_SUBSECTION || type == TS_SUBSUBSECTION || type == TS_SECTION || type == TS_TEXT)
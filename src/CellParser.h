@@ -23,6 +23,7 @@
 
 #include <wx/wx.h>
 #include <wx/fontenum.h>
+#include <map>
 
 #include "TextStyle.h"
 
@@ -35,6 +36,7 @@ public:
   CellParser(wxDC& dc, double scale);
   ~CellParser();
   void SetZoomFactor(double newzoom) { m_zoomFactor = newzoom; }
+  double GetZoomFactor() { return m_zoomFactor; }
   void SetScale(double scale) { m_scale = scale; }
   double GetScale() { return m_scale; }
   wxDC& GetDC() { return m_dc; }
@@ -99,7 +101,24 @@ public:
   wxString GetTeXCMTI() { return m_fontCMTI; }
   void SetPrinter(bool printer) { m_printer = printer; }
   bool GetPrinter() { return m_printer; }
+  /*! Determine the size of a text in the font currently selected in our device context
+
+    The results are kept in a metrics cache that is shared by all CellParsers so a
+    forced recalculation of a worksheet only measures each combination of font and
+    text once. Like all measuring, this must only be called from the GUI thread.
+   */
+  void GetTextExtent(const wxString &text, wxCoord *width, wxCoord *height);
+  /*! Empty the metrics cache GetTextExtent() uses.
+
+    Needs to be called if the fonts or the styles might have changed: A font that
+    has been installed or replaced keeps its description, but not its metrics.
+   */
+  static void ClearTextExtentCache();
 private:
+  //! The maximum number of text sizes GetTextExtent() remembers
+  static const size_t m_textExtentCacheMaxSize = 50000;
+  //! The sizes GetTextExtent() has already measured, by device resolution, user scale, font and text
+  static std::map<wxString, wxSize> m_textExtentCache;
   int m_indent;
   double m_scale;
   double m_zoomFactor;
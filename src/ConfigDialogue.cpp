@@ -205,6 +205,7 @@ void ConfigDialogue::SetProperties()
   m_changeAsterisk->SetToolTip(_("Use centered dot character for multiplication"));
   m_defaultPort->SetToolTip(_("The default port used for communication between Maxima and wxMaxima."));
   m_undoLimit->SetToolTip(_("Save only this number of actions in the undo buffer. 0 means: save an infinite number of actions."));
+  m_undoMemoryLimit->SetToolTip(_("The number of megabytes the cells deleted from the worksheet may occupy in the undo buffer. If they need more memory the output of the oldest of them is discarded first. 0 means: no limit."));
 
   #ifdef __WXMSW__
   m_wxcd->SetToolTip(_("Automatically change maxima's working directory to the one the current document is in: "
@@ -231,6 +232,7 @@ void ConfigDialogue::SetProperties()
 
   int labelWidth = 4;
   int  undoLimit = 0;
+  int  undoMemoryLimit = 64;
   int showLength = 0;
   int autosubscript = 1;
   int  bitmapScale = 3;
@@ -296,6 +298,7 @@ void ConfigDialogue::SetProperties()
   config->Read(wxT("cursorJump"), &cursorJump);
   config->Read(wxT("labelWidth"), &labelWidth);
   config->Read(wxT("undoLimit"), &undoLimit);
+  config->Read(wxT("undoMemoryLimit"), &undoMemoryLimit);
   config->Read(wxT("bitmapScale"), &bitmapScale);
   config->Read(wxT("fixReorderedIndices"), &fixReorderedIndices);
   config->Read(wxT("showUserDefinedLabels"), &showUserDefinedLabels);
@@ -365,6 +368,7 @@ void ConfigDialogue::SetProperties()
   m_cursorJump->SetValue(cursorJump);
   m_labelWidth->SetValue(labelWidth);
   m_undoLimit->SetValue(undoLimit);
+  m_undoMemoryLimit->SetValue(undoMemoryLimit);
   m_bitmapScale->SetValue(bitmapScale);
   m_fixReorderedIndices->SetValue(fixReorderedIndices);
   m_showUserDefinedLabels->SetValue(showUserDefinedLabels);
@@ -590,6 +594,11 @@ wxPanel* ConfigDialogue::CreateOptionsPanel()
   grid_sizer->Add(ul, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
   grid_sizer->Add(m_undoLimit, 0, wxALL, 5);
 
+  wxStaticText* um = new wxStaticText(panel, -1, _("Undo memory limit (MB, 0 for none):"));
+  m_undoMemoryLimit = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 0, 10000);
+  grid_sizer->Add(um, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+  grid_sizer->Add(m_undoMemoryLimit, 0, wxALL, 5);
+
   wxStaticText* df = new wxStaticText(panel, -1, _("Default animation framerate:"));
   m_defaultFramerate = new wxSpinCtrl(panel, -1, wxEmptyString, wxDefaultPosition, wxSize(100, -1), wxSP_ARROW_KEYS, 1, 200);
   grid_sizer->Add(df, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
@@ -831,6 +840,7 @@ void ConfigDialogue::WriteSettings()
   config->Write(wxT("cursorJump"), m_cursorJump->GetValue());
   config->Write(wxT("labelWidth"), m_labelWidth->GetValue());
   config->Write(wxT("undoLimit"), m_undoLimit->GetValue());
+  config->Write(wxT("undoMemoryLimit"), m_undoMemoryLimit->GetValue());
   config->Write(wxT("bitmapScale"), m_bitmapScale->GetValue());
   config->Write(wxT("fixReorderedIndices"), m_fixReorderedIndices->GetValue());
   config->Write(wxT("showUserDefinedLabels"), m_showUserDefinedLabels->GetValue());
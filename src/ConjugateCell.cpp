@@ -140,9 +140,9 @@ wxString ConjugateCell::ToMathML()
     wxT("<mo>&#xaf;</mo></mover>\n");
 }
 
-wxString ConjugateCell::ToXML()
+wxString ConjugateCell::ToXML(WXMXImageList &images)
 {
-  return wxT("<cj>") + m_innerCell->ListToXML() + wxT("</cj>");
+  return wxT("<cj>") + m_innerCell->ListToXML(images) + wxT("</cj>");
 }
 
 void ConjugateCell::SelectInner(wxRect& rect, MathCell **first, MathCell **last)
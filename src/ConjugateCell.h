@@ -53,7 +53,7 @@ protected:
   wxString ToString();
   wxString ToTeX();
   wxString ToMathML();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
 };
 
 #endif // CONJUGATECELL_H
@@ -0,0 +1,201 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "Delimiters.h"
+
+wxString Delimiters::Scan(const wxString &text,
+                          std::vector<size_t> *positions,
+                          std::vector<long> *matches)
+{
+  size_t len = text.Length();
+  size_t index = 0;
+
+  if(positions)
+    positions->clear();
+  if(matches)
+    matches->clear();
+
+  // The first problem we have found. We continue scanning after having found
+  // one in order to find the matches of all delimiters.
+  wxString error;
+  if(text.Right(1) == wxT("\\"))
+    error = _("Cell ends in a backslash");
+
+  // The parenthesis that haven't been closed yet and the number of their
+  // entries in positions.
+  std::vector<wxChar> delimiters;
+  std::vector<size_t> openDelimiters;
+  size_t numberOfDelimiters = 0;
+
+  bool lisp = false;
+
+  wxChar lastC=wxT(';');
+  wxChar lastnonWhitespace=wxT(',');
+  while(index<len)
+  {
+    wxChar c=text[index];
+
+    switch(c)
+    {
+    case wxT('('):
+    case wxT('['):
+    case wxT('{'):
+      if(c == wxT('('))
+        delimiters.push_back(wxT(')'));
+      else if(c == wxT('['))
+        delimiters.push_back(wxT(']'));
+      else
+        delimiters.push_back(wxT('}'));
+      openDelimiters.push_back(numberOfDelimiters++);
+      if(positions)
+        positions->push_back(index);
+      if(matches)
+        matches->push_back(-1);
+      lastC=c;
+      break;
+
+    case wxT(')'):
+    case wxT(']'):
+    case wxT('}'):
+      if(positions)
+        positions->push_back(index);
+      if(matches)
+        matches->push_back(-1);
+      if(delimiters.empty() || (c!=delimiters.back()))
+      {
+        if(error.IsEmpty())
+          error = _("Mismatched parenthesis");
+      }
+      else
+      {
+        if(positions && matches)
+        {
+          (*matches)[openDelimiters.back()] = index;
+          matches->back() = (*positions)[openDelimiters.back()];
+        }
+        delimiters.pop_back();
+        openDelimiters.pop_back();
+      }
+      numberOfDelimiters++;
+      lastC=c;
+      if((lastnonWhitespace==wxT(',')) && error.IsEmpty())
+        error = _("Comma directly followed by a closing parenthesis");
+      break;
+
+    case wxT('\\'):
+      index++;
+      lastC=c;
+      break;
+
+    case wxT('\"'):
+    {
+      size_t start = index;
+      index++;
+      while((index<len)&&(c=text[index])!=wxT('\"'))
+      {
+        if(c==wxT('\\'))
+          index++;
+        index++;
+      }
+      if(index>=len)
+      {
+        if(error.IsEmpty())
+          error = _("Unterminated string.");
+        if(positions)
+          positions->push_back(start);
+        if(matches)
+          matches->push_back(-1);
+        numberOfDelimiters++;
+        index = len;
+        break;
+      }
+      if(positions)
+      {
+        positions->push_back(start);
+        positions->push_back(index);
+      }
+      if(matches)
+      {
+        matches->push_back(index);
+        matches->push_back(start);
+      }
+      numberOfDelimiters += 2;
+      lastC=c;
+      break;
+    }
+
+    case wxT(':'):
+      if(text.Mid(index + 1, 4) == wxT("lisp"))
+        lisp = true;
+      lastC=c;
+      break;
+      
+    case wxT(';'):
+    case wxT('$'):
+      if((!lisp) && (!delimiters.empty()) && error.IsEmpty())
+        error = _("Un-closed parenthesis on encountering ; or $");
+      lastC=c;
+      break;      
+      
+    case wxT('/'):
+      if(index<len-1)
+      {
+        if(text[index + 1]==wxT('*'))
+        {
+          index=text.find(wxT("*/"),index);
+          if(index==wxString::npos)
+          {
+            if(error.IsEmpty())
+              error = _("Unterminated comment.");
+            index = len;
+            break;
+          }
+        }
+        else lastC=c;
+      }
+    default:
+      if((c!=wxT('\n')) && (c!=wxT(' '))&& (c!=wxT('\t')))
+        lastC=c;
+    }
+
+    if(
+      (c!=wxT(' ')) &&
+      (c!=wxT('\t')) &&
+      (c!=wxT('\n')) &&
+      (c!=wxT('\r'))
+      )
+      lastnonWhitespace = c;
+
+    index++;
+  }
+
+  if(!error.IsEmpty())
+    return error;
+
+  if(!delimiters.empty())
+    return _("Un-closed parenthesis");
+
+  if((!lisp))
+  {
+    if((lastC!=wxT(';'))&&(lastC!=wxT('$')))
+      return _("No dollar ($) or semicolon (;) at the end of command");      
+  }
+  return wxEmptyString;
+}
@@ -0,0 +1,49 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef DELIMITERS_H
+#define DELIMITERS_H
+
+#include <wx/wx.h>
+
+#include <vector>
+
+//! Finds the parenthesis, brackets and quotes of maxima code
+class Delimiters
+{
+public:
+  /*! Find all parenthesis, brackets and quotes in text and the ones that match them
+
+    Parenthesis that are part of strings or comments are ignored.
+
+    \param text The text to scan
+    \param positions If not NULL: Receives the positions of all delimiters in 
+    ascending order.
+    \param matches If not NULL: Receives the position of the delimiter each
+    delimiter in positions matches or -1, if there is none.
+    \return A message describing the first problem with the parenthesis or the
+    command endings text contains or wxEmptyString, if there is none.
+   */
+  static wxString Scan(const wxString &text,
+                       std::vector<size_t> *positions = NULL,
+                       std::vector<long> *matches = NULL);
+};
+
+#endif // DELIMITERS_H
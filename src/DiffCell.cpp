@@ -161,9 +161,9 @@ wxString DiffCell::ToMathML()
   return retval;
 }
 
-wxString DiffCell::ToXML()
+wxString DiffCell::ToXML(WXMXImageList &images)
 {
-  return _T("<d>") + m_diffCell->ListToXML() + m_baseCell->ListToXML() + _T("</d>");
+  return _T("<d>") + m_diffCell->ListToXML(images) + m_baseCell->ListToXML(images) + _T("</d>");
 }
 
 void DiffCell::SelectInner(wxRect& rect, MathCell** first, MathCell** last)
@@ -73,6 +73,16 @@ public:
 
   //! The path to wxMaxima's own AutoComplete file
   wxString AutocompleteFile() {return DataDir() + wxT("autocomplete.txt");}
+
+  /*! The file the precompiled version of AutocompleteFile() is cached in
+
+    See AutoComplete::LoadSymbols().
+   */
+#if defined __WXMSW__
+  wxString AutocompleteIndexFile() {return UserConfDir()+wxT("wxmax.acidx");}
+#else
+  wxString AutocompleteIndexFile() {return UserConfDir()+wxT(".wxmaxima.acidx");}
+#endif
   
   //! The directory art is stored relative to
 #if defined __WXMAC__
@@ -27,12 +27,17 @@
 #include "wxMaxima.h"
 #include "wxMaximaFrame.h"
 #include <wx/tokenzr.h>
+#include <algorithm>
 
 #define ESC_CHAR wxT('\xA6')
 
 const wxString operators = wxT("+-*/^:=#'!\";$");
 
 wxString EditorCell::m_selectionString;
+std::list<EditorCell *> EditorCell::m_undoCells;
+long EditorCell::m_undoBytesTotal = 0;
+long EditorCell::m_undoBudgetCell = 1024 * 1024;
+long EditorCell::m_undoBudgetTotal = 16 * 1024 * 1024;
 
 EditorCell::EditorCell(wxString text) : MathCell()
 {
@@ -62,11 +67,18 @@ EditorCell::EditorCell(wxString text) : MathCell()
   m_containsChangesCheck = false;
   m_firstLineOnly = false;
   m_historyPosition = -1;
+  m_undoStepBytes = 0;
+  m_undoBytes = 0;
+  m_styledTextLaidOut = false;
+  m_textVersion = 0;
+  m_lineIndexVersion = -1;
+  m_delimiterIndexVersion = -1;
   m_text = TabExpand(text,0);
 }
 
 EditorCell::~EditorCell()
 {
+  ClearUndo();
   if (m_next != NULL)
     delete m_next;
 }
@@ -116,10 +128,12 @@ MathCell *EditorCell::Copy()
   EditorCell *tmp = new EditorCell();
   // We cannot use SetValue() here, since SetValue() sometimes has the task to change
   //  the cell's contents
-  tmp->m_text = m_text;
+  tmp->SetText(m_text);
   tmp->m_containsChanges = m_containsChanges;
   CopyData(this, tmp);
   tmp->m_styledText = m_styledText;
+  tmp->m_styledLines = m_styledLines;
+  tmp->m_styledTextLaidOut = m_styledTextLaidOut;
 
   return tmp;
 }
@@ -257,7 +271,7 @@ wxString EditorCell::ToTeX()
   return text;
 }
 
-wxString EditorCell::ToXML()
+wxString EditorCell::ToXML(WXMXImageList &images)
 {
   wxString xmlstring = m_text;
   // convert it, so that the XML parser doesn't fail
@@ -312,31 +326,16 @@ void EditorCell::RecalculateWidths(CellParser& parser, int fontsize)
 
     dc.GetTextExtent(wxT("X"), &charWidth, &m_charHeight);
 
-    unsigned int newLinePos = 0, prevNewLinePos = 0;
-    int width = 0, width1, height1;
-
-    m_numberOfLines = 1;
-
-    while (newLinePos < m_text.Length())
+    // The width of a line is the position of its end.
+    LayOutStyledText(dc);
+    int width = 0;
+    for (size_t line = 0; line < m_styledLines.size(); line++)
     {
-      while (newLinePos < m_text.Length())
-      {
-        if (m_text.GetChar(newLinePos) == '\n')
-          break;
-        newLinePos++;
-      }
-
-      dc.GetTextExtent(m_text.SubString(prevNewLinePos, newLinePos), &width1, &height1);
-      width = MAX(width, width1);
-
-      while (newLinePos < m_text.Length() && m_text.GetChar(newLinePos) == '\n')
-      {
-        newLinePos++;
-        m_numberOfLines++;
-      }
-
-      prevNewLinePos = newLinePos;
+      size_t end = StyledLineEnd(line);
+      if (end > m_styledLines[line])
+        width = MAX(width, m_styledText[end - 1].GetX() + m_styledText[end - 1].GetWidth());
     }
+    m_numberOfLines = m_styledLines.size();
 
     // new
     if (m_firstLineOnly)
@@ -360,12 +359,10 @@ wxString EditorCell::ToHTML()
 
   while(tmp != NULL)
   {
-    std::list<StyledText> styledText = tmp->m_styledText;
-    while(!styledText.empty())
+    for (size_t i = 0; i < tmp->m_styledText.size(); i++)
     {
       // Grab a portion of text from the list.
-      StyledText TextSnippet = styledText.front();
-      styledText.pop_front();
+      StyledText &TextSnippet = tmp->m_styledText[i];
 
       wxString text =  PrependNBSP(EscapeHTMLChars(TextSnippet.GetText()));
 /*      wxString tmp = EscapeHTMLChars(TextSnippet.GetText());
@@ -543,37 +540,42 @@ void EditorCell::Draw(CellParser& parser, wxPoint point1, int fontsize)
     SetPen(parser);
     SetFont(parser, fontsize);
 
+    // StyleText() replaces "*" with a centerdot if requested
+    if (m_changeAsterisk != parser.GetChangeAsterisk())
+    {
+      m_changeAsterisk = parser.GetChangeAsterisk();
+      // The text is split into different snippets now, but m_text stays the same.
+      m_lineWidths.clear();
+      StyleText();
+    }
+    if (!m_styledTextLaidOut)
+      LayOutStyledText(dc);
+
     wxPoint TextStartingpoint = point;
     // TextStartingpoint.x -= SCALE_PX(MC_TEXT_PADDING, scale);
     TextStartingpoint.x += SCALE_PX(2, scale);
     TextStartingpoint.y += SCALE_PX(2, scale);
-    wxPoint TextCurrentPoint = TextStartingpoint;
-    std::list<StyledText> styledText = m_styledText;
     int lastStyle = -1;
-    while(!styledText.empty())
+    for (size_t line = 0; line < m_styledLines.size(); line++)
     {
-      // Grab a portion of text from the list.
-      StyledText TextSnippet = styledText.front();
-      styledText.pop_front();
-      wxString TextToDraw = TextSnippet.GetText();
-      int width, height;
-      
-      // A newline is a separate token.
-      if(TextToDraw == wxT("\n"))
-      {
-        // A newline =>
-        // set the point to the beginning of the next line.
-        TextCurrentPoint.x = TextStartingpoint.x;
-        TextCurrentPoint.y += m_charHeight;
-      }
-      else
+      int y = TextStartingpoint.y + line * m_charHeight;
+
+      // Don't draw lines that aren't visible
+      if(!InUpdateRegion(wxRect(TextStartingpoint.x, y - m_center, m_width, m_charHeight)))
+        continue;
+
+      for (size_t i = m_styledLines[line]; i < StyledLineEnd(line); i++)
       {
-        // We need to draw some text.
-        
+        // Grab a portion of text from the list.
+        StyledText &TextSnippet = m_styledText[i];
+
+        // A newline is a separate token.
+        if(TextSnippet.GetText() == wxT("\n"))
+          continue;
+
         // Grab a pen of the right color.
         if(TextSnippet.StyleSet())
         {
-          wxDC& dc = parser.GetDC();
           if(lastStyle != TextSnippet.GetStyle())
           {
             dc.SetTextForeground(parser.GetColor(TextSnippet.GetStyle()));
@@ -586,23 +588,9 @@ void EditorCell::Draw(CellParser& parser, wxPoint point1, int fontsize)
           SetForeground(parser);
         }
 
-#if defined __WXMSW__ || wxUSE_UNICODE
-        // replace "*" with centerdot if requested
-        if ((m_changeAsterisk = parser.GetChangeAsterisk())!=0)
-          TextToDraw.Replace(wxT("*"), wxT("\xB7"));
-#endif
-        
-        dc.DrawText(TextToDraw,
-                    TextCurrentPoint.x,
-                    TextCurrentPoint.y - m_center);
-        /*
-        dc.DrawLine(TextCurrentPoint.x + SCALE_PX(2, scale),
-                    TextCurrentPoint.y - m_center,
-                    TextCurrentPoint.x + SCALE_PX(2, scale),
-                    TextCurrentPoint.y); */
-        
-        dc.GetTextExtent(TextToDraw, &width, &height);
-        TextCurrentPoint.x += width;
+        dc.DrawText(TextSnippet.GetText(),
+                    TextStartingpoint.x + TextSnippet.GetX(),
+                    y - m_center);
       }
     }
     //
@@ -761,28 +749,74 @@ wxString EditorCell::TabExpand(wxString input, size_t posInLine)
   return retval;
 }
 
-size_t EditorCell::BeginningOfLine(size_t pos)
+void EditorCell::UpdateLineIndex()
 {
-  if(pos>0)
-    pos--;
-  
-  while(pos > 0)
+  if (!m_lineStarts.empty() && (m_lineIndexVersion == m_textVersion))
+    return;
+
+  m_lineStarts.clear();
+  m_lineStarts.push_back(0);
+  size_t pos = 0;
+  for (wxString::const_iterator it = m_text.begin(); it != m_text.end(); ++it)
   {
-    if(m_text[pos]==wxT('\n'))
-      break;
-    pos--;
-  }
-  if(m_text[pos]==wxT('\n'))
     pos++;
-  return pos;
+    if (*it == wxT('\n'))
+      m_lineStarts.push_back(pos);
+  }
+  m_lineIndexVersion = m_textVersion;
 }
 
-size_t EditorCell::EndOfLine(size_t pos)
+void EditorCell::ReplaceText(size_t start, size_t end, const wxString &text)
 {
-  while (pos<m_text.length() && m_text[pos] != wxT('\n'))
+  if (end > m_text.Length())
+    end = m_text.Length();
+  if (start > end)
+    start = end;
+
+  bool lineIndexValid = !m_lineStarts.empty() && (m_lineIndexVersion == m_textVersion);
+  m_text.replace(start, end - start, text);
+  m_textVersion++;
+  if (!lineIndexValid)
+    return;
+
+  // The lines that start inside the replaced range (their line break was
+  // part of it) are dropped, the ones behind it are moved.
+  size_t first = std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), start) - m_lineStarts.begin();
+  size_t last = std::upper_bound(m_lineStarts.begin() + first, m_lineStarts.end(), end) - m_lineStarts.begin();
+  for (size_t i = last; i < m_lineStarts.size(); i++)
+    m_lineStarts[i] = m_lineStarts[i] - (end - start) + text.Length();
+
+  std::vector<size_t> inserted;
+  size_t pos = start;
+  for (wxString::const_iterator it = text.begin(); it != text.end(); ++it)
+  {
     pos++;
+    if (*it == wxT('\n'))
+      inserted.push_back(pos);
+  }
+  m_lineStarts.erase(m_lineStarts.begin() + first, m_lineStarts.begin() + last);
+  m_lineStarts.insert(m_lineStarts.begin() + first, inserted.begin(), inserted.end());
+  m_lineIndexVersion = m_textVersion;
+}
+
+size_t EditorCell::LineOfPosition(size_t pos)
+{
+  UpdateLineIndex();
+  return std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), pos) - m_lineStarts.begin() - 1;
+}
 
-  return pos;
+size_t EditorCell::BeginningOfLine(size_t pos)
+{
+  return m_lineStarts[LineOfPosition(pos)];
+}
+
+size_t EditorCell::EndOfLine(size_t pos)
+{
+  size_t line = LineOfPosition(pos);
+  if (line + 1 < m_lineStarts.size())
+    return m_lineStarts[line + 1] - 1;
+  else
+    return m_text.Length();
 }
 
 #if defined __WXMAC__
@@ -805,7 +839,7 @@ bool EditorCell::HandleCtrlCommand(wxKeyEvent& ev)
     size_t end = EndOfLine(m_positionOfCaret);
     if (end == m_positionOfCaret)
       end++;
-    m_text = m_text.SubString(0, m_positionOfCaret-1) + m_text.SubString(end, m_text.length());
+    EraseText(m_positionOfCaret, end);
     m_isDirty = true;
     break;
   }
@@ -1134,8 +1168,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
       SaveValue();
       long start = MIN(m_selectionEnd, m_selectionStart);
       long end = MAX(m_selectionEnd, m_selectionStart);
-      m_text = m_text.SubString(0, start - 1) +
-               m_text.SubString(end, m_text.Length());
+      EraseText(start, end);
       m_positionOfCaret = start;
       ClearSelection();
     }
@@ -1220,9 +1253,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
         for(int i=0;i<indentChars;i++)
           indentString += wxT(" ");
       
-      m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-        wxT("\n") + indentString +
-        m_text.SubString(m_positionOfCaret, m_text.Length());
+      InsertText(m_positionOfCaret, wxT("\n") + indentString);
       m_positionOfCaret++;
       if((indentChars > 0)&&(autoIndent))
       {
@@ -1251,8 +1282,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
         {
           m_isDirty = true;
           m_containsChanges = true;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-            m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          EraseText(m_positionOfCaret, m_positionOfCaret + 1);
         }
       }
       else
@@ -1263,8 +1293,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
         m_saveValue = true;
         long start = MIN(m_selectionEnd, m_selectionStart);
         long end = MAX(m_selectionEnd, m_selectionStart);
-        m_text = m_text.SubString(0, start - 1) +
-          m_text.SubString(end, m_text.Length());
+        EraseText(start, end);
         m_positionOfCaret = start;
         ClearSelection();
       } 
@@ -1282,23 +1311,20 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
       while((wxIsalnum(m_text[m_positionOfCaret - 1]))&&(m_positionOfCaret>0))
       {
         m_positionOfCaret--;
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+        EraseText(m_positionOfCaret, m_positionOfCaret + 1);
       }            
       // Delete Spaces, Tabs and Newlines until the next printable character
       while((wxIsspace(m_text[m_positionOfCaret - 1]))&&(m_positionOfCaret>0))
       {
         m_positionOfCaret--;
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+        EraseText(m_positionOfCaret, m_positionOfCaret + 1);
       }
       
       // If we didn't delete anything till now delete one single character.
       if(lastpos == m_positionOfCaret)
       {
         m_positionOfCaret--;
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+        EraseText(m_positionOfCaret, m_positionOfCaret + 1);
       }
     }
     break;
@@ -1312,8 +1338,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
       m_isDirty = true;
       long start = MIN(m_selectionEnd, m_selectionStart);
       long end = MAX(m_selectionEnd, m_selectionStart);
-      m_text = m_text.SubString(0, start - 1) +
-               m_text.SubString(end, m_text.Length());
+      EraseText(start, end);
       m_positionOfCaret = start;
       ClearSelection();
       break;
@@ -1330,8 +1355,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
           
           if(m_text.SubString(0, m_positionOfCaret - 1).Right(4) == wxT("    ")) 
           {
-            m_text = m_text.SubString(0, m_positionOfCaret - 5) +
-              m_text.SubString(m_positionOfCaret, m_text.Length());
+            EraseText(m_positionOfCaret - 4, m_positionOfCaret);
             m_positionOfCaret -= 4;
           }
           else
@@ -1344,8 +1368,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
                  (m_text.GetChar(m_positionOfCaret-1) == '{' && m_text.GetChar(m_positionOfCaret) == '}') ||
                  (m_text.GetChar(m_positionOfCaret-1) == '"' && m_text.GetChar(m_positionOfCaret) == '"')))
               right++;
-            m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-              m_text.SubString(right, m_text.Length());
+            EraseText(m_positionOfCaret - 1, right);
             m_positionOfCaret--;
           }
         }
@@ -1364,23 +1387,20 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
         while((wxIsalnum(m_text[m_positionOfCaret - 1]))&&(m_positionOfCaret>0))
         {
           m_positionOfCaret--;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-                   m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          EraseText(m_positionOfCaret, m_positionOfCaret + 1);
         }            
         // Delete Spaces, Tabs and Newlines until the next printable character
         while((wxIsspace(m_text[m_positionOfCaret - 1]))&&(m_positionOfCaret>0))
         {
           m_positionOfCaret--;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-                   m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          EraseText(m_positionOfCaret, m_positionOfCaret + 1);
         }
         
         // If we didn't delete anything till now delete one single character.
         if(lastpos == m_positionOfCaret)
         {
           m_positionOfCaret--;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-                   m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          EraseText(m_positionOfCaret, m_positionOfCaret + 1);
         }
       }
     }
@@ -1444,8 +1464,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
           }
           else
           {
-            m_text = m_text.SubString(0, start - 1) +
-              m_text.SubString(end, m_text.Length());
+            EraseText(start, end);
             ClearSelection();
           }
           m_positionOfCaret = start;
@@ -1463,9 +1482,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
               ins += wxT(" ");
             } while (col%4 != 0);
             
-            m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-              ins +
-              m_text.SubString(m_positionOfCaret, m_text.Length());
+            InsertText(m_positionOfCaret, ins);
             m_positionOfCaret += ins.Length();
           }
           else
@@ -1491,11 +1508,11 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
 /*
   case WXK_SPACE:
     if (event.ShiftDown())
-      m_text = m_text.SubString(0, m_positionOfCaret - 1) + wxT("*") + // wxT("\x00B7")
-               m_text.SubString(m_positionOfCaret, m_text.Length());
+      SetText(m_text.SubString(0, m_positionOfCaret - 1) + wxT("*") + // wxT("\x00B7")
+               m_text.SubString(m_positionOfCaret, m_text.Length()));
     else
-      m_text = m_text.SubString(0, m_positionOfCaret - 1) + wxT(" ") +
-               m_text.SubString(m_positionOfCaret, m_text.Length());
+      SetText(m_text.SubString(0, m_positionOfCaret - 1) + wxT(" ") +
+               m_text.SubString(m_positionOfCaret, m_text.Length()));
     m_isDirty = true;
     m_containsChanges = true;
     m_positionOfCaret++;
@@ -1516,8 +1533,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
       if (esccharpos > -1) { // we have a match, check for insertion
         wxString greek = InterpretEscapeString(m_text.SubString(esccharpos + 1, m_positionOfCaret - 1));
         if (greek.Length() > 0 ) {
-          m_text = m_text.SubString(0, esccharpos - 1) + greek +
-                   m_text.SubString(m_positionOfCaret, m_text.Length());
+          ReplaceText(esccharpos, m_positionOfCaret, greek);
           m_positionOfCaret = esccharpos + greek.Length();
           m_isDirty = true;
           m_containsChanges = true;
@@ -1529,8 +1545,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent& event)
         insertescchar = true;
 
       if (insertescchar) {
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) + ESC_CHAR +
-                 m_text.SubString(m_positionOfCaret, m_text.Length());
+        InsertText(m_positionOfCaret, ESC_CHAR);
         m_isDirty = true;
         m_containsChanges = true;
         m_positionOfCaret++;
@@ -1586,11 +1601,7 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent& event)
   }
 
   if (m_historyPosition != -1) {
-    int len = m_textHistory.GetCount() - m_historyPosition;
-    m_textHistory.RemoveAt(m_historyPosition + 1, len - 1);
-    m_startHistory.erase(m_startHistory.begin() + m_historyPosition + 1, m_startHistory.end());
-    m_endHistory.erase(m_endHistory.begin() + m_historyPosition + 1, m_endHistory.end());
-    m_positionHistory.erase(m_positionHistory.begin() + m_historyPosition + 1, m_positionHistory.end());
+    TruncateUndoHistory(m_historyPosition + 1);
     m_historyPosition = -1;
   }
 
@@ -1604,50 +1615,42 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent& event)
     switch (keyCode)
     {
     case '(':
-      m_text = m_text.SubString(0, start - 1) +   wxT("(") +
-        m_text.SubString(start, end - 1) + wxT(")") +
-        m_text.SubString(end, m_text.Length());
+      InsertText(end, wxT(")"));
+      InsertText(start, wxT("("));
       m_positionOfCaret = start;  insertLetter = false;
       break;
     case '\"':
-      m_text = m_text.SubString(0, start - 1) +   wxT("\"") +
-        m_text.SubString(start, end - 1) + wxT("\"") +
-        m_text.SubString(end, m_text.Length());
+      InsertText(end, wxT("\""));
+      InsertText(start, wxT("\""));
       m_positionOfCaret = start;  insertLetter = false;
       break;
     case '{':
-      m_text = m_text.SubString(0, start - 1) +   wxT("{") +
-        m_text.SubString(start, end - 1) + wxT("}") +
-        m_text.SubString(end, m_text.Length());
+      InsertText(end, wxT("}"));
+      InsertText(start, wxT("{"));
       m_positionOfCaret = start;  insertLetter = false;
       break;
     case '[':
-      m_text = m_text.SubString(0, start - 1) +   wxT("[") +
-        m_text.SubString(start, end - 1) + wxT("]") +
-        m_text.SubString(end, m_text.Length());
+      InsertText(end, wxT("]"));
+      InsertText(start, wxT("["));
       m_positionOfCaret = start;  insertLetter = false;
       break;
     case ')':
-      m_text = m_text.SubString(0, start - 1) +   wxT("(") +
-        m_text.SubString(start, end - 1) + wxT(")") +
-        m_text.SubString(end, m_text.Length());
+      InsertText(end, wxT(")"));
+      InsertText(start, wxT("("));
       m_positionOfCaret = end + 2; insertLetter = false;
       break;
     case '}':
-      m_text = m_text.SubString(0, start - 1) +   wxT("{") +
-        m_text.SubString(start, end - 1) + wxT("}") +
-        m_text.SubString(end, m_text.Length());
+      InsertText(end, wxT("}"));
+      InsertText(start, wxT("{"));
       m_positionOfCaret = end + 2; insertLetter = false;
       break;
     case ']':
-      m_text = m_text.SubString(0, start - 1) +   wxT("[") +
-        m_text.SubString(start, end - 1) + wxT("]") +
-        m_text.SubString(end, m_text.Length());
+      InsertText(end, wxT("]"));
+      InsertText(start, wxT("["));
       m_positionOfCaret = end + 2; insertLetter = false;
       break;
     default: // delete selection
-      m_text = m_text.SubString(0, start - 1) +
-        m_text.SubString(end, m_text.Length());
+      EraseText(start, end);
       m_positionOfCaret = start;
       break;
     }
@@ -1656,13 +1659,13 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent& event)
   
   // insert letter if we didn't insert brackets around selection
   if (insertLetter) {
-    m_text = m_text.SubString(0, m_positionOfCaret - 1) +
+    InsertText(m_positionOfCaret,
 #if wxUSE_UNICODE
-      event.GetUnicodeKey() +
+               wxString(event.GetUnicodeKey())
 #else
-      wxString::Format(wxT("%c"), ChangeNumpadToChar(event.GetKeyCode())) +
+               wxString::Format(wxT("%c"), ChangeNumpadToChar(event.GetKeyCode()))
 #endif
-      m_text.SubString(m_positionOfCaret, m_text.Length());
+      );
     
     m_positionOfCaret++;
       
@@ -1671,46 +1674,35 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent& event)
       switch (keyCode)
       {
       case '(':
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          wxT(")") +
-          m_text.SubString(m_positionOfCaret, m_text.Length());
+        InsertText(m_positionOfCaret, wxT(")"));
         break;
       case '[':
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          wxT("]") +
-          m_text.SubString(m_positionOfCaret, m_text.Length());
+        InsertText(m_positionOfCaret, wxT("]"));
         break;
       case '{':
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          wxT("}") +
-          m_text.SubString(m_positionOfCaret, m_text.Length());
+        InsertText(m_positionOfCaret, wxT("}"));
         break;
       case '"':
         if (m_positionOfCaret < m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == '"')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2)+
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          EraseText(m_positionOfCaret - 1, m_positionOfCaret);
         else
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-            wxT("\"") + m_text.SubString(m_positionOfCaret, m_text.Length());
+          InsertText(m_positionOfCaret, wxT("\""));
         break;
       case ')': // jump over ')'
         if (m_positionOfCaret < m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == ')')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          EraseText(m_positionOfCaret - 1, m_positionOfCaret);
         break;
       case ']': // jump over ']'
         if (m_positionOfCaret < m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == ']')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          EraseText(m_positionOfCaret - 1, m_positionOfCaret);
         break;
       case '}': // jump over '}'
         if (m_positionOfCaret < m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == '}')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          EraseText(m_positionOfCaret - 1, m_positionOfCaret);
         break;
       case '+':
         // case '-': // this could mean negative.
@@ -1723,8 +1715,7 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent& event)
         size_t len = m_text.Length();
         if (m_insertAns && len == 1 && m_positionOfCaret == 1)
         {
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) + wxT("%") +
-            m_text.SubString(m_positionOfCaret - 1, m_text.Length());
+          InsertText(m_positionOfCaret - 1, wxT("%"));
           m_positionOfCaret += 1;
         }
         break;
@@ -1735,11 +1726,37 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent& event)
   return true;
 }
 
+void EditorCell::UpdateDelimiterIndex()
+{
+  if (m_delimiterIndexVersion == m_textVersion)
+    return;
+
+  m_parenthesisState = Delimiters::Scan(m_text, &m_delimiters, &m_delimiterMatches);
+  m_delimiterIndexVersion = m_textVersion;
+}
+
+long EditorCell::DelimiterAt(size_t pos)
+{
+  UpdateDelimiterIndex();
+  std::vector<size_t>::iterator it =
+    std::lower_bound(m_delimiters.begin(), m_delimiters.end(), pos);
+  if ((it == m_delimiters.end()) || (*it != pos))
+    return -1;
+  return it - m_delimiters.begin();
+}
+
+wxString EditorCell::GetUnmatchedParenthesisState()
+{
+  UpdateDelimiterIndex();
+  return m_parenthesisState;
+}
+
 /**
  * For a given quotation mark ("), find a matching quote.
- * Since there are no nested quotes, an odd-numbered, non-escaped quote
- * is an opening quote, and an even-numbered non-escaped quote
- * is a closing quote.
+ *
+ * The quotes are looked up in the index UpdateDelimiterIndex() maintains
+ * which means that quotes that are part of comments or are escaped are
+ * ignored.
  *
  * @return true if matching quotation marks were found; false otherwise
  */
@@ -1764,33 +1781,17 @@ bool EditorCell::FindMatchingQuotes()
     }
   }
 
-  int count = 0;
-  for (int i = 0; i < (int) m_text.Length(); ++i)
+  long delimiter = DelimiterAt(pos);
+  if ((delimiter < 0) || (m_delimiterMatches[delimiter] < 0))
   {
-    if (m_text.GetChar(i) == '"' &&
-        ((i == 0) ||
-         (i >= 1 && m_text.GetChar(i-1) != '\\')))
-    {
-      ++count;
-      if (count&1)
-      {
-        m_paren1 = i;  // open quote here
-      }
-      else
-      {
-        m_paren2 = i;  // close quote here
-        if (m_paren1 == pos || m_paren2 == pos)
-        {
-          // found the pair of quotes under the cursor
-          return true;
-        }
-      }
-    }
+    // didn't find matching quotes; do not highlight quotes
+    m_paren1 = m_paren2 = -1;
+    return false;
   }
 
-  // didn't find matching quotes; do not highlight quotes
-  m_paren1 = m_paren2 = -1;
-  return false;
+  m_paren1 = MIN(pos, m_delimiterMatches[delimiter]);
+  m_paren2 = MAX(pos, m_delimiterMatches[delimiter]);
+  return true;
 }
 
 void EditorCell::FindMatchingParens()
@@ -1819,57 +1820,14 @@ void EditorCell::FindMatchingParens()
     }
   }
 
-  wxChar first = m_text.GetChar(m_paren2);
-  wxChar second;
-  int dir;
-
-  switch (first)
+  // Parenthesis that are part of strings or comments aren't in the index.
+  long delimiter = DelimiterAt(m_paren2);
+  if ((delimiter < 0) || (m_delimiterMatches[delimiter] < 0))
   {
-  case '(':
-    second = ')';
-    dir = 1;
-    break;
-  case '[':
-    second = ']';
-    dir = 1;
-    break;
-  case '{':
-    second = '}';
-    dir = 1;
-    break;
-  case ')':
-    second = '(';
-    dir = -1;
-    break;
-  case ']':
-    second = '[';
-    dir = -1;
-    break;
-  case '}':
-    second = '{';
-    dir = -1;
-    break;
-  default:
+    m_paren1 = m_paren2 = -1;
     return;
   }
-
-  m_paren1 = m_paren2 + dir;
-  int depth = 1;
-
-  while (m_paren1 >= 0 && m_paren1 < (int)m_text.Length())
-  {
-    if (m_text.GetChar(m_paren1) == second)
-      depth--;
-    else if (m_text.GetChar(m_paren1) == first)
-      depth++;
-
-    if (depth == 0)
-      break;
-    m_paren1 += dir;
-  }
-
-  if (m_paren1 < 0 || m_paren1 >= (int)m_text.Length())
-    m_paren1 = m_paren2 = -1;
+  m_paren1 = m_delimiterMatches[delimiter];
 }
 
 #if wxUSE_UNICODE
@@ -2143,9 +2101,9 @@ bool EditorCell::AddEnding()
   if (m_text.Left(5) == wxT(":lisp"))
     return false;
 
-  wxString text = m_text.Trim();
-  if (text.Right(1) != wxT(";") && text.Right(1) != wxT("$")) {
-    m_text += wxT(";");
+  SetText(wxString(m_text).Trim());
+  if (m_text.Right(1) != wxT(";") && m_text.Right(1) != wxT("$")) {
+    InsertText(m_text.Length(), wxT(";"));
     m_paren1 = m_paren2 = m_width = -1;
     StyleText();
     return true;
@@ -2160,45 +2118,30 @@ bool EditorCell::AddEnding()
 //
 void EditorCell::PositionToXY(int position, int* x, int* y)
 {
-  int col = 0, lin = 0;
-  int pos = 0;
+  if (position < 0)
+    position = 0;
+  if (position > (int)m_text.Length())
+    position = m_text.Length();
 
-  while (pos < position)
-  {
-    if (m_text.GetChar(pos) == '\n')
-    {
-      col = 0,
-      lin++;
-    }
-    else
-      col++;
-    pos++;
-  }
-
-  *x = col;
-  *y = lin;
+  size_t line = LineOfPosition(position);
+  *x = position - m_lineStarts[line];
+  *y = line;
 }
 
 int EditorCell::XYToPosition(int x, int y)
 {
-  int col = 0, lin = 0, pos = 0;
+  UpdateLineIndex();
 
-  while (pos < (int)m_text.Length() && lin < y)
-  {
-    if (m_text.GetChar(pos) == '\n')
-      lin++;
-    pos++;
-  }
-
-  while (pos < (int)m_text.Length() && col < x)
-  {
-    if (m_text.GetChar(pos) == '\n')
-      break;
-    pos++;
-    col++;
-  }
+  if (y >= (int)m_lineStarts.size())
+    return m_text.Length();
+  if (y < 0)
+    y = 0;
+  if (x < 0)
+    x = 0;
 
-  return pos;
+  int lineStart = m_lineStarts[y];
+  int lineEnd = EndOfLine(lineStart);
+  return MIN(lineStart + x, lineEnd);
 }
 
 wxPoint EditorCell::PositionToPoint(CellParser& parser, int pos)
@@ -2229,7 +2172,6 @@ wxPoint EditorCell::PositionToPoint(CellParser& parser, int pos)
 
 void EditorCell::SelectPointText(wxDC& dc, wxPoint& point)
 {
-  wxString s;
   int fontsize1 = m_fontSize;
 
   dc.SetFont(wxFont(fontsize1, wxFONTFAMILY_MODERN,
@@ -2246,26 +2188,8 @@ void EditorCell::SelectPointText(wxDC& dc, wxPoint& point)
   translate.y -= m_currentPoint.y - 2 - m_center;
 
   int lin = translate.y / m_charHeight;
-  int width, height;
-  int lineStart = XYToPosition(0, lin);
-  m_positionOfCaret = lineStart;
-
-  wxString text = m_text;
-  if (m_changeAsterisk)  
-    text.Replace(wxT("*"), wxT("\xB7"));
-
-  while (m_positionOfCaret < (signed)text.Length() && text.GetChar(m_positionOfCaret) != '\n')
-  {
-    s = text.SubString(lineStart, m_positionOfCaret);
-    dc.GetTextExtent(text.SubString(lineStart, m_positionOfCaret),
-                                      &width, &height);
-    if (width > translate.x)
-      break;
-
-    m_positionOfCaret++;
-  }
-
-  m_positionOfCaret = MIN(m_positionOfCaret, (signed)text.Length());
+  m_positionOfCaret = XYToPosition(PointToColumn(dc, lin, translate.x), lin);
+  m_positionOfCaret = MIN(m_positionOfCaret, (signed)m_text.Length());
 
   m_displayCaret = true;
   m_caretColumn = -1;
@@ -2299,13 +2223,8 @@ bool EditorCell::IsPointInSelection(wxDC& dc, wxPoint point)
   if (!rect.Contains(point))
     return false;
 
-  wxString s;
   int fontsize1 = m_fontSize;
 
-  wxString text = m_text;
-  if (m_changeAsterisk)  
-    text.Replace(wxT("*"), wxT("\xB7"));
-
   dc.SetFont(wxFont(fontsize1, wxFONTFAMILY_MODERN,
                     m_fontStyle,
                     m_fontWeight,
@@ -2316,19 +2235,8 @@ bool EditorCell::IsPointInSelection(wxDC& dc, wxPoint point)
   translate.x -= m_currentPoint.x - 2;
   translate.y -= m_currentPoint.y - 2 - m_center;
   int lin = translate.y / m_charHeight;
-  int width, height;
-  int lineStart = XYToPosition(0, lin);
-  int positionOfCaret = lineStart;
-  while (text.GetChar(positionOfCaret) != '\n' && positionOfCaret < (signed)text.Length())
-  {
-    s = text.SubString(lineStart, positionOfCaret);
-    dc.GetTextExtent(text.SubString(lineStart, positionOfCaret),
-                                      &width, &height);
-    if (width > translate.x)
-      break;
-    positionOfCaret++;
-  }
-  positionOfCaret = MIN(positionOfCaret, (signed)text.Length());
+  int positionOfCaret = XYToPosition(PointToColumn(dc, lin, translate.x), lin);
+  positionOfCaret = MIN(positionOfCaret, (signed)m_text.Length());
 
   if ((m_selectionStart >= positionOfCaret) || (m_selectionEnd <= positionOfCaret))
     return false;
@@ -2472,8 +2380,7 @@ bool EditorCell::CutToClipboard()
   m_positionOfCaret = start;
 
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  m_text = m_text.SubString(0, start - 1) +
-           m_text.SubString(end, m_text.Length());
+  EraseText(start, end);
   StyleText();
 
   ClearSelection();
@@ -2527,76 +2434,195 @@ void EditorCell::PasteFromClipboard(bool primary)
 
 int EditorCell::GetLineWidth(wxDC& dc, int line, int pos)
 {
-  if (pos == 0)
+  if (pos <= 0)
     return 0;
 
-  int i = 0;
-  
-  std::list<StyledText> styledText = m_styledText;
+  if (!m_styledTextLaidOut)
+    LayOutStyledText(dc);
 
-  while(!styledText.empty() && i<line)
+  if ((line < 0) || (line >= (int)m_styledLines.size()))
+    return 0;
+
+  size_t first = m_styledLines[line];
+  size_t last = StyledLineEnd(line);
+  if (first >= last)
+    return 0;
+
+  // Find the last text snippet that starts before pos
+  while (last - first > 1)
   {
-    // Grab a portion of text from the list.
-    StyledText textSnippet = styledText.front();
-    styledText.pop_front();
-    wxString text = textSnippet.GetText();
-    if (text.Right(1) == '\n')
-      i++;
+    size_t middle = (first + last) / 2;
+    if (m_styledText[middle].GetPos() < pos)
+      first = middle;
+    else
+      last = middle;
   }
 
-  if (i<line)
-    return 0;
+  StyledText &textSnippet = m_styledText[first];
+  int chars = pos - textSnippet.GetPos();
+  if (chars >= (int)textSnippet.GetText().Length())
+    return textSnippet.GetX() + textSnippet.GetWidth();
 
-  int width = 0;
-  wxString text;
   int textWidth, textHeight;
-  pos--;
-  while (!styledText.empty() && pos>=0)
+  dc.GetTextExtent(textSnippet.GetText().Left(chars), &textWidth, &textHeight);
+  return textSnippet.GetX() + textWidth;
+}
+
+int EditorCell::PointToColumn(wxDC& dc, int line, int x)
+{
+  if (!m_styledTextLaidOut)
+    LayOutStyledText(dc);
+
+  if (line < 0)
+    line = 0;
+  if (line >= (int)m_styledLines.size())
+    return 0;
+
+  size_t first = m_styledLines[line];
+  size_t last = StyledLineEnd(line);
+  if (first >= last)
+    return 0;
+
+  // Find the first text snippet that ends right of x
+  size_t lo = first, hi = last;
+  while (lo < hi)
   {
-    StyledText textSnippet = styledText.front();
-    styledText.pop_front();
-    text = textSnippet.GetText();
-    dc.GetTextExtent(text, &textWidth, &textHeight);
-    width += textWidth;
-    pos -= text.Length();
+    size_t middle = (lo + hi) / 2;
+    if (m_styledText[middle].GetX() + m_styledText[middle].GetWidth() > x)
+      hi = middle;
+    else
+      lo = middle + 1;
   }
 
-  if (pos<0) {
-    width -= textWidth;
-    dc.GetTextExtent(text.SubString(0, text.Length() + pos), &textWidth, &textHeight);
-    width += textWidth;
+  // x lies right of the end of the line
+  if (lo == last)
+  {
+    StyledText &lastSnippet = m_styledText[last - 1];
+    if (lastSnippet.GetText() == wxT("\n"))
+      return lastSnippet.GetPos();
+    else
+      return lastSnippet.GetPos() + lastSnippet.GetText().Length();
   }
 
-  return width;
+  StyledText &textSnippet = m_styledText[lo];
+  wxArrayInt widths;
+  dc.GetPartialTextExtents(textSnippet.GetText(), widths);
+  for (size_t i = 0; i < widths.GetCount(); i++)
+    if (textSnippet.GetX() + widths[i] > x)
+      return textSnippet.GetPos() + i;
+
+  return textSnippet.GetPos() + textSnippet.GetText().Length();
 }
 
+void EditorCell::LayOutStyledText(wxDC& dc)
+{
+  m_styledLines.clear();
+  m_styledLines.push_back(0);
+  for (size_t i = 0; i < m_styledText.size(); i++)
+    if (m_styledText[i].GetText() == wxT("\n"))
+      m_styledLines.push_back(i + 1);
+
+  // The widths we know are only valid for the font they have been measured with.
+  wxString font = dc.GetFont().GetNativeFontInfoDesc();
+  if (font != m_lineWidthsFont)
+  {
+    m_lineWidths.clear();
+    m_lineWidthsFont = font;
+  }
+  // Lines that follow a line that has been inserted or deleted are looked up
+  // at the index they had before.
+  int shift = int(m_styledLines.size()) - int(m_lineWidths.size());
+  std::vector<LineWidths> lineWidths(m_styledLines.size());
+
+  for (size_t line = 0; line < m_styledLines.size(); line++)
+  {
+    size_t first = m_styledLines[line];
+    size_t last = StyledLineEnd(line);
+    LineWidths &widths = lineWidths[line];
+
+    if ((line < m_lineWidths.size()) && (m_lineWidths[line].m_textVersion == m_textVersion))
+      widths = m_lineWidths[line];
+    else
+    {
+      // The text has changed since this line has been measured => we have to
+      // find out if the line itself has changed.
+      wxUint64 hash = wxULL(14695981039346656037);
+      for (size_t i = first; i < last; i++)
+      {
+        const wxString &text = m_styledText[i].GetText();
+        for (wxString::const_iterator it = text.begin(); it != text.end(); ++it)
+        {
+          hash ^= wxUint64((*it).GetValue());
+          hash *= wxULL(1099511628211);
+        }
+        // Separates the snippets
+        hash ^= wxUint64(0x10000);
+        hash *= wxULL(1099511628211);
+      }
+
+      if ((line < m_lineWidths.size()) && (m_lineWidths[line].m_hash == hash))
+        widths = m_lineWidths[line];
+      else if ((int(line) - shift >= 0) && (int(line) - shift < int(m_lineWidths.size())) &&
+               (m_lineWidths[line - shift].m_hash == hash))
+        widths = m_lineWidths[line - shift];
+      else
+      {
+        widths.m_hash = hash;
+        for (size_t i = first; i < last; i++)
+        {
+          int width = 0, height;
+          if (m_styledText[i].GetText() != wxT("\n"))
+            dc.GetTextExtent(m_styledText[i].GetText(), &width, &height);
+          widths.m_widths.push_back(width);
+        }
+      }
+      widths.m_textVersion = m_textVersion;
+    }
+
+    int pos = 0, x = 0;
+    for (size_t i = first; i < last; i++)
+    {
+      StyledText &textSnippet = m_styledText[i];
+      int width = widths.m_widths[i - first];
+      textSnippet.SetLayout(pos, x, width);
+      pos += textSnippet.GetText().Length();
+      x += width;
+    }
+  }
+
+  m_lineWidths.swap(lineWidths);
+  m_styledTextLaidOut = true;
+}
 
 bool EditorCell::CanUndo()
 {
-  return m_textHistory.GetCount()>0 && m_historyPosition != 0;
+  return m_undoSteps.size()>0 && m_historyPosition != 0;
 }
 
 void EditorCell::Undo()
 {
   if (m_historyPosition == -1) {
-    m_historyPosition = m_textHistory.GetCount()-1;
-    m_textHistory.Add(m_text);
-    m_startHistory.push_back(m_selectionStart);
-    m_endHistory.push_back(m_selectionEnd);
-    m_positionHistory.push_back(m_positionOfCaret);
+    // Remember the current text so that a redo can return to it.
+    PushUndoStep();
+    m_historyPosition = ptrdiff_t(m_undoSteps.size()) - 2;
   }
-  else
+  else if (m_historyPosition > 0)
     m_historyPosition--;
+  else
+    return;
 
   if (m_historyPosition == -1)
     return ;
 
+  ApplyUndoStep(m_historyPosition + 1, false);
+
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  m_text = m_textHistory.Item(m_historyPosition);
+  SetText(m_historyText);
   StyleText();
   
-  m_positionOfCaret = m_positionHistory[m_historyPosition];
-  SetSelection(m_startHistory[m_historyPosition],m_endHistory[m_historyPosition]);
+  m_positionOfCaret = m_undoSteps[m_historyPosition].m_positionOfCaret;
+  SetSelection(m_undoSteps[m_historyPosition].m_selectionStart,
+               m_undoSteps[m_historyPosition].m_selectionEnd);
 
   m_paren1 = m_paren2 = -1;
   m_isDirty = true;
@@ -2606,9 +2632,9 @@ void EditorCell::Undo()
 
 bool EditorCell::CanRedo()
 {
-  return m_textHistory.GetCount()>0 &&
+  return m_undoSteps.size()>0 &&
     m_historyPosition >= 0 &&
-    m_historyPosition < m_textHistory.GetCount()-1;
+    m_historyPosition < ptrdiff_t(m_undoSteps.size())-1;
 }
 
 void EditorCell::Redo()
@@ -2616,17 +2642,19 @@ void EditorCell::Redo()
   if (m_historyPosition == -1)
     return;
 
-  m_historyPosition++;
-
-  if (m_historyPosition >= m_textHistory.GetCount())
+  if (m_historyPosition + 1 >= ptrdiff_t(m_undoSteps.size()))
     return ;
 
+  m_historyPosition++;
+  ApplyUndoStep(m_historyPosition, true);
+
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  m_text = m_textHistory.Item(m_historyPosition);
+  SetText(m_historyText);
   StyleText();
   
-  m_positionOfCaret = m_positionHistory[m_historyPosition];
-  SetSelection(m_startHistory[m_historyPosition],m_endHistory[m_historyPosition]);
+  m_positionOfCaret = m_undoSteps[m_historyPosition].m_positionOfCaret;
+  SetSelection(m_undoSteps[m_historyPosition].m_selectionStart,
+               m_undoSteps[m_historyPosition].m_selectionEnd);
 
   m_paren1 = m_paren2 = -1;
   m_isDirty = true;
@@ -2636,35 +2664,149 @@ void EditorCell::Redo()
 
 void EditorCell::SaveValue()
 {
-  if (m_textHistory.GetCount()>0) {
-    if (m_textHistory.Last() == m_text)
+  if ((m_historyPosition == -1) && (m_undoSteps.size()>0)) {
+    if (m_historyText == m_text)
       return ;
   }
 
-  if (m_historyPosition != -1) {
-    int len = m_textHistory.GetCount() - m_historyPosition;
-    m_textHistory.RemoveAt(m_historyPosition, len);
-    m_startHistory.erase(m_startHistory.begin() + m_historyPosition, m_startHistory.end());
-    m_endHistory.erase(m_endHistory.begin() + m_historyPosition, m_endHistory.end());
-    m_positionHistory.erase(m_positionHistory.begin() + m_historyPosition, m_positionHistory.end());
-  }
+  if (m_historyPosition != -1)
+    TruncateUndoHistory(m_historyPosition);
 
-  m_textHistory.Add(m_text);
-  m_startHistory.push_back(m_selectionStart);
-  m_endHistory.push_back(m_selectionEnd);
-  m_positionHistory.push_back(m_positionOfCaret);
+  PushUndoStep();
   m_historyPosition = -1;
 }
 
+void EditorCell::PushUndoStep()
+{
+  UndoStep step;
+  step.m_positionOfCaret = m_positionOfCaret;
+  step.m_selectionStart = m_selectionStart;
+  step.m_selectionEnd = m_selectionEnd;
+
+  // Only remember the part of the text that differs from the last step.
+  if (m_undoSteps.size()>0)
+    step.m_delta = TextDelta(m_historyText, m_text);
+  else
+  {
+    m_undoCells.push_front(this);
+    m_undoCellsEntry = m_undoCells.begin();
+  }
+
+  m_historyText = m_text;
+  m_undoSteps.push_back(step);
+  m_undoStepBytes += UndoStepSize(step);
+  AccountUndoBytes();
+
+  // We are now the cell that has been edited most recently.
+  m_undoCells.splice(m_undoCells.begin(), m_undoCells, m_undoCellsEntry);
+  LimitUndoHistory();
+}
+
+void EditorCell::ApplyUndoStep(size_t index, bool forward)
+{
+  UndoStep &step = m_undoSteps[index];
+  if (forward)
+    step.m_delta.Apply(m_historyText);
+  else
+    step.m_delta.Revert(m_historyText);
+}
+
+void EditorCell::TruncateUndoHistory(size_t size)
+{
+  if (size == 0)
+  {
+    ClearUndo();
+    return;
+  }
+
+  // Move m_historyText back to the newest step we keep.
+  size_t current = m_undoSteps.size() - 1;
+  if (m_historyPosition != -1)
+    current = m_historyPosition;
+  while (current >= size)
+    ApplyUndoStep(current--, false);
+
+  while (m_undoSteps.size() > size)
+  {
+    m_undoStepBytes -= UndoStepSize(m_undoSteps.back());
+    m_undoSteps.pop_back();
+  }
+  AccountUndoBytes();
+}
+
+bool EditorCell::CanDropUndoStep()
+{
+  return (m_undoSteps.size() > 1) && (m_historyPosition != 0);
+}
+
+void EditorCell::DropOldestUndoStep()
+{
+  m_undoStepBytes -= UndoStepSize(m_undoSteps[0]) + UndoStepSize(m_undoSteps[1]);
+  m_undoSteps.pop_front();
+
+  // The step that now is the oldest one doesn't need to know what it differs
+  // from any more.
+  m_undoSteps[0].m_delta = TextDelta();
+  m_undoStepBytes += UndoStepSize(m_undoSteps[0]);
+  AccountUndoBytes();
+
+  if (m_historyPosition > 0)
+    m_historyPosition--;
+}
+
+void EditorCell::AccountUndoBytes()
+{
+  long bytes = 0;
+  if (m_undoSteps.size() > 0)
+    bytes = m_undoStepBytes + long(m_historyText.Length() * sizeof(wxChar));
+  m_undoBytesTotal += bytes - m_undoBytes;
+  m_undoBytes = bytes;
+}
+
+void EditorCell::LimitUndoHistory()
+{
+  while ((m_undoBytes > m_undoBudgetCell) && CanDropUndoStep())
+    DropOldestUndoStep();
+
+  // If all cells together use too much memory the history of the cells that
+  // haven't been edited for the longest time is shortened first.
+  while ((m_undoBytesTotal > m_undoBudgetTotal) && (m_undoCells.back() != this))
+  {
+    EditorCell *cell = m_undoCells.back();
+    if (cell->CanDropUndoStep())
+      cell->DropOldestUndoStep();
+    else
+      cell->ClearUndo();
+  }
+  while ((m_undoBytesTotal > m_undoBudgetTotal) && CanDropUndoStep())
+    DropOldestUndoStep();
+}
+
+long EditorCell::UndoStepSize(const UndoStep &step)
+{
+  return sizeof(UndoStep) +
+    long(step.m_delta.Length() * sizeof(wxChar));
+}
+
 void EditorCell::ClearUndo()
 {
-  m_textHistory.Clear();
-  m_startHistory.clear();
-  m_endHistory.clear();
-  m_positionHistory.clear();
+  if (m_undoSteps.size() > 0)
+    m_undoCells.erase(m_undoCellsEntry);
+  m_undoSteps.clear();
+  m_historyText = wxEmptyString;
+  m_undoStepBytes = 0;
+  AccountUndoBytes();
   m_historyPosition = -1;
 }
 
+void EditorCell::SetUndoBudget(long cellBytes, long totalBytes)
+{
+  m_undoBudgetCell = cellBytes;
+  m_undoBudgetTotal = totalBytes;
+  while ((m_undoBytesTotal > m_undoBudgetTotal) && !m_undoCells.empty())
+    m_undoCells.back()->ClearUndo();
+}
+
 bool EditorCell::IsAlpha(wxChar ch)
 {
   static const wxString alphas = wxT("\\_%");
@@ -2810,9 +2952,163 @@ wxArrayString EditorCell::StringToTokens(wxString string)
   return retval;
 }
 
+void EditorCell::StyleLine(wxString line, int &state, wxChar &lastChar, wxChar nextChar,
+                           std::vector<StyledText> &styledText)
+{
+  wxArrayString tokens = StringToTokens(line);
+
+  // The first non-whitespace character after each token
+  std::vector<wxChar> nextChars(tokens.GetCount());
+  for (size_t i = tokens.GetCount(); i > 0; i--)
+  {
+    nextChars[i - 1] = nextChar;
+    wxString token = tokens[i - 1];
+    token = token.Trim(false);
+    if(token != wxT("d"))
+      nextChar = token[0];
+  }
+
+  for(size_t i=0;i<tokens.GetCount();i++)
+  {
+    wxString token = tokens[i];
+    token = token.Left(token.Length()-1);
+    if(token == wxEmptyString)
+      continue;
+
+    // Strings and comments can span several lines
+    if(state == LEXER_STRING)
+    {
+      styledText.push_back(StyledText(TS_CODE_STRING,token));
+      if(token == wxT("\""))
+        state = LEXER_CODE;
+      continue;
+    }
+    if(state == LEXER_COMMENT)
+    {
+      styledText.push_back(StyledText(TS_CODE_COMMENT,token));
+      if((token == wxT("*/"))||(token == wxT("\xB7/")))
+        state = LEXER_CODE;
+      continue;
+    }
+
+    wxChar Ch = token[0];
+
+    // The last non-whitespace character before this token - or a space if
+    // there is no such char.
+    wxChar previousChar = lastChar;
+    wxString tmp = token;
+    tmp=tmp.Trim();
+    if(tmp!=wxEmptyString)
+      lastChar = tmp.Last();
+
+    nextChar = nextChars[i];
+
+    // Handle strings
+    if(token == wxT("\""))
+    {
+      styledText.push_back(StyledText(TS_CODE_STRING,token));
+      state = LEXER_STRING;
+      continue;
+    }
+
+    if((Ch==wxT('+')) ||
+       (Ch==wxT('-'))||
+       (Ch==wxT('\x2212'))
+      )
+    {
+      if(
+        (nextChar>=wxT('0')) &&
+        (nextChar<=wxT('9'))
+        )
+      {
+        // Our sign precedes a number.
+        if(
+          (wxIsalnum(previousChar)) ||
+          (previousChar==wxT('%'))  ||
+          (previousChar==wxT(')'))  ||
+          (previousChar==wxT('}'))  ||
+          (previousChar==wxT(']'))
+          )
+        {
+          styledText.push_back(StyledText(TS_CODE_OPERATOR,token));
+        }
+        else
+        {
+          styledText.push_back(StyledText(TS_CODE_NUMBER,token));
+        }
+      }
+      else
+        styledText.push_back(StyledText(TS_CODE_OPERATOR,token));
+      continue;
+    }
+
+    // Handle comments
+    if((token == wxT("/*"))||(token==wxT("/\xB7")))
+    {
+      styledText.push_back(StyledText(TS_CODE_COMMENT,token));
+      state = LEXER_COMMENT;
+      continue;
+    }
+      
+    if(operators.Find(token) != wxNOT_FOUND)
+    {
+      if((token==wxT('$'))||(token==wxT(';')))
+        styledText.push_back(StyledText(TS_CODE_ENDOFLINE,token));
+      else
+        styledText.push_back(StyledText(TS_CODE_OPERATOR,token));
+      continue;
+    }
+    if(isdigit(token[0]))
+    {
+      styledText.push_back(StyledText(TS_CODE_NUMBER,token));
+      continue;
+    }
+    if((IsAlpha(token[0])) || (token[0] == wxT('\\')))
+    {
+      // Sometimes we can differ between variables and functions by the context.
+      // But I assume there cannot be an algorithm that always makes
+      // the right decision here:
+      //  - Function names can be used without the parenthesis that make out
+      //    functions.
+      //  - The same name can stand for a function and a variable
+      //  - There are indexed functions
+      //  - using lambda a user can store a function in a variable
+      //  - and is U_C1(t) really meant as a function or does it represent a variable
+      //    named U_C1 that depends on t?
+      if (token == wxT("for")    ||
+          token == wxT("in")     ||
+          token == wxT("then")   ||
+          token == wxT("while")  ||
+          token == wxT("do")     ||
+          token == wxT("thru")   ||
+          token == wxT("next")   ||
+          token == wxT("step")   ||
+          token == wxT("unless") ||
+          token == wxT("from")   ||
+          token == wxT("if")     ||
+          token == wxT("else")   ||
+          token == wxT("elif")   ||
+          token == wxT("and")    ||
+          token == wxT("or")     ||
+          token == wxT("not")    ||
+          token == wxT("true")   ||
+          token == wxT("false"))
+        styledText.push_back(token);
+      else if(nextChar==wxT('('))
+        styledText.push_back(StyledText(TS_CODE_FUNCTION,token));
+      else
+        styledText.push_back(StyledText(TS_CODE_VARIABLE,token));
+      continue;
+    }
+    styledText.push_back(StyledText(token));
+  }
+}
+
 void EditorCell::StyleText()
 {
   m_styledText.clear();
+  m_styledLines.clear();
+  m_styledTextLaidOut = false;
 
   if(m_type == MC_TYPE_INPUT)
   {
@@ -2829,176 +3125,108 @@ void EditorCell::StyleText()
           wxString::Format(wxT(" ... + %i hidden lines"), textToStyle.Freq(wxT('\n')));
       }
     }
-    
-    wxArrayString tokens = StringToTokens(textToStyle);
-
-    wxString lastTokenWithText;
-    for(size_t i=0;i<tokens.GetCount();i++)
-    {
-      wxString token = tokens[i];
-      token = token.Left(token.Length()-1);
-      wxChar Ch = token[0];
-
-      // Save the last non-whitespace character in lastChar -
-      // or a space if there is no such char.
-      wxChar lastChar=wxT(' ');
-      if(lastTokenWithText!=wxEmptyString)
-            lastChar=lastTokenWithText.Right(1)[0];
-      wxString tmp = token;
-      tmp=tmp.Trim();
-      if(tmp!=wxEmptyString)
-        lastTokenWithText = tmp;
-      
-      // Save the next non-whitespace character in lastChar -
-      // or a space if there is no such char.
-      wxChar nextChar=wxT(' ');
-      size_t o = i+1;
-      while(o<tokens.GetCount())
-      {
-        wxString nextToken=tokens[o];
-        nextToken=nextToken.Trim(false);
-        if(nextToken!=wxT("d"))
-        {
-          nextChar=nextToken[0];
-          break;
-        }
-        o++;
-      }
 
-      // Handle comments
-      if(token == wxT("\""))
-      {
-        m_styledText.push_back(StyledText(TS_CODE_STRING,token));
-        if (i+1<tokens.GetCount()) {
-          i++;
-          token = tokens[i];
-          token = token.Left(token.Length()-1);
-          m_styledText.push_back(StyledText(TS_CODE_STRING,token));
-          while ((i+1 < tokens.GetCount()) && token != wxT("\"")) {
-            i++;
-            token = tokens[i];
-            token = token.Left(token.Length()-1);
-            m_styledText.push_back(StyledText(TS_CODE_STRING,token));
-          }
-        }
-        continue;
-      }
+    // Split the text into lines
+    wxArrayString lines;
+    size_t lineStart = 0, newlinepos;
+    while ((newlinepos = textToStyle.find(wxT('\n'), lineStart)) != wxString::npos)
+    {
+      lines.Add(textToStyle.Mid(lineStart, newlinepos - lineStart));
+      lineStart = newlinepos + 1;
+    }
+    lines.Add(textToStyle.Mid(lineStart));
+    size_t newCount = lines.GetCount();
 
-      if((Ch==wxT('+')) ||
-         (Ch==wxT('-'))||
-         (Ch==wxT('\x2212'))
-        )
-      {
-        if(
-          (nextChar>=wxT('0')) &&
-          (nextChar<=wxT('9'))
-          )
-        {
-          // Our sign precedes a number.
-          if(
-            (wxIsalnum(lastChar)) ||
-            (lastChar==wxT('%'))  ||
-            (lastChar==wxT(')'))  ||
-            (lastChar==wxT('}'))  ||
-            (lastChar==wxT(']'))
-            )
-          {
-            m_styledText.push_back(StyledText(TS_CODE_OPERATOR,token));
-          }
-          else
-          {
-            m_styledText.push_back(StyledText(TS_CODE_NUMBER,token));
-          }
-        }
-        else
-            m_styledText.push_back(StyledText(TS_CODE_OPERATOR,token));
-        continue;
-      }
+    // The first non-whitespace character after each line
+    std::vector<wxChar> nextChars(newCount);
+    wxChar nextChar = wxT(' ');
+    for (size_t i = newCount; i > 0; i--)
+    {
+      nextChars[i - 1] = nextChar;
+      wxString trimmed = lines[i - 1];
+      trimmed.Trim(false);
+      if (trimmed != wxEmptyString)
+        nextChar = trimmed[0];
+    }
 
-      if((token == wxT("/*"))||(token==wxT("/\xB7")))
-      {
-        m_styledText.push_back(StyledText(TS_CODE_COMMENT,token));
-        while ((i+1 < tokens.GetCount()) && (token != wxT("*/"))&& (token != wxT("\xB7/"))) {
-          i++;
-          token = tokens[i];
-          token = token.Left(token.Length()-1);
-          m_styledText.push_back(StyledText(TS_CODE_COMMENT,token));
-        }
-        continue;
-      }
-      
-      if(operators.Find(token) != wxNOT_FOUND)
+    // Lines at the start and the end of the text that are the same as in the last
+    // call can reuse the snippets from then if they are styled in the same context.
+    size_t oldCount = m_styledLineCache.size();
+    size_t prefix = 0;
+    while ((prefix < oldCount) && (prefix < newCount) &&
+           (m_styledLineCache[prefix].m_text == lines[prefix]))
+      prefix++;
+    size_t suffix = 0;
+    while ((suffix < oldCount - prefix) && (suffix < newCount - prefix) &&
+           (m_styledLineCache[oldCount - 1 - suffix].m_text == lines[newCount - 1 - suffix]))
+      suffix++;
+
+    std::vector<StyledLine> styledLines(newCount);
+    int state = LEXER_CODE;
+    wxChar lastChar = wxT(' ');
+    for (size_t i = 0; i < newCount; i++)
+    {
+      StyledLine *oldLine = NULL;
+      if (i < prefix)
+        oldLine = &m_styledLineCache[i];
+      else if (i >= newCount - suffix)
+        oldLine = &m_styledLineCache[oldCount - (newCount - i)];
+
+      StyledLine &line = styledLines[i];
+      if ((oldLine != NULL) && (oldLine->m_stateIn == state) &&
+          (oldLine->m_lastCharIn == lastChar) && (oldLine->m_nextChar == nextChars[i]))
       {
-        if((token==wxT('$'))||(token==wxT(';')))
-          m_styledText.push_back(StyledText(TS_CODE_ENDOFLINE,token));
-        else
-          m_styledText.push_back(StyledText(TS_CODE_OPERATOR,token));
-        continue;
+        line.m_text = oldLine->m_text;
+        line.m_stateIn = oldLine->m_stateIn;
+        line.m_lastCharIn = oldLine->m_lastCharIn;
+        line.m_nextChar = oldLine->m_nextChar;
+        line.m_stateOut = oldLine->m_stateOut;
+        line.m_lastCharOut = oldLine->m_lastCharOut;
+        line.m_styledText.swap(oldLine->m_styledText);
+        state = line.m_stateOut;
+        lastChar = line.m_lastCharOut;
       }
-      if(isdigit(token[0]))
+      else
       {
-        m_styledText.push_back(StyledText(TS_CODE_NUMBER,token));
-        continue;
+        line.m_text = lines[i];
+        line.m_stateIn = state;
+        line.m_lastCharIn = lastChar;
+        line.m_nextChar = nextChars[i];
+        StyleLine(lines[i], state, lastChar, nextChars[i], line.m_styledText);
+        line.m_stateOut = state;
+        line.m_lastCharOut = lastChar;
       }
-      if((IsAlpha(token[0])) || (token[0] == wxT('\\')))
+
+      m_styledText.insert(m_styledText.end(), line.m_styledText.begin(), line.m_styledText.end());
+      if (i + 1 < newCount)
       {
-        // Sometimes we can differ between variables and functions by the context.
-        // But I assume there cannot be an algorithm that always makes
-        // the right decision here:
-        //  - Function names can be used without the parenthesis that make out
-        //    functions.
-        //  - The same name can stand for a function and a variable
-        //  - There are indexed functions
-        //  - using lambda a user can store a function in a variable
-        //  - and is U_C1(t) really meant as a function or does it represent a variable
-        //    named U_C1 that depends on t?
-        if((tokens.GetCount()>i+1))
-        {
-          wxString nextToken = tokens[i+1];
-          nextToken=nextToken.Trim(false);
-
-          if (token == wxT("for")    ||
-              token == wxT("in")     ||
-              token == wxT("then")   ||
-              token == wxT("while")  ||
-              token == wxT("do")     ||
-              token == wxT("thru")   ||
-              token == wxT("next")   ||
-              token == wxT("step")   ||
-              token == wxT("unless") ||
-              token == wxT("from")   ||
-              token == wxT("if")     ||
-              token == wxT("else")   ||
-              token == wxT("elif")   ||
-              token == wxT("and")    ||
-              token == wxT("or")     ||
-              token == wxT("not")    ||
-              token == wxT("not")    ||
-              token == wxT("true")   ||
-              token == wxT("false"))
-            m_styledText.push_back(token);
-          else if(nextChar==wxT('('))
-            m_styledText.push_back(StyledText(TS_CODE_FUNCTION,token));
-          else
-            m_styledText.push_back(StyledText(TS_CODE_VARIABLE,token));
-          continue;
-        }
+        if (state == LEXER_STRING)
+          m_styledText.push_back(StyledText(TS_CODE_STRING, wxT("\n")));
+        else if (state == LEXER_COMMENT)
+          m_styledText.push_back(StyledText(TS_CODE_COMMENT, wxT("\n")));
         else
-          m_styledText.push_back(StyledText(TS_CODE_VARIABLE,token));
+          m_styledText.push_back(StyledText(wxT("\n")));
       }
-      m_styledText.push_back(StyledText(token));
     }
+    m_styledLineCache.swap(styledLines);
   }
   else {
+    wxString textToStyle = m_text;
+#if defined __WXMSW__ || wxUSE_UNICODE
+    // replace "*" with centerdot if requested
+    if (m_changeAsterisk)
+      textToStyle.Replace(wxT("*"), wxT("\xB7"));
+#endif
+
     wxString token;
-    for (size_t i = 0; i<m_text.Length(); i++) {
-      if (m_text.GetChar(i) == '\n') {
+    for (size_t i = 0; i<textToStyle.Length(); i++) {
+      if (textToStyle.GetChar(i) == '\n') {
         m_styledText.push_back(StyledText(token));
         m_styledText.push_back(StyledText(wxT("\n")));
         token = wxEmptyString;
       }
       else
-        token += m_text.GetChar(i);
+        token += textToStyle.GetChar(i);
     }
     m_styledText.push_back(StyledText(token));
   }
@@ -3012,28 +3240,28 @@ void EditorCell::SetValue(wxString text)
     if (m_matchParens)
     {
       if (text == wxT("(")) {
-        m_text = wxT("()");
+        SetText(wxT("()"));
         m_positionOfCaret = 1;
       }
       else if (text == wxT("[")) {
-        m_text = wxT("[]");
+        SetText(wxT("[]"));
         m_positionOfCaret = 1;
       }
       else if (text == wxT("{")) {
-        m_text = wxT("{}");
+        SetText(wxT("{}"));
         m_positionOfCaret = 1;
       }
       else if (text == wxT("\"")) {
-        m_text = wxT("\"\"");
+        SetText(wxT("\"\""));
         m_positionOfCaret = 1;
       }
       else {
-        m_text = text;
+        SetText(text);
         m_positionOfCaret = m_text.Length();
       }
     }
     else {
-      m_text = text;
+      SetText(text);
       m_positionOfCaret = m_text.Length();
     }
 
@@ -3046,14 +3274,14 @@ void EditorCell::SetValue(wxString text)
           m_text == wxT("=") ||
           m_text == wxT(","))
       {
-        m_text = wxT("%") + m_text;
+        InsertText(0, wxT("%"));
         m_positionOfCaret = m_text.Length();
       }
     }
   }
   else
   {
-    m_text = text;
+    SetText(text);
     m_positionOfCaret = m_text.Length();
   }
 
@@ -3077,9 +3305,11 @@ bool EditorCell::CheckChanges()
 int EditorCell::ReplaceAll(wxString oldString, wxString newString,bool IgnoreCase)
 {
   SaveValue();
-  int count = m_text.Replace(oldString, newString);
+  wxString text = m_text;
+  int count = text.Replace(oldString, newString);
   if (count > 0)
   {
+    SetText(text);
     m_containsChanges = true;
     ClearSelection();
   }
@@ -3157,9 +3387,7 @@ bool EditorCell::ReplaceSelection(wxString oldStr, wxString newStr, bool keepSel
   
   {
     // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-    m_text = m_text.SubString(0, start - 1) +
-             newStr +
-             m_text.SubString(end, m_text.Length());
+    ReplaceText(start, end, newStr);
     StyleText();
     
     m_containsChanges = true;
@@ -24,9 +24,12 @@
 #define EDITORCELL_H
 
 #include "MathCell.h"
+#include "TextDelta.h"
+#include "Delimiters.h"
 
 #include <vector>
 #include <list>
+#include <deque>
 #include <wx/tokenzr.h>
 
 /*! \file
@@ -105,7 +108,7 @@ public:
   //! Convert the current cell to LaTeX code
   wxString ToTeX();
   //! Convert the current cell to XML code for inclusion in a .wxmx file.
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   //! Convert the current cell to HTML code.
   wxString ToHTML();
   void SetFont(CellParser& parser, int fontsize);
@@ -120,9 +123,12 @@ public:
   {
     return m_text;
   }
+  //! A number that changes on every change of the text
+  long GetTextVersion() { return m_textVersion; }
   /*! Converts m_text to a list of styled text snippets that will later be used by draw().
 
-    \todo Actually set the needed text styles.
+    Code is styled line by line: Lines whose text and context haven't changed
+    since the last call reuse the snippets that were generated for them then.
    */
   void StyleText();
   void Reset();
@@ -170,8 +176,30 @@ public:
     m_insertAns = insertAns;
   }
   bool FindMatchingQuotes();
+  /*! Find the parenthesis that matches the one at the caret
+
+    Uses the index Delimiters::Scan() creates. Parenthesis inside strings and
+    comments therefore aren't matched, and a parenthesis only matches the
+    one that actually closes it: One of a different type or one that is part
+    of a string doesn't count.
+   */
   void FindMatchingParens();
+  /*! The problem with the parenthesis this cell contains, if there is one.
+
+    See Delimiters::Scan(). Is only recalculated if the text has changed.
+   */
+  wxString GetUnmatchedParenthesisState();
+  /*! The width of the first "end" characters of a line
+
+    Uses the positions of the text snippets LayOutStyledText() has measured,
+    so only a part of a single snippet has to be measured here.
+   */
   int GetLineWidth(wxDC& dc, int line, int end);
+  /*! The column of a line that lies at the horizontal position x
+    
+    x is measured in pixels from the start of the line.
+   */
+  int PointToColumn(wxDC& dc, int line, int x);
   //! true, if this cell's width has to be recalculated.
   bool IsDirty()
   {
@@ -216,6 +244,18 @@ public:
   wxString DivideAtCaret();
   void CommentSelection();
   void ClearUndo();
+  /*! Set the maximum number of bytes the undo history may use
+
+    \param cellBytes The maximum size of the history of a single cell
+    \param totalBytes The maximum size of the histories of all cells together.
+    If the histories grow bigger than that the history of the cells that haven't
+    been edited for the longest time is shortened first.
+   */
+  static void SetUndoBudget(long cellBytes, long totalBytes);
+  size_t SizeInMemory()
+    {
+      return sizeof(EditorCell) + m_text.Length() * sizeof(wxChar) + m_undoBytes;
+    }
   //! Query if this cell needs to be re-evaluated by maxima
   bool ContainsChanges() { return m_containsChanges; }
   //! Set the information if this cell needs to be re-evaluated by maxima
@@ -305,6 +345,12 @@ private:
     wxString m_text;
     //! Do we really want to style this text portion different than the default?
     bool m_styleThisText;
+    //! The column of the line this text portion starts at
+    int m_pos;
+    //! The horizontal position of this text portion relative to the start of its line
+    int m_x;
+    //! The width of this text portion in pixels
+    int m_width;
   public:    
     //! Defines a piece of styled text
     StyledText(TextStyle style,wxString text)
@@ -312,6 +358,7 @@ private:
         m_text = text;
         m_style = style;
         m_styleThisText = true;
+        m_pos = m_x = m_width = 0;
       }
 
     //! Defines a piece of text with the default style
@@ -319,6 +366,29 @@ private:
       {
         m_text = text;
         m_styleThisText = false;
+        m_pos = m_x = m_width = 0;
+      }
+    //! Remember where in its line this text portion is drawn. See LayOutStyledText().
+    void SetLayout(int pos, int x, int width)
+      {
+        m_pos = pos;
+        m_x = x;
+        m_width = width;
+      }
+    //! The column of the line this text portion starts at
+    int GetPos()
+      {
+        return m_pos;
+      }
+    //! The horizontal position of this text portion relative to the start of its line
+    int GetX()
+      {
+        return m_x;
+      }
+    //! The width of this text portion
+    int GetWidth()
+      {
+        return m_width;
       }
     //! Returns the piece of text
     wxString GetText()
@@ -337,7 +407,85 @@ private:
       }
   };
   
-  std::list<StyledText> m_styledText;
+  //! The text of this cell, divided into portions by StyleText()
+  std::vector<StyledText> m_styledText;
+  //! The index of the first element of m_styledText of each line
+  std::vector<size_t> m_styledLines;
+  //! Have the positions and widths of the elements of m_styledText been measured?
+  bool m_styledTextLaidOut;
+  /*! Measure all elements of m_styledText and fill m_styledLines
+
+    Uses the font that is currently set for dc. Draw() and all functions that
+    need to know where a character is drawn then only need to look up the
+    positions instead of measuring the text again.
+   */
+  void LayOutStyledText(wxDC& dc);
+  //! The widths of the text snippets of one line
+  struct LineWidths
+  {
+    LineWidths() : m_textVersion(-1), m_hash(0) {}
+    //! The m_textVersion the widths are known to be valid for
+    long m_textVersion;
+    //! A hash of the snippets of the line
+    wxUint64 m_hash;
+    //! The width of each snippet
+    std::vector<int> m_widths;
+  };
+  /*! The widths of the snippets of each line, as LayOutStyledText() has measured them
+
+    As long as m_text doesn't change a line's entry is found by its index and
+    m_textVersion. After a change the hash of the line's snippets tells if the line
+    has changed, too. This way an edit only causes the lines that actually have
+    changed to be measured anew.
+   */
+  std::vector<LineWidths> m_lineWidths;
+  //! The font m_lineWidths has been measured with
+  wxString m_lineWidthsFont;
+  //! The index of the first element of m_styledText that doesn't belong to a line
+  size_t StyledLineEnd(size_t line)
+  {
+    return (line + 1 < m_styledLines.size())?m_styledLines[line + 1]:m_styledText.size();
+  }
+
+  //! The states the syntax highlighter can be in at the end of a line
+  enum LexerState
+  {
+    LEXER_CODE,    //!< Ordinary code
+    LEXER_STRING,  //!< Inside a string
+    LEXER_COMMENT  //!< Inside a comment
+  };
+  //! A line of code, the context it has been styled in and the result
+  struct StyledLine
+  {
+    //! The text of the line
+    wxString m_text;
+    //! The LexerState at the start of the line
+    int m_stateIn;
+    //! The last non-whitespace character of the code before the line
+    wxChar m_lastCharIn;
+    //! The first non-whitespace character after the line
+    wxChar m_nextChar;
+    //! The LexerState at the end of the line
+    int m_stateOut;
+    //! The last non-whitespace character of the code up to the end of the line
+    wxChar m_lastCharOut;
+    //! The styled snippets of this line
+    std::vector<StyledText> m_styledText;
+  };
+  //! The lines of code as StyleText() has styled them the last time
+  std::vector<StyledLine> m_styledLineCache;
+  /*! Style a single line of code
+
+    \param line The text of the line, without the newline
+    \param state The LexerState at the start of the line. Is set to the state
+                 at the end of the line.
+    \param lastChar The last non-whitespace character of the code before the
+                 line (text in strings and comments doesn't count). Is updated.
+    \param nextChar The first non-whitespace character after the line
+    \param styledText The list the styled snippets are appended to
+   */
+  void StyleLine(wxString line, int &state, wxChar &lastChar, wxChar nextChar,
+                 std::vector<StyledText> &styledText);
 
 #if wxUSE_UNICODE
   /*! Handle ESC shortcuts for special characters
@@ -349,11 +497,112 @@ private:
   wxString InterpretEscapeString(wxString txt);
 #endif
   wxString m_text;
-  wxArrayString m_textHistory;
-  std::vector<int> m_positionHistory;
-  std::vector<int> m_startHistory;
-  std::vector<int> m_endHistory;
+  /*! Change m_text
+
+    All changes of m_text have to go through this function or ReplaceText() so
+    m_textVersion tells the indices that are built from m_text that they are
+    outdated. Edits of a part of the text should use ReplaceText().
+   */
+  void SetText(const wxString &text)
+    {
+      m_text = text;
+      m_textVersion++;
+    }
+  /*! Replace the characters start...end-1 of m_text by text
+
+    Unlike SetText() this keeps an up-to-date m_lineStarts valid: Only the
+    text that has been inserted is searched for line breaks and the lines
+    behind the edit are moved by the change of length.
+   */
+  void ReplaceText(size_t start, size_t end, const wxString &text);
+  //! Insert text in front of m_text[pos]
+  void InsertText(size_t pos, const wxString &text) { ReplaceText(pos, pos, text); }
+  //! Delete the characters start...end-1 of m_text
+  void EraseText(size_t start, size_t end) { ReplaceText(start, end, wxEmptyString); }
+  //! Is incremented on every change of m_text.
+  long m_textVersion;
+  /*! Make sure that m_lineStarts describes the current m_text
+
+    Is cheap if m_text hasn't changed since the last call or has only been
+    changed by ReplaceText().
+   */
+  void UpdateLineIndex();
+  //! The line m_text[pos] is part of
+  size_t LineOfPosition(size_t pos);
+  //! The index of the first character of each line of m_text
+  std::vector<size_t> m_lineStarts;
+  //! The m_textVersion m_lineStarts has been calculated for
+  long m_lineIndexVersion;
+  //! Make sure m_delimiters describes the current m_text
+  void UpdateDelimiterIndex();
+  //! The index of the delimiter at the position pos in m_delimiters or -1
+  long DelimiterAt(size_t pos);
+  //! The positions of all parenthesis, brackets and quotes in m_text
+  std::vector<size_t> m_delimiters;
+  //! The position of the delimiter each entry of m_delimiters matches or -1
+  std::vector<long> m_delimiterMatches;
+  //! The result of Delimiters::Scan() for m_text
+  wxString m_parenthesisState;
+  //! The m_textVersion m_delimiters has been calculated for
+  long m_delimiterIndexVersion;
+  /*! One step of the undo history
+
+    Instead of a copy of the whole text a step only remembers the part of the
+    text that differs from the step before it. This way the history of a big
+    cell doesn't grow by the size of the cell on each keystroke and undoing or
+    redoing a step only costs as much as the edit it undoes.
+   */
+  struct UndoStep
+  {
+    //! How the text differs from the text of the step before
+    TextDelta m_delta;
+    int m_positionOfCaret;
+    int m_selectionStart;
+    int m_selectionEnd;
+  };
+  //! Append m_text to the undo history
+  void PushUndoStep();
+  //! Replace m_historyText by the text of the step before or after the step index
+  void ApplyUndoStep(size_t index, bool forward);
+  //! Forget all undo steps from the step number size on
+  void TruncateUndoHistory(size_t size);
+  //! Can the oldest undo step be forgotten in order to save memory?
+  bool CanDropUndoStep();
+  //! Forget the oldest undo step
+  void DropOldestUndoStep();
+  //! Update the number of bytes our undo history uses
+  void AccountUndoBytes();
+  //! Forget old undo steps until the history fits into the memory budget
+  void LimitUndoHistory();
+  //! The number of bytes a step of the undo history uses
+  static long UndoStepSize(const UndoStep &step);
+  //! The undo history, the oldest step first
+  std::deque<UndoStep> m_undoSteps;
+  /*! The text of the current step of the undo history
+
+    This is the only full copy of a text the undo history contains. All other
+    steps are reached from it by applying the differences the steps store.
+   */
+  wxString m_historyText;
+  /*! The step of the undo history m_text was taken from
+
+    -1 means that m_text is newer than all steps of the history.
+   */
   ptrdiff_t m_historyPosition;
+  //! The number of bytes the differences our undo steps store use
+  long m_undoStepBytes;
+  //! The number of bytes our undo history uses
+  long m_undoBytes;
+  //! Our entry in m_undoCells; only valid if m_undoSteps isn't empty.
+  std::list<EditorCell *>::iterator m_undoCellsEntry;
+  //! All cells that have an undo history, the most recently edited one first
+  static std::list<EditorCell *> m_undoCells;
+  //! The number of bytes the undo histories of all cells use together
+  static long m_undoBytesTotal;
+  //! The maximum number of bytes the undo history of one cell may use
+  static long m_undoBudgetCell;
+  //! The maximum number of bytes the undo histories of all cells may use
+  static long m_undoBudgetTotal;
   //! Where inside this cell is the cursor?
   int m_positionOfCaret;
   int m_caretColumn;
@@ -209,12 +209,12 @@ wxString ExptCell::ToMathML()
 //  return wxT("<apply><power/>") + m_baseCell->ListToMathML() + m_powCell->ListToMathML() + wxT("</apply>");
 }
 
-wxString ExptCell::ToXML()
+wxString ExptCell::ToXML(WXMXImageList &images)
 {
 //  if (m_isBroken)
 //    return wxEmptyString;
-  return _T("<e><r>") + m_baseCell->ListToXML() + _T("</r><r>") +
-    m_powCell->ListToXML() + _T("</r></e>");
+  return _T("<e><r>") + m_baseCell->ListToXML(images) + _T("</r><r>") +
+    m_powCell->ListToXML(images) + _T("</r></e>");
 }
 
 void ExptCell::SelectInner(wxRect& rect, MathCell **first, MathCell **last)
@@ -40,7 +40,7 @@ public:
   void Draw(CellParser& parser, wxPoint point, int fontsize);
   wxString ToString();
   wxString ToTeX();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   wxString ToMathML();
   wxString GetDiffPart();
   void SelectInner(wxRect& rect, MathCell **first, MathCell **last);
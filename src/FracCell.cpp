@@ -315,7 +315,7 @@ wxString FracCell::ToMathML()
     m_denom->ListToMathML() + wxT("</mfrac>\n");
 }
 
-wxString FracCell::ToXML()
+wxString FracCell::ToXML(WXMXImageList &images)
 {
   wxString s = ( m_fracStyle == FC_NORMAL || m_fracStyle == FC_DIFF )?
     _T("f"): _T("f line = \"no\"");
@@ -323,8 +323,8 @@ wxString FracCell::ToXML()
   if(m_fracStyle == FC_DIFF)
     diffStyle=wxT(" diffstyle=\"yes\"");
   return _T("<") + s + diffStyle + _T("><r>") +
-    m_num->ListToXML() + _T("</r><r>") +
-    m_denom->ListToXML() + _T("</r></f>");
+    m_num->ListToXML(images) + _T("</r><r>") +
+    m_denom->ListToXML(images) + _T("</r></f>");
 }
 
 void FracCell::SelectInner(wxRect& rect, MathCell **first, MathCell **last)
@@ -59,7 +59,7 @@ public:
   wxString ToString();
   wxString ToTeX();
   wxString ToMathML();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   void SetExponentFlag();
   bool BreakUp();
   void SetupBreakUps();
@@ -154,12 +154,12 @@ wxString FunCell::ToTeX()
   return s;
 }
 
-wxString FunCell::ToXML()
+wxString FunCell::ToXML(WXMXImageList &images)
 {
 //  if (m_isBroken)
 //    return wxEmptyString;
-  return _T("<fn>") + m_nameCell->ListToXML() +
-    m_argCell->ListToXML() + _T("</fn>");
+  return _T("<fn>") + m_nameCell->ListToXML(images) +
+    m_argCell->ListToXML(images) + _T("</fn>");
 }
 
 wxString FunCell::ToMathML()
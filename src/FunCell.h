@@ -39,7 +39,7 @@ public:
   wxString ToString();
   wxString ToTeX();
   wxString ToMathML();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   void SelectInner(wxRect& rect, MathCell** first, MathCell** last);
   bool BreakUp();
   void Unbreak();
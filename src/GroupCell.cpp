@@ -23,6 +23,7 @@
 
 #include <wx/config.h>
 #include <wx/clipbrd.h>
+#include <wx/dcmemory.h>
 #include "MarkDown.h"
 #include "GroupCell.h"
 #include "SlideShowCell.h"
@@ -32,6 +33,11 @@
 #include "Bitmap.h"
 #include "list"
 
+std::list<GroupCell *> GroupCell::m_surfaceCache;
+long GroupCell::m_surfaceCacheSize = 0;
+long GroupCell::m_surfaceCacheBudget = 32 * 1024 * 1024;
+long GroupCell::m_xmlVersionCounter = 0;
+
 GroupCell::GroupCell(int groupType, wxString initString) : MathCell()
 {
   m_input = NULL;
@@ -52,6 +58,11 @@ GroupCell::GroupCell(int groupType, wxString initString) : MathCell()
   m_groupType = groupType;
   m_lastInOutput = NULL;
   m_appendedCells = NULL;
+  m_sizeIsEstimated = false;
+  m_forceUpdatePending = false;
+  m_clientWidth = -1;
+  m_surface = NULL;
+  XMLChanged();
 
   // set up cell depending on groupType, so we have a working cell
   if (groupType != GC_TYPE_PAGEBREAK) {
@@ -128,6 +139,7 @@ GroupCell::GroupCell(int groupType, wxString initString) : MathCell()
 
 GroupCell::~GroupCell()
 {
+  InvalidateSurface();
   if (m_input != NULL)
     delete m_input;
   DestroyOutput();
@@ -166,10 +178,18 @@ void GroupCell::DestroyOutput(bool destroyFirst)
 {
   MathCell *tmp = m_output, *tmp1;
 
+  // Even if there is no output the cell might have been drawn as waiting for
+  // one => our cached bitmap is outdated in every case.
+  InvalidateSurface();
+
   // If there isn't anything to do we can already return.
   if(tmp == NULL)
     return;
 
+  m_outputXML.clear();
+  m_lineBreaks.clear();
+  XMLChanged();
+
   // If we are dealing with an image cell we don't delete the actual image.
   if(!destroyFirst)
   {
@@ -197,11 +217,24 @@ void GroupCell::DestroyOutput(bool destroyFirst)
 void GroupCell::ResetInputLabel()
 {
   if (m_groupType == GC_TYPE_CODE) {
-    if (m_input)
+    if ((m_input) && (m_input->GetValue() != EMPTY_INPUT_LABEL))
+    {
       m_input->SetValue(EMPTY_INPUT_LABEL);
+      XMLChanged();
+    }
+    InvalidateSurface();
   }
 }
 
+void GroupCell::SetPrompt(wxString prompt)
+{
+  if (m_input == NULL)
+    return;
+  m_input->SetValue(prompt);
+  InvalidateSurface();
+  XMLChanged();
+}
+
 void GroupCell::ResetInputLabelList()
 {
   GroupCell *tmp=this;
@@ -256,10 +289,12 @@ void GroupCell::SetInput(MathCell *input)
     delete m_input;
   m_input = input;
   m_input->SetParent(this);
+  XMLChanged();
 }
 
 void GroupCell::AppendInput(MathCell *cell)
 {
+  XMLChanged();
   if (m_input == NULL) {
     m_input = cell;
   }
@@ -288,6 +323,9 @@ void GroupCell::SetOutput(MathCell *output)
 
   m_output = output;
   m_output->SetParent(this);
+  m_outputXML.clear();
+  m_lineBreaks.clear();
+  XMLChanged();
 
   m_lastInOutput = m_output;
 
@@ -314,6 +352,10 @@ void GroupCell::AppendOutput(MathCell *cell)
 {
   wxASSERT_MSG(cell != NULL,_("Bug: Trying to append NULL to a group cell."));
   if(cell == NULL) return;
+  InvalidateSurface();
+  m_outputXML.clear();
+  m_lineBreaks.clear();
+  XMLChanged();
   cell->SetParentList(this);
   if (m_output == NULL) {
     m_output = cell;
@@ -350,14 +392,123 @@ void GroupCell::Recalculate(CellParser& parser, int d_fontsize, int m_fontsize)
   m_fontSize = d_fontsize;
   m_mathFontSize = m_fontsize;
 
-  RecalculateWidths(parser, d_fontsize);
-  RecalculateSize(parser, d_fontsize);
+  if (m_sizeIsEstimated)
+  {
+    // EstimateSize() has replaced our size by a guess.
+    ResetSize();
+    m_sizeIsEstimated = false;
+  }
+
+  // If only the width of the worksheet has changed our contents keep their
+  // sizes: Only the lines of the output have to be broken anew.
+  if (m_clientWidth != parser.GetClientWidth())
+    ResetSize();
+
+  if (m_forceUpdatePending && !parser.ForceUpdate())
+  {
+    // This cell has been skipped by the layout pass after a font or style
+    // change => its contents have to be measured anew.
+    parser.SetForceUpdate(true);
+    RecalculateWidths(parser, d_fontsize);
+    RecalculateSize(parser, d_fontsize);
+    parser.SetForceUpdate(false);
+  }
+  else
+  {
+    RecalculateWidths(parser, d_fontsize);
+    RecalculateSize(parser, d_fontsize);
+  }
+  m_forceUpdatePending = false;
+}
+
+void GroupCell::EstimateSize(CellParser& parser, int d_fontsize, int m_fontsize)
+{
+  m_fontSize = d_fontsize;
+  m_mathFontSize = m_fontsize;
+  m_indent = parser.GetIndent();
+
+  if (m_groupType == GC_TYPE_PAGEBREAK)
+  {
+    Recalculate(parser, d_fontsize, m_fontsize);
+    return;
+  }
+
+  m_sizeIsEstimated = true;
+  // If the fonts or styles have changed our contents have to be measured anew as
+  // soon as we are laid out.
+  if (parser.ForceUpdate())
+    m_forceUpdatePending = true;
+  InvalidateSurface();
+  double scale = parser.GetScale();
+
+  int fontsize = d_fontsize;
+  if (parser.GetFontSize(m_input->GetStyle()) > 0)
+    fontsize = parser.GetFontSize(m_input->GetStyle());
+  int lineHeight = SCALE_PX(MAX(fontsize, MC_MIN_SIZE), scale) * 3 / 2 +
+    2 * MC_TEXT_PADDING;
+  int charWidth = MAX(SCALE_PX(MAX(fontsize, MC_MIN_SIZE), scale) * 3 / 5, 1);
+
+  // The input part: One line of text per line of the input
+  int lines = 1;
+  int columns = 0;
+  EditorCell *editor = GetEditable();
+  if (editor != NULL)
+  {
+    wxString value = editor->GetValue();
+    int column = 0;
+    for (wxString::const_iterator it = value.begin(); it != value.end(); ++it)
+    {
+      if (*it == wxT('\n'))
+      {
+        lines++;
+        column = 0;
+      }
+      else
+        columns = MAX(columns, ++column);
+    }
+  }
+  m_center = lineHeight / 2;
+  m_height = lines * lineHeight;
+  m_width = MAX(m_input->GetWidth(), 0) + columns * charWidth;
+
+  // The output part: Images know their size, everything else is guessed to be
+  // one line of text per line of output.
+  if (m_output != NULL && !m_hide)
+  {
+    int mathLineHeight = SCALE_PX(MAX(m_fontsize, MC_MIN_SIZE), scale) * 3 / 2 +
+      2 * MC_TEXT_PADDING;
+    MathCell *tmp = m_output;
+    while (tmp != NULL)
+    {
+      if ((tmp->GetType() == MC_TYPE_IMAGE) || (tmp->GetType() == MC_TYPE_SLIDE))
+      {
+        tmp->RecalculateWidths(parser, m_fontSize);
+        tmp->RecalculateSize(parser, m_fontSize);
+        m_height += tmp->GetHeight() + MC_LINE_SKIP;
+        m_width = MAX(m_width, tmp->GetWidth());
+      }
+      else if ((tmp == m_output) || tmp->ForceBreakLineHere())
+        m_height += mathLineHeight + MC_LINE_SKIP;
+      tmp = tmp->m_next;
+    }
+  }
+
+  m_appendedCells = NULL;
+  ResetData();
+  UpdateYPosition();
 }
 
 void GroupCell::RecalculateWidths(CellParser& parser, int fontsize)
 {
   if (m_width == -1 || m_height == -1 || parser.ForceUpdate())
   {
+    InvalidateSurface();
+    m_clientWidth = parser.GetClientWidth();
+
+    // After a font or style change the cells will have different sizes.
+    if (parser.ForceUpdate())
+      m_lineBreaks.clear();
+
     // special case of 'line cell'
     if (m_groupType == GC_TYPE_PAGEBREAK) {
       m_width = 10;
@@ -390,16 +541,82 @@ void GroupCell::RecalculateWidths(CellParser& parser, int fontsize)
       m_width = m_input->GetFullWidth(scale);
     }
 
-    BreakUpCells(parser, m_fontSize, parser.GetClientWidth());
-    BreakLines(parser.GetClientWidth());
+    if (!RestoreLineBreaks(parser))
+    {
+      std::vector<MathCell *> brokenUp;
+      BreakUpCells(m_output, parser, m_fontSize, parser.GetClientWidth(), &brokenUp);
+      BreakLines(parser.GetClientWidth());
+      StoreLineBreaks(parser, brokenUp);
+    }
   }
   ResetData();
 }
 
+bool GroupCell::RestoreLineBreaks(CellParser& parser)
+{
+  if (m_hide)
+    return false;
+
+  std::map<std::pair<int, int>, LineBreaks>::iterator it =
+    m_lineBreaks.find(std::make_pair(parser.GetClientWidth(), m_canvasSize.y));
+  if (it == m_lineBreaks.end())
+    return false;
+
+  // The same as BreakUpCells() would do, but without having to look at the
+  // widths of all cells.
+  std::vector<MathCell *> &brokenUp = it->second.m_brokenUp;
+  for (size_t i = 0; i < brokenUp.size(); i++)
+    if (brokenUp[i]->BreakUp())
+    {
+      brokenUp[i]->RecalculateWidths(parser, brokenUp[i]->IsMath() ? m_mathFontSize : m_fontSize);
+      brokenUp[i]->RecalculateSize(parser, brokenUp[i]->IsMath() ? m_mathFontSize : m_fontSize);
+    }
+
+  // The same as BreakLines() would do
+  std::vector<MathCell *> &lineStarts = it->second.m_lineStarts;
+  size_t nextLineStart = 0;
+  MathCell *tmp = m_output;
+  while (tmp != NULL)
+  {
+    tmp->ResetData();
+    tmp->BreakLine(false);
+    if ((nextLineStart < lineStarts.size()) && (lineStarts[nextLineStart] == tmp))
+    {
+      tmp->BreakLine(true);
+      nextLineStart++;
+    }
+    tmp = tmp->m_nextToDraw;
+  }
+  return true;
+}
+
+void GroupCell::StoreLineBreaks(CellParser& parser, const std::vector<MathCell *> &brokenUp)
+{
+  if (m_hide || (m_output == NULL))
+    return;
+
+  if (m_lineBreaks.size() >= m_lineBreaksMaxSize)
+    m_lineBreaks.clear();
+
+  LineBreaks &lineBreaks =
+    m_lineBreaks[std::make_pair(parser.GetClientWidth(), m_canvasSize.y)];
+  lineBreaks.m_brokenUp = brokenUp;
+  lineBreaks.m_lineStarts.clear();
+  MathCell *tmp = m_output;
+  while (tmp != NULL)
+  {
+    if (!tmp->m_isBroken && tmp->BreakLineHere())
+      lineBreaks.m_lineStarts.push_back(tmp);
+    tmp = tmp->m_nextToDraw;
+  }
+}
+
 void GroupCell::RecalculateSize(CellParser& parser, int fontsize)
 {
   if (m_width == -1 || m_height == -1 || parser.ForceUpdate())
   {
+    InvalidateSurface();
+
     // special case
     if (m_groupType == GC_TYPE_PAGEBREAK) {
       m_width = 10;
@@ -446,7 +663,11 @@ void GroupCell::RecalculateSize(CellParser& parser, int fontsize)
   }
 
   m_appendedCells = NULL;
+  UpdateYPosition();
+}
 
+void GroupCell::UpdateYPosition()
+{
   if(m_previous == NULL)
   {
     m_currentPoint.x = MC_GROUP_LEFT_INDENT;
@@ -471,6 +692,8 @@ void GroupCell::RecalculateAppended(CellParser& parser)
   if (m_appendedCells == NULL)
     return;
 
+  InvalidateSurface();
+
   MathCell *tmp = m_appendedCells;
   int fontsize = m_fontSize;
   double scale = parser.GetScale();
@@ -657,6 +880,132 @@ void GroupCell::Draw(CellParser& parser, wxPoint point, int fontsize)
   }
 }
 
+void GroupCell::DrawCached(CellParser& parser, wxPoint point, int fontsize)
+{
+  // The bracket at the bottom of the cell is drawn one pixel below m_height.
+  wxRect rect(0, point.y - m_center, m_canvasSize.GetWidth(), m_height + 1);
+
+  // Cells that haven't been laid out yet, page breaks and cells that are wider
+  // than the canvas aren't worth caching.
+  if ((m_width == -1) || (m_height == -1) || (m_groupType == GC_TYPE_PAGEBREAK) ||
+      (point.x + m_indent + m_width >= rect.GetWidth()))
+  {
+    InvalidateSurface();
+    Draw(parser, point, fontsize);
+    return;
+  }
+
+  wxDC& dc = parser.GetDC();
+  double contentScale = dc.GetContentScaleFactor();
+  long bytes = long(rect.GetWidth() * contentScale) * long(rect.GetHeight() * contentScale) * 4;
+  if (bytes > m_surfaceCacheBudget)
+  {
+    InvalidateSurface();
+    Draw(parser, point, fontsize);
+    return;
+  }
+
+  bool outdated = (m_groupType == GC_TYPE_CODE) && (m_input->m_next != NULL) &&
+    ((EditorCell *)(m_input->m_next))->ContainsChanges();
+
+  if ((m_surface != NULL) &&
+      ((m_surfacePoint != point) || (m_surfaceFontSize != fontsize) ||
+       (m_surfaceCanvasWidth != rect.GetWidth()) || (m_surfaceOutdated != outdated) ||
+       (m_surface->GetScaledHeight() != rect.GetHeight())))
+    InvalidateSurface();
+
+  if (m_surface == NULL)
+  {
+    m_surface = new wxBitmap();
+    m_surface->CreateScaled(rect.GetWidth(), rect.GetHeight(), -1, contentScale);
+
+    wxMemoryDC surfaceDC;
+    surfaceDC.SelectObject(*m_surface);
+    surfaceDC.SetBackground(dc.GetBackground());
+    surfaceDC.Clear();
+    surfaceDC.SetDeviceOrigin(0, -rect.GetTop());
+    surfaceDC.SetMapMode(wxMM_TEXT);
+    surfaceDC.SetBackgroundMode(wxTRANSPARENT);
+    surfaceDC.SetLogicalFunction(wxCOPY);
+    surfaceDC.SetPen(dc.GetPen());
+    surfaceDC.SetBrush(dc.GetBrush());
+
+    CellParser surfaceParser(surfaceDC);
+    surfaceParser.SetScale(parser.GetScale());
+    surfaceParser.SetZoomFactor(parser.GetZoomFactor());
+    surfaceParser.SetChangeAsterisk(parser.GetChangeAsterisk());
+    surfaceParser.SetBounds(rect.GetTop(), rect.GetBottom());
+
+    // Draw all of the cell, not only the part that currently needs updating.
+    wxRect updateRegion = GetUpdateRegion();
+    SetUpdateRegion(rect);
+    Draw(surfaceParser, point, fontsize);
+    SetUpdateRegion(updateRegion);
+    surfaceDC.SelectObject(wxNullBitmap);
+
+    m_surfacePoint = point;
+    m_surfaceFontSize = fontsize;
+    m_surfaceCanvasWidth = rect.GetWidth();
+    m_surfaceOutdated = outdated;
+    m_surfaceCache.push_front(this);
+    m_surfaceCacheEntry = m_surfaceCache.begin();
+    m_surfaceCacheSize += long(m_surface->GetWidth()) * long(m_surface->GetHeight()) * 4;
+
+    // Make room by dropping the bitmaps that haven't been used for the longest time.
+    while ((m_surfaceCacheSize > m_surfaceCacheBudget) && (m_surfaceCache.back() != this))
+      m_surfaceCache.back()->InvalidateSurface();
+  }
+  else
+    m_surfaceCache.splice(m_surfaceCache.begin(), m_surfaceCache, m_surfaceCacheEntry);
+
+  if (InUpdateRegion(rect))
+  {
+    wxRect visible = CropToUpdateRegion(rect);
+    wxMemoryDC surfaceDC;
+    surfaceDC.SelectObject(*m_surface);
+    dc.Blit(visible.GetLeft(), visible.GetTop(), visible.GetWidth(), visible.GetHeight(),
+            &surfaceDC, visible.GetLeft() - rect.GetLeft(), visible.GetTop() - rect.GetTop());
+    surfaceDC.SelectObject(wxNullBitmap);
+  }
+}
+
+void GroupCell::InvalidateSurface()
+{
+  if (m_surface == NULL)
+    return;
+
+  m_surfaceCacheSize -= long(m_surface->GetWidth()) * long(m_surface->GetHeight()) * 4;
+  m_surfaceCache.erase(m_surfaceCacheEntry);
+  wxDELETE(m_surface);
+}
+
+size_t GroupCell::SizeInMemory()
+{
+  size_t size = sizeof(GroupCell);
+  if (m_input)
+    size += m_input->SizeInMemoryList();
+  if (m_output)
+    size += m_output->SizeInMemoryList();
+  if (m_surface)
+    size += m_surface->GetWidth() * m_surface->GetHeight() * 4;
+  if (m_hiddenTree)
+    size += m_hiddenTree->SizeInMemoryList();
+  return size;
+}
+
+void GroupCell::SetSurfaceCacheBudget(long bytes)
+{
+  m_surfaceCacheBudget = bytes;
+  while ((m_surfaceCacheSize > m_surfaceCacheBudget) && !m_surfaceCache.empty())
+    m_surfaceCache.back()->InvalidateSurface();
+}
+
+void GroupCell::ClearSurfaceCache()
+{
+  while (!m_surfaceCache.empty())
+    m_surfaceCache.back()->InvalidateSurface();
+}
+
 wxRect GroupCell::HideRect()
 {
   return wxRect(m_currentPoint.x - 10, m_currentPoint.y - m_center, 10, 10);
@@ -903,7 +1252,7 @@ wxString GroupCell::ToTeXImage(MathCell *tmp, wxString imgDir, wxString filename
   return str;
 }
 
-wxString GroupCell::ToXML()
+wxString GroupCell::ToXML(WXMXImageList &images)
 {
   wxString str;
   str = wxT("\n<cell"); // start opening tag
@@ -956,35 +1305,35 @@ wxString GroupCell::ToXML()
     case GC_TYPE_CODE:
       if (input != NULL) {
         str += wxT("<input>\n");
-        str += input->ListToXML();
+        str += input->ListToXML(images);
         str += wxT("</input>");
       }
       if (output != NULL) {
         str += wxT("\n<output>\n");
         str += wxT("<mth>");
-        str += output->ListToXML();
+        str += OutputToXML(output, images);
         str += wxT("\n</mth></output>");
       }
       break;
     case GC_TYPE_IMAGE:
       if (input != NULL)
-        str += input->ListToXML();
+        str += input->ListToXML(images);
       if (output != NULL)
-        str += output->ListToXML();
+        str += OutputToXML(output, images);
       break;
     case GC_TYPE_TEXT:
       if (input)
-        str += input->ListToXML();
+        str += input->ListToXML(images);
       break;
     case GC_TYPE_TITLE:
     case GC_TYPE_SECTION:
     case GC_TYPE_SUBSECTION:
     case GC_TYPE_SUBSUBSECTION:
       if (input)
-        str += input->ListToXML();
+        str += input->ListToXML(images);
       if (m_hiddenTree) {
         str += wxT("<fold>");
-        str+= m_hiddenTree->ListToXML();
+        str+= m_hiddenTree->ListToXML(images);
         str += wxT("</fold>");
       }
       break;
@@ -992,7 +1341,7 @@ wxString GroupCell::ToXML()
     {
       MathCell *tmp = output;
       while (tmp != NULL) {
-        str += tmp->ListToXML();
+        str += tmp->ListToXML(images);
         tmp = tmp->m_next;
       }
       break;
@@ -1003,6 +1352,36 @@ wxString GroupCell::ToXML()
   return str;
 }
 
+wxString GroupCell::OutputToXML(MathCell *output, WXMXImageList &images)
+{
+  if (!images.IsCacheable())
+    return output->ListToXML(images);
+
+  std::map<long, OutputXML>::iterator cached = m_outputXML.find(images.GetId());
+  if (cached != m_outputXML.end())
+  {
+    // The images need to be marked as used as though we had converted them.
+    bool found = true;
+    for (size_t i = 0; (i < cached->second.m_images.size()) && found; i++)
+      found = images.MarkUsed(cached->second.m_images[i].first,
+                              cached->second.m_images[i].second);
+    if (found)
+      return cached->second.m_xml;
+  }
+
+  size_t firstImage = images.GetUsed().size();
+  OutputXML xml;
+  xml.m_xml = output->ListToXML(images);
+  for (size_t i = firstImage; i < images.GetUsed().size(); i++)
+  {
+    size_t image = images.GetUsed()[i];
+    xml.m_images.push_back(std::make_pair((const void *) images.GetData(image).GetData(),
+                                          images.GetName(image)));
+  }
+  m_outputXML[images.GetId()] = xml;
+  return xml.m_xml;
+}
+
 void GroupCell::SelectRectGroup(wxRect& rect, wxPoint& one, wxPoint& two,
     MathCell **first, MathCell **last)
 {
@@ -1116,6 +1495,7 @@ bool GroupCell::SetEditableContent(wxString text)
 {
   if (GetEditable()) {
     GetEditable()->SetValue(text);
+    InvalidateSurface();
     return true;
   }
   else
@@ -1193,13 +1573,16 @@ void GroupCell::BreakUpCells(CellParser parser, int fontsize, int clientWidth)
   BreakUpCells(m_output, parser, fontsize, clientWidth);
 }
 
-void GroupCell::BreakUpCells(MathCell *cell, CellParser parser, int fontsize, int clientWidth)
+void GroupCell::BreakUpCells(MathCell *cell, CellParser parser, int fontsize, int clientWidth,
+                             std::vector<MathCell *> *brokenUp)
 {
   MathCell *tmp = cell;
 
   while (tmp != NULL && !m_hide) {
     if (tmp->GetWidth() > clientWidth) {
       if (tmp->BreakUp()) {
+        if (brokenUp != NULL)
+          brokenUp->push_back(tmp);
         tmp->RecalculateWidths(parser,  tmp->IsMath() ? m_mathFontSize : m_fontSize);
         tmp->RecalculateSize(parser,  tmp->IsMath() ? m_mathFontSize : m_fontSize);
       }
@@ -1229,6 +1612,8 @@ void GroupCell::Hide(bool hide) {
     return;
 
   m_hide = hide;
+  InvalidateSurface();
+  XMLChanged();
   if ((m_groupType == GC_TYPE_TEXT) || (m_groupType == GC_TYPE_CODE))
     GetEditable()->SetFirstLineOnly(m_hide);
 
@@ -1252,12 +1637,15 @@ bool GroupCell::HideTree(GroupCell *tree)
     return false;
   m_hiddenTree = tree;
   m_hiddenTree->SetHiddenTreeParent(this);
+  InvalidateSurface();
+  XMLChanged();
 
   // Clear cached images from cells that are hidden
   GroupCell *tmp = m_hiddenTree;
   while(tmp)
   {
     tmp->GetLabel()->ClearCacheList();
+    tmp->InvalidateSurface();
     tmp = dynamic_cast<GroupCell *>(tmp->m_next);
   }
   
@@ -1269,6 +1657,8 @@ GroupCell *GroupCell::UnhideTree()
   GroupCell *tree = m_hiddenTree;
   m_hiddenTree->SetHiddenTreeParent(m_hiddenTreeParent);
   m_hiddenTree = NULL;
+  InvalidateSurface();
+  XMLChanged();
   return tree;
 }
 
@@ -1334,6 +1724,7 @@ GroupCell *GroupCell::Fold() {
   end->m_next = end->m_nextToDraw = NULL;
   m_hiddenTree = start; // save the torn out tree into m_hiddenTree
   m_hiddenTree->SetHiddenTreeParent(this);
+  XMLChanged();
   return this;
 }
 
@@ -1359,6 +1750,7 @@ GroupCell *GroupCell::Unfold() {
 
   m_hiddenTree->SetHiddenTreeParent(m_hiddenTreeParent);
   m_hiddenTree = NULL;
+  XMLChanged();
   return dynamic_cast<GroupCell*>(tmp);
 }
 
@@ -30,6 +30,9 @@
 
 #include "MathCell.h"
 #include "EditorCell.h"
+#include <list>
+#include <map>
+#include <vector>
 
 #define EMPTY_INPUT_LABEL wxT("-->  ")
 
@@ -93,7 +96,16 @@ public:
   wxString ToTeX();
   //! Add Markdown to the TeX representation of input cells.
   wxString TeXMarkdown(wxString str);
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
+  /*! A number that changes each time the xml representation of this cell might change
+
+    Changes of the text of the cell's editor aren't counted: They are counted
+    by EditorCell::GetTextVersion(). No other cell ever gets the same number,
+    not even one that is created at the same address after this one has been
+    deleted. Used by WXMXJournal to find the cells that have changed since
+    its last record.
+   */
+  long GetXMLVersion() { return m_xmlVersion; }
   //! Return the hide status
   bool IsHidden() { return m_hide; }
   void Hide(bool hide);
@@ -113,8 +125,42 @@ public:
   void RecalculateSize(CellParser& parser, int fontsize);
   void RecalculateWidths(CellParser& parser, int fontsize);
   void Recalculate(CellParser& parser, int d_fontsize, int m_fontsize);
+  /*! Guess the size of this cell without laying out its contents
+
+    Used for cells that are far away from the visible part of the worksheet:
+    The guess is based on the number of lines of the input and the output and
+    on the sizes of the images in the output. Recalculate() replaces the
+    estimate by the real size as soon as the cell comes near the viewport.
+
+    Is only to be called for cells that are actually skipped by a layout pass,
+    see NeedsRecalculation().
+   */
+  void EstimateSize(CellParser& parser, int d_fontsize, int m_fontsize);
+  //! Is the size of this cell only a guess made by EstimateSize()?
+  bool IsSizeEstimated() { return m_sizeIsEstimated; }
+  /*! Would Recalculate() need to lay out this cell again?
+
+    If not, Recalculate() is cheap: All it does is to place the cell.
+   */
+  bool NeedsRecalculation(CellParser& parser)
+    {
+      return m_sizeIsEstimated || m_width == -1 || m_height == -1 || parser.ForceUpdate() ||
+        (m_clientWidth != parser.GetClientWidth());
+    }
+  /*! Place this cell below the cell before it in the worksheet
+
+    Only needs the size of this and the previous cell which means it can be 
+    called after the sizes of all cells of the worksheet have been determined.
+   */
+  void UpdateYPosition();
   void BreakUpCells(CellParser parser, int fontsize, int clientWidth);
-  void BreakUpCells(MathCell *cell, CellParser parser, int fontsize, int clientWidth);
+  /*! Break up all cells starting at cell that are wider than the client width
+
+    \param brokenUp If not NULL the cells that have been broken up are appended
+    to this list in the order they have been broken up in.
+   */
+  void BreakUpCells(MathCell *cell, CellParser parser, int fontsize, int clientWidth,
+                    std::vector<MathCell *> *brokenUp = NULL);
   void UnBreakUpCells();
   void BreakLines(int fullWidth);
   void BreakLines(MathCell *cell, int fullWidth);
@@ -124,6 +170,12 @@ public:
     with an input label.
    */
   void ResetInputLabel();
+  /*! Change the text of the input label
+
+    Use this instead of GetPrompt()->SetValue(): The cached bitmap of this cell
+    needs to be updated, too.
+   */
+  void SetPrompt(wxString prompt);
   void ResetInputLabelList();
   //! @{ folding and unfolding
 
@@ -195,6 +247,27 @@ public:
    */
   void RecalculateAppended(CellParser& parser);
   void Draw(CellParser& parser, wxPoint point, int fontsize);
+  /*! Draw this cell from a bitmap of its last rendering, if possible
+
+    Scrolling only moves cells around on the screen. Instead of drawing a cell
+    that hasn't changed since the last time it was drawn we therefore can copy
+    a bitmap of it to the screen. The bitmaps of all cells are kept in a cache
+    whose size is limited by SetSurfaceCacheBudget(): If it grows too big the
+    bitmaps that haven't been used for the longest time are dropped.
+
+    The caller has to make sure that nothing that isn't part of this cell is 
+    drawn into the area of this cell (selections, the evaluation queue markers,
+    the cursor) and that the cell isn't drawn scaled.
+   */
+  void DrawCached(CellParser& parser, wxPoint point, int fontsize);
+  //! Drop the cached bitmap of this cell as its contents have changed.
+  void InvalidateSurface();
+  //! Set the maximum number of bytes the cached bitmaps of all cells may use
+  static void SetSurfaceCacheBudget(long bytes);
+  //! Drop the cached bitmaps of all cells, for example after a style change
+  static void ClearSurfaceCache();
+  //! The number of bytes this cell, its output and the cells folded into it occupy
+  size_t SizeInMemory();
   //! Is this list of cells empty?
   bool Empty();
   //! Does this tree contain the cell "cell"?
@@ -226,8 +299,84 @@ protected:
   int m_mathFontSize;
   MathCell *m_lastInOutput;
   MathCell *m_appendedCells;
+  //! true = our size is only a guess made by EstimateSize()
+  bool m_sizeIsEstimated;
+  /*! true = EstimateSize() has skipped us in a layout pass after a font or style change
+
+    Means that Recalculate() has to measure all of our contents anew.
+   */
+  bool m_forceUpdatePending;
+  //! The client width the lines of this cell have been broken for; -1 = none.
+  int m_clientWidth;
 private:
   wxRect m_outputRect;
+  //! Where the lines of the output have been broken for one size of the worksheet
+  struct LineBreaks
+  {
+    //! The cells BreakUpCells() has broken up, in the order it has done so
+    std::vector<MathCell *> m_brokenUp;
+    //! The cells BreakLines() has begun a new line with, in drawing order
+    std::vector<MathCell *> m_lineStarts;
+  };
+  /*! The line breaks of the output for the sizes of the worksheet it has been laid out for
+
+    The key is the client width and the height of the canvas, as the images scale
+    with the canvas. Toggling back to a size the output has already been laid out
+    for therefore doesn't need to decide anew which cells to break. Is emptied on
+    every change of the output and on every font or style change.
+   */
+  std::map<std::pair<int, int>, LineBreaks> m_lineBreaks;
+  //! The maximum number of sizes m_lineBreaks remembers the line breaks for
+  static const size_t m_lineBreaksMaxSize = 8;
+  /*! Break the output's lines the way they have been broken for this size before
+
+    \return false, if the line breaks for this size aren't known.
+   */
+  bool RestoreLineBreaks(CellParser& parser);
+  //! Remember how the output's lines have been broken for the current size
+  void StoreLineBreaks(CellParser& parser, const std::vector<MathCell *> &brokenUp);
+  //! The cached bitmap of this cell or NULL, if there is none. See DrawCached().
+  wxBitmap *m_surface;
+  //! The position m_surface was drawn at
+  wxPoint m_surfacePoint;
+  //! The font size m_surface was drawn with
+  int m_surfaceFontSize;
+  //! The width of the canvas m_surface was drawn for
+  int m_surfaceCanvasWidth;
+  //! Was the output marked as outdated when m_surface was drawn?
+  bool m_surfaceOutdated;
+  //! Our entry in m_surfaceCache; only valid if m_surface != NULL.
+  std::list<GroupCell *>::iterator m_surfaceCacheEntry;
+  //! All cells owning a cached bitmap, the most recently drawn one first
+  static std::list<GroupCell *> m_surfaceCache;
+  //! The number of bytes all cached bitmaps use together
+  static long m_surfaceCacheSize;
+  //! The maximum number of bytes the cached bitmaps may use
+  static long m_surfaceCacheBudget;
+  /*! Convert the output to xml or reuse the xml from the last time
+
+    The output of a cell is the part of the worksheet that is slow to convert
+    to xml and that changes less often than the input. If the current image
+    list is cacheable (see WXMXImageList::IsCacheable()) the xml is therefore
+    kept until the output changes.
+   */
+  wxString OutputToXML(MathCell *output, WXMXImageList &images);
+  //! The cached xml of the output for one image list
+  struct OutputXML
+  {
+    //! The xml
+    wxString m_xml;
+    //! The data of the images the xml refers to and the names it refers to them by
+    std::vector<std::pair<const void *, wxString> > m_images;
+  };
+  //! The xml of the output by the id of the image list it was generated for
+  std::map<long, OutputXML> m_outputXML;
+  //! Tell GetXMLVersion() that the xml of this cell has changed
+  void XMLChanged() { m_xmlVersion = ++m_xmlVersionCounter; }
+  //! See GetXMLVersion()
+  long m_xmlVersion;
+  //! The last number XMLChanged() has handed out
+  static long m_xmlVersionCounter;
 };
 
 #endif /* GROUPCELL_H */
@@ -1,6 +1,69 @@
 #include "Image.h"
 #include <wx/mstream.h>
 #include <wx/wfstream.h>
+#include <string.h>
+
+void Image::SetCompressedImage(const wxMemoryBuffer &data)
+{
+  ReleaseCompressedImage();
+  m_compressedImage = ImageStore::Add(data);
+}
+
+void Image::ReleaseCompressedImage()
+{
+  ImageStore::Release(m_compressedImage);
+  // Copies of this image might share the old data with us.
+  m_compressedImage = wxMemoryBuffer();
+}
+
+size_t Image::SizeInMemory()
+{
+  size_t compressed = m_compressedImage.GetDataLen();
+  long users = ImageStore::GetUsers(m_compressedImage);
+  if (users > 1)
+    compressed /= users;
+  return sizeof(Image) + compressed +
+    m_scaledBitmap.GetWidth() * m_scaledBitmap.GetHeight() * 4;
+}
+
+Image::Image(const Image &image)
+{
+  m_compressedImage = image.m_compressedImage;
+  ImageStore::AddUser(m_compressedImage);
+  m_originalWidth  = image.m_originalWidth;
+  m_originalHeight = image.m_originalHeight;
+  m_scale          = image.m_scale;
+  m_viewportWidth  = image.m_viewportWidth;
+  m_viewportHeight = image.m_viewportHeight;
+  m_scaledBitmap   = image.m_scaledBitmap;
+  m_extension      = image.m_extension;
+  m_width          = image.m_width;
+  m_height         = image.m_height;
+}
+
+Image &Image::operator=(const Image &image)
+{
+  if (this == &image)
+    return *this;
+  ReleaseCompressedImage();
+  m_compressedImage = image.m_compressedImage;
+  ImageStore::AddUser(m_compressedImage);
+  m_originalWidth  = image.m_originalWidth;
+  m_originalHeight = image.m_originalHeight;
+  m_scale          = image.m_scale;
+  m_viewportWidth  = image.m_viewportWidth;
+  m_viewportHeight = image.m_viewportHeight;
+  m_scaledBitmap   = image.m_scaledBitmap;
+  m_extension      = image.m_extension;
+  m_width          = image.m_width;
+  m_height         = image.m_height;
+  return *this;
+}
+
+Image::~Image()
+{
+  ReleaseCompressedImage();
+}
 
 wxMemoryBuffer Image::ReadCompressedImage(wxInputStream *data)
 {
@@ -46,13 +109,13 @@ Image::Image(const wxBitmap &bitmap)
 }
 
 // constructor which loads an image
-Image::Image(wxString image,bool remove, wxFileSystem *filesystem)
+Image::Image(wxString image,bool remove, WXMXArchive *archive)
 {
   m_viewportWidth  = 640;
   m_viewportHeight = 480;
   m_scale          = 1;
   m_scaledBitmap.Create (1,1);
-  LoadImage(image,remove,filesystem);
+  LoadImage(image,remove,archive);
 }
 
 wxSize Image::ToImageFile(wxString filename)
@@ -164,8 +227,12 @@ void Image::LoadImage(const wxBitmap &bitmap)
   wxImage image = bitmap.ConvertToImage();
   wxMemoryOutputStream stream;
   image.SaveFile(stream,wxBITMAP_TYPE_PNG);
-  m_compressedImage.AppendData(stream.GetOutputStreamBuffer()->GetBufferStart(),
-			       stream.GetOutputStreamBuffer()->GetBufferSize());
+  // Only the bytes that have actually been written: Else two identical images
+  // might differ in the garbage that follows them.
+  wxMemoryBuffer data;
+  data.AppendData(stream.GetOutputStreamBuffer()->GetBufferStart(),
+                  stream.GetLength());
+  SetCompressedImage(data);
 
   // Set the info about the image.
   m_extension = wxT("png");
@@ -174,24 +241,15 @@ void Image::LoadImage(const wxBitmap &bitmap)
   m_scaledBitmap.Create (1,1);
 }
 
-void Image::LoadImage(wxString image, bool remove,wxFileSystem *filesystem)
+void Image::LoadImage(wxString image, bool remove,WXMXArchive *archive)
 {
-  m_compressedImage.Clear();
+  ReleaseCompressedImage();
   m_scaledBitmap.Create (1,1);
 
-  if (filesystem) {
-    wxFSFile *fsfile = filesystem->OpenFile(image);
-    if (fsfile) { // open successful
-
-      wxInputStream *istream = fsfile->GetStream();
-
-      m_compressedImage = ReadCompressedImage(istream);
-    }
-
-    // Closing and deleting fsfile is important: If this line is missing
-    // opening .wxmx files containing hundreds of images might lead to a
-    // "too many open files" error.
-    delete fsfile;
+  if (archive) {
+    wxMemoryBuffer data;
+    if (archive->ReadEntry(image, data))
+      SetCompressedImage(data);
   }
   else {
     wxFile file(image);
@@ -200,7 +258,7 @@ void Image::LoadImage(wxString image, bool remove,wxFileSystem *filesystem)
 	wxFileInputStream strm(file);
 	bool ok=strm.IsOk();
 	if(ok)
-	    m_compressedImage = ReadCompressedImage(&strm);
+	    SetCompressedImage(ReadCompressedImage(&strm));
 	
 	file.Close();
 	if(ok && remove)
@@ -208,28 +266,94 @@ void Image::LoadImage(wxString image, bool remove,wxFileSystem *filesystem)
       }
   }
 
-  wxImage Image;
-  if(m_compressedImage.GetDataLen()>0)
+  m_extension = wxFileName(image).GetExt();
+
+  // Decoding the whole image just in order to learn its size would be slow:
+  // The image will be decoded anyway as soon as it is drawn.
+  if(!ReadSizeFromHeader())
     {
-      wxMemoryInputStream istream(m_compressedImage.GetData(),m_compressedImage.GetDataLen());
-      Image.LoadFile(istream);
+      wxImage Image;
+      if(m_compressedImage.GetDataLen()>0)
+        {
+          wxMemoryInputStream istream(m_compressedImage.GetData(),m_compressedImage.GetDataLen());
+          Image.LoadFile(istream);
+        }
+      
+      if(Image.Ok())
+        {
+          m_originalWidth  = Image.GetWidth();
+          m_originalHeight = Image.GetHeight();
+        }
+      else
+        {
+          // Leave space for an image showing an error message
+          m_originalWidth  = 400;
+          m_originalHeight = 250;
+        }
     }
-  
-  m_extension = wxFileName(image).GetExt();
+  ViewportSize(m_viewportWidth,m_viewportHeight,m_scale);
 
-  if(Image.Ok())
+}
+
+bool Image::ReadSizeFromHeader()
+{
+  const unsigned char *data = (const unsigned char *) m_compressedImage.GetData();
+  size_t len = m_compressedImage.GetDataLen();
+
+  // png: The IHDR chunk that has to follow the signature contains the size.
+  if((len >= 24) && (memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) &&
+     (memcmp(data + 12, "IHDR", 4) == 0))
     {
-      m_originalWidth  = Image.GetWidth();
-      m_originalHeight = Image.GetHeight();
+      wxUint32 width  = ((wxUint32) data[16] << 24) | ((wxUint32) data[17] << 16) |
+        ((wxUint32) data[18] << 8) | (wxUint32) data[19];
+      wxUint32 height = ((wxUint32) data[20] << 24) | ((wxUint32) data[21] << 16) |
+        ((wxUint32) data[22] << 8) | (wxUint32) data[23];
+      // A header that claims a size no bitmap can have is most probably
+      // broken => let the decoder find out what the image really is.
+      if((width == 0) || (height == 0) ||
+         (width > m_maxHeaderSize) || (height > m_maxHeaderSize))
+        return false;
+      m_originalWidth  = width;
+      m_originalHeight = height;
+      return true;
     }
-  else
+
+  // gif: The logical screen descriptor directly follows the signature.
+  if((len >= 10) && (memcmp(data, "GIF8", 4) == 0))
     {
-      // Leave space for an image showing an error message
-      m_originalWidth  = 400;
-      m_originalHeight = 250;
+      m_originalWidth  = data[6] | (data[7] << 8);
+      m_originalHeight = data[8] | (data[9] << 8);
+      return (m_originalWidth > 0) && (m_originalHeight > 0);
     }
-  ViewportSize(m_viewportWidth,m_viewportHeight,m_scale);
 
+  // jpeg: Walk through the segments until we find a "start of frame" one.
+  if((len >= 4) && (data[0] == 0xFF) && (data[1] == 0xD8))
+    {
+      size_t pos = 2;
+      while(pos + 9 < len)
+        {
+          if(data[pos] != 0xFF)
+            return false;
+          unsigned char marker = data[pos + 1];
+          // Fill bytes
+          if(marker == 0xFF)
+            {
+              pos++;
+              continue;
+            }
+          // 0xC4, 0xC8 and 0xCC aren't SOF markers even if they look like one.
+          if((marker >= 0xC0) && (marker <= 0xCF) &&
+             (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC))
+            {
+              m_originalHeight = (data[pos + 5] << 8) | data[pos + 6];
+              m_originalWidth  = (data[pos + 7] << 8) | data[pos + 8];
+              return (m_originalWidth > 0) && (m_originalHeight > 0);
+            }
+          pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+        }
+    }
+  
+  return false;
 }
 
 void Image::ViewportSize(size_t viewPortWidth,size_t viewPortHeight,double scale)
@@ -23,6 +23,8 @@
 #define IMAGE_H
 
 #include "MathCell.h"
+#include "WXMXArchive.h"
+#include "ImageStore.h"
 #include <wx/image.h>
 
 #include <wx/filesys.h>
@@ -51,6 +53,15 @@
       to store them in their uncompressed form.
     - One could even delete the cached scaled images for all cells that currently 
       are off-screen in order to save memory.
+
+  Copying an Image is cheap: wxMemoryBuffer and wxBitmap are reference counted
+  so a copy shares the compressed and the scaled image with the original. The
+  data is never modified in place once it has been loaded.
+
+  Images that have been loaded or created separately but have the same contents
+  (plots that have been generated twice or the repeated frames of an animation)
+  share their compressed data, too: All compressed images are kept in the
+  ImageStore. This way they also are written to a .wxmx file only once.
  */
 class Image
 {
@@ -65,12 +76,14 @@ public:
   /*! A constructor that loads an image
 
     \param image The name of the file
-    \param filesystem The filesystem to load it from
-    \param viewport_xsize The width of the viewport the image is to be displayed in
-    \param viewport_ysize The height of the viewport the image is to be displayed in
+    \param archive The .wxmx archive to load it from or NULL, if it is a file
     \param remove true = Delete the file after loading it
    */
-  Image(wxString image,bool remove = true, wxFileSystem *filesystem = NULL);
+  Image(wxString image,bool remove = true, WXMXArchive *archive = NULL);
+  //! A copy shares the compressed image with the original
+  Image(const Image &image);
+  ~Image();
+  Image &operator=(const Image &image);
   /*! Temporarily forget the scaled image in order to save memory
 
     Will recreate the scaled image as soon as needed.
@@ -80,8 +93,12 @@ public:
   wxMemoryBuffer ReadCompressedImage(wxInputStream *data);
   //! Returns the file name extension of the current image
   wxString GetExtension() {return m_extension;};
-  //! Loads an image from a file
-  void LoadImage(wxString image,bool remove = true, wxFileSystem *filesystem = NULL);
+  /*! Loads an image from a file
+
+    Only the compressed image is read here. It is decoded only once it is drawn
+    for the first time.
+   */
+  void LoadImage(wxString image,bool remove = true, WXMXArchive *archive = NULL);
   //! "Loads" an image from a bitmap
   void LoadImage(const wxBitmap &bitmap);
   //! Saves the image in its original form, or as .png if it originates in a bitmap
@@ -96,12 +113,36 @@ public:
   size_t m_width;
   //! The height of the scaled image
   size_t m_height;
-  //! Returns the original image in its compressed form
+  /*! Returns the original image in its compressed form
+
+    wxMemoryBuffer is reference counted, so this doesn't copy the data.
+   */
   wxMemoryBuffer GetCompressedImage(){return m_compressedImage;}
+  /*! The number of bytes the compressed and the scaled image occupy in memory
+
+    The compressed image is shared between all images with the same contents
+    => Each of them is accounted for its share only.
+   */
+  size_t SizeInMemory();
   size_t GetOriginalWidth(){return m_originalWidth;}
   size_t GetOriginalHeight(){return m_originalHeight;}
 
 protected:
+  /*! Read the size of the unscaled image from the header of m_compressedImage
+
+    This is much faster than decoding the whole image. Knows about png, jpeg
+    and gif images.
+
+    \return false, if the size could not be determined this way.
+   */
+  bool ReadSizeFromHeader();
+  /*! The biggest width or height ReadSizeFromHeader() accepts from a png header
+
+    png allows sizes up to 2^31-1, but the sizes are handled as int in the
+    layout and a bitmap that big couldn't be created anyway. gif and jpeg
+    headers cannot describe bigger images than this.
+   */
+  static const wxUint32 m_maxHeaderSize = 65535;
   //! The width of the unscaled image
   size_t m_originalWidth;
   //! The height of the unscaled image
@@ -118,6 +159,15 @@ protected:
   wxBitmap m_scaledBitmap;
   //! The file extension for the current image type
   wxString m_extension;
+private:
+  /*! Make data our compressed image
+
+    If the store already contains an image with the same contents we use that
+    one instead.
+   */
+  void SetCompressedImage(const wxMemoryBuffer &data);
+  //! Stop using m_compressedImage and remove it from the store if no image uses it any more
+  void ReleaseCompressedImage();
 };
 
 #endif // IMAGE_H
@@ -0,0 +1,116 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "ImageStore.h"
+
+#include <string.h>
+
+std::map<const void *, ImageStore::StoredImage> ImageStore::s_images;
+std::multimap<wxUint64, const void *> ImageStore::s_hashes;
+
+wxUint64 ImageStore::Hash(const wxMemoryBuffer &data)
+{
+  // FNV-1a: Fast and good enough as images with the same hash are compared
+  // byte by byte before they are treated as identical.
+  const unsigned char *bytes = (const unsigned char *) data.GetData();
+  wxUint64 hash = wxULL(14695981039346656037);
+  for (size_t i = 0; i < data.GetDataLen(); i++)
+  {
+    hash ^= bytes[i];
+    hash *= wxULL(1099511628211);
+  }
+  return hash;
+}
+
+wxMemoryBuffer ImageStore::Add(const wxMemoryBuffer &data)
+{
+  if (data.GetDataLen() == 0)
+    return data;
+
+  wxUint64 hash = Hash(data);
+  std::pair<std::multimap<wxUint64, const void *>::iterator,
+            std::multimap<wxUint64, const void *>::iterator> candidates =
+    s_hashes.equal_range(hash);
+  for (std::multimap<wxUint64, const void *>::iterator it = candidates.first;
+       it != candidates.second; ++it)
+  {
+    StoredImage &stored = s_images[it->second];
+    if ((stored.m_data.GetDataLen() == data.GetDataLen()) &&
+        (memcmp(stored.m_data.GetData(), data.GetData(), data.GetDataLen()) == 0))
+    {
+      stored.m_users++;
+      return stored.m_data;
+    }
+  }
+
+  // data might already be in the store if it has been modified in place
+  // since it has been added, which mustn't happen.
+  wxASSERT_MSG(s_images.find(data.GetData()) == s_images.end(),
+               _("Bug: Image data has been modified after being added to the image store"));
+  StoredImage stored;
+  stored.m_data = data;
+  stored.m_hash = hash;
+  stored.m_users = 1;
+  s_images[data.GetData()] = stored;
+  s_hashes.insert(std::make_pair(hash, data.GetData()));
+  return data;
+}
+
+void ImageStore::AddUser(const wxMemoryBuffer &data)
+{
+  if (data.GetDataLen() == 0)
+    return;
+  std::map<const void *, StoredImage>::iterator it = s_images.find(data.GetData());
+  wxASSERT_MSG(it != s_images.end(), _("Bug: Image data that isn't in the image store"));
+  if (it != s_images.end())
+    it->second.m_users++;
+}
+
+void ImageStore::Release(const wxMemoryBuffer &data)
+{
+  if (data.GetDataLen() == 0)
+    return;
+  std::map<const void *, StoredImage>::iterator it = s_images.find(data.GetData());
+  wxASSERT_MSG(it != s_images.end(), _("Bug: Image data that isn't in the image store"));
+  if ((it == s_images.end()) || (--it->second.m_users > 0))
+    return;
+
+  std::pair<std::multimap<wxUint64, const void *>::iterator,
+            std::multimap<wxUint64, const void *>::iterator> candidates =
+    s_hashes.equal_range(it->second.m_hash);
+  for (std::multimap<wxUint64, const void *>::iterator hash = candidates.first;
+       hash != candidates.second; ++hash)
+    if (hash->second == it->first)
+    {
+      s_hashes.erase(hash);
+      break;
+    }
+  s_images.erase(it);
+}
+
+long ImageStore::GetUsers(const wxMemoryBuffer &data)
+{
+  if (data.GetDataLen() == 0)
+    return 0;
+  std::map<const void *, StoredImage>::iterator it = s_images.find(data.GetData());
+  if (it == s_images.end())
+    return 0;
+  return it->second.m_users;
+}
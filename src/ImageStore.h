@@ -0,0 +1,72 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef IMAGESTORE_H
+#define IMAGESTORE_H
+
+#include <wx/wx.h>
+#include <wx/buffer.h>
+
+#include <map>
+
+/*! All compressed images that are in use, indexed by a hash of their contents
+
+  Images that have been loaded or created separately but have the same
+  contents share their data this way. The store counts the users of each
+  image and forgets the image as soon as the last user has released it.
+ */
+class ImageStore
+{
+public:
+  /*! Add an image to the store
+
+    \return The data of the image with the same contents the store already
+    contains or data, if there is none. The caller is a user of the returned
+    data and has to Release() it.
+   */
+  static wxMemoryBuffer Add(const wxMemoryBuffer &data);
+  //! Register one more user of data, which Add() has returned
+  static void AddUser(const wxMemoryBuffer &data);
+  //! Unregister a user of data and forget data if it has no users left
+  static void Release(const wxMemoryBuffer &data);
+  //! The number of users of data or 0, if it isn't in the store
+  static long GetUsers(const wxMemoryBuffer &data);
+  //! The number of different images the store contains
+  static size_t GetCount() { return s_images.size(); }
+private:
+  //! An image in the store
+  struct StoredImage
+  {
+    //! The compressed image
+    wxMemoryBuffer m_data;
+    //! The hash of m_data
+    wxUint64 m_hash;
+    //! The number of users of m_data
+    long m_users;
+  };
+  //! A hash of the contents of a compressed image
+  static wxUint64 Hash(const wxMemoryBuffer &data);
+  //! All images in the store by the address of their data
+  static std::map<const void *, StoredImage> s_images;
+  //! The addresses of the data of all images in the store by their hash
+  static std::multimap<wxUint64, const void *> s_hashes;
+};
+
+#endif // IMAGESTORE_H
@@ -23,8 +23,6 @@
 
 #include <wx/file.h>
 #include <wx/filename.h>
-#include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <wx/clipbrd.h>
 
 ImgCell::ImgCell() : MathCell()
@@ -44,15 +42,13 @@ ImgCell::ImgCell(const wxBitmap &bitmap) : MathCell()
   m_imageBorderWidth = 1;
 }
 
-int ImgCell::s_counter = 0;
-
 // constructor which load image
-ImgCell::ImgCell(wxString image, bool remove, wxFileSystem *filesystem) : MathCell()
+ImgCell::ImgCell(wxString image, bool remove, WXMXArchive *archive) : MathCell()
 {
   m_type = MC_TYPE_IMAGE;
   m_drawRectangle = true;
   if(image != wxEmptyString)
-    m_image = new Image(image,remove,filesystem);
+    m_image = new Image(image,remove,archive);
   else
     m_image = new Image();
 }
@@ -83,9 +79,8 @@ MathCell* ImgCell::Copy()
   CopyData(this, tmp);
   tmp->m_drawRectangle = m_drawRectangle;
 
-  Image *img = new Image();
-  *img = *m_image;
-  tmp->m_image = img;
+  // The copy shares the compressed image data with us, see Image.
+  tmp->m_image = new Image(*m_image);
   
   return tmp;
 }
@@ -172,28 +167,10 @@ wxSize ImgCell::ToImageFile(wxString file)
   return m_image->ToImageFile(file);
 }
 
-wxString ImgCell::ToXML()
+wxString ImgCell::ToXML(WXMXImageList &images)
 {
-  wxString basename = ImgCell::WXMXGetNewFileName();
-
-  // add the file to memory
-  if(m_image)
-  {
-    if(m_image->GetCompressedImage())
-      wxMemoryFSHandler::AddFile(basename+m_image -> GetExtension(),
-                                 m_image->GetCompressedImage().GetData(),
-                                 m_image->GetCompressedImage().GetDataLen()
-        );
-  }
   return (m_drawRectangle ? wxT("<img>") : wxT("<img rect=\"false\">")) +
-    basename + m_image -> GetExtension()+ wxT("</img>");
-}
-
-wxString ImgCell::WXMXGetNewFileName()
-{
-   wxString file(wxT("image"));
-   file << (++s_counter) << wxT(".");
-   return file;
+    images.Add(m_image) + wxT("</img>");
 }
 
 bool ImgCell::CopyToClipboard()
@@ -26,14 +26,14 @@
 #include <wx/image.h>
 #include <Image.h>
 
-#include <wx/filesys.h>
-#include <wx/fs_arc.h>
+#include "WXMXArchive.h"
+#include "WXMXImageList.h"
 
 class ImgCell : public MathCell
 {
 public:
   ImgCell();
-  ImgCell(wxString image, bool remove = true, wxFileSystem *filesystem = NULL);
+  ImgCell(wxString image, bool remove = true, WXMXArchive *archive = NULL);
   ImgCell(const wxBitmap &bitmap);
   ~ImgCell();
   void Destroy();
@@ -59,15 +59,11 @@ public:
     needed.
    */
   virtual void ClearCache(){if(m_image)m_image->ClearCache();}
+  size_t SizeInMemory(){return sizeof(ImgCell) + (m_image ? m_image->SizeInMemory() : 0);}
   //! Sets the bitmap that is shown
   void SetBitmap(const wxBitmap &bitmap);
   //! Copies the cell to the system's clipboard
   bool CopyToClipboard();
-  // These methods should only be used for saving wxmx files
-  // and are shared with SlideShowCell.
-  static void WXMXResetCounter() { s_counter = 0; }
-  static wxString WXMXGetNewFileName();
-  static int WXMXImageCount() { return s_counter; }
   void DrawRectangle(bool draw) { m_drawRectangle = draw; }
   //! Returns the file name extension that matches the image type
   wxString GetExtension(){if(m_image)return m_image->GetExtension(); else return wxEmptyString;}
@@ -78,8 +74,7 @@ protected:
   void Draw(CellParser& parser, wxPoint point, int fontsize);
   wxString ToString();
   wxString ToTeX();
-  wxString ToXML();
-	static int s_counter;
+  wxString ToXML(WXMXImageList &images);
 	bool m_drawRectangle;
   virtual void DrawBoundingBox(wxDC& dc, bool all = false)
     {
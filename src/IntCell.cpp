@@ -440,26 +440,26 @@ wxString IntCell::ToMathML()
   return(wxT("<mrow>") + retval + wxT("</mrow>"));
 }
 
-wxString IntCell::ToXML()
+wxString IntCell::ToXML(WXMXImageList &images)
 {
   wxString from;
   if(m_under != NULL)
-    from = m_under->ListToXML();
+    from = m_under->ListToXML(images);
   from = wxT("<r>")+from+wxT("</r>");
 
   wxString to;
   if(m_over != NULL)
-    to = m_over->ListToXML();
+    to = m_over->ListToXML(images);
   to = wxT("<r>")+to+wxT("</r>");
 
   wxString base;
   if(m_base != NULL)
-    base = m_base->ListToXML();
+    base = m_base->ListToXML(images);
   base = wxT("<r>")+base+wxT("</r>");
 
   wxString var;
   if(m_var != NULL)
-    var = m_var->ListToXML();
+    var = m_var->ListToXML(images);
   var = wxT("<r>")+var+wxT("</r>");
 
   if (m_intStyle == INT_DEF)
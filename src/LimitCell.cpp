@@ -199,11 +199,11 @@ wxString LimitCell::ToMathML()
   return(retval);
 }
 
-wxString LimitCell::ToXML()
+wxString LimitCell::ToXML(WXMXImageList &images)
 {
-  return _T("<lm><r>") + m_name->ListToXML() + _T("</r><r>") +
-    m_under->ListToXML() + _T("</r><r>") +
-    m_base->ListToXML() + _T("</r></lm>");
+  return _T("<lm><r>") + m_name->ListToXML(images) + _T("</r><r>") +
+    m_under->ListToXML(images) + _T("</r><r>") +
+    m_base->ListToXML(images) + _T("</r></lm>");
 }
 
 void LimitCell::SelectInner(wxRect& rect, MathCell** first, MathCell** last)
@@ -39,7 +39,7 @@ public:
   void SetName(MathCell* name);
   wxString ToString();
   wxString ToTeX();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   wxString ToMathML();
   void SelectInner(wxRect& rect, MathCell** first, MathCell** last);
   void SetParent(MathCell *parent);
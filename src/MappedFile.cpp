@@ -0,0 +1,127 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "MappedFile.h"
+
+#include <wx/ffile.h>
+
+#if defined __WXMSW__
+#include <wx/msw/wrapwin.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(wxString file)
+{
+  m_data = NULL;
+  m_size = 0;
+  m_ok = false;
+  m_mapped = false;
+#if defined __WXMSW__
+  m_mapping = NULL;
+
+  HANDLE handle = ::CreateFile(file.t_str(), GENERIC_READ, FILE_SHARE_READ,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (handle != INVALID_HANDLE_VALUE)
+  {
+    LARGE_INTEGER size;
+    if (::GetFileSizeEx(handle, &size) && (size.QuadPart > 0) &&
+        (wxUint64(size.QuadPart) <= wxUint64(size_t(-1))))
+    {
+      m_mapping = ::CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (m_mapping != NULL)
+      {
+        m_data = (const char *) ::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (m_data != NULL)
+        {
+          m_size = size_t(size.QuadPart);
+          m_mapped = true;
+        }
+        else
+        {
+          ::CloseHandle(m_mapping);
+          m_mapping = NULL;
+        }
+      }
+    }
+    // The mapping keeps the file open by itself.
+    ::CloseHandle(handle);
+  }
+#else
+  int fd = open(file.fn_str(), O_RDONLY);
+  if (fd >= 0)
+  {
+    struct stat info;
+    if ((fstat(fd, &info) == 0) && (info.st_size > 0) &&
+        (wxUint64(info.st_size) <= wxUint64(size_t(-1))))
+    {
+      void *data = mmap(NULL, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+      if (data != MAP_FAILED)
+      {
+        m_data = (const char *) data;
+        m_size = size_t(info.st_size);
+        m_mapped = true;
+      }
+    }
+    // The mapping keeps the file open by itself.
+    close(fd);
+  }
+#endif
+
+  if (m_mapped)
+  {
+    m_ok = true;
+    return;
+  }
+
+  // Empty files cannot be mapped and some file systems don't support mapping
+  // at all => Read the file instead.
+  wxLogNull logNull;
+  wxFFile input(file, wxT("rb"));
+  if (!input.IsOpened())
+    return;
+  wxFileOffset length = input.Length();
+  if (length < 0)
+    return;
+  size_t read = input.Read(m_buffer.GetWriteBuf(length), length);
+  m_buffer.UngetWriteBuf(read);
+  if (read != size_t(length))
+    return;
+  m_data = (const char *) m_buffer.GetData();
+  m_size = m_buffer.GetDataLen();
+  m_ok = true;
+}
+
+MappedFile::~MappedFile()
+{
+  if (!m_mapped)
+    return;
+#if defined __WXMSW__
+  ::UnmapViewOfFile(m_data);
+  ::CloseHandle(m_mapping);
+#else
+  munmap((void *) m_data, m_size);
+#endif
+}
@@ -0,0 +1,63 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <wx/wx.h>
+#include <wx/buffer.h>
+
+/*! Read-only access to the contents of a file without copying them
+
+  The file is mapped into memory so the operating system reads only the parts
+  of the file that are actually accessed, directly from its page cache. If the
+  file cannot be mapped it is read into memory instead.
+ */
+class MappedFile
+{
+public:
+  //! Map the file
+  MappedFile(wxString file);
+  ~MappedFile();
+  //! Could the file be opened?
+  bool IsOk() { return m_ok; }
+  //! The contents of the file
+  const char *GetData() { return m_data; }
+  //! The size of the file in bytes
+  size_t GetSize() { return m_size; }
+private:
+  //! The contents of the file
+  const char *m_data;
+  //! The size of the file in bytes
+  size_t m_size;
+  //! Could the file be opened?
+  bool m_ok;
+  //! Is m_data mapped (true) or does it point to m_buffer (false)?
+  bool m_mapped;
+  //! The contents of the file if it couldn't be mapped
+  wxMemoryBuffer m_buffer;
+#if defined __WXMSW__
+  //! The file mapping
+  void *m_mapping;
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -126,6 +126,19 @@ void MathCell::ClearCacheList()
   }
 }
 
+size_t MathCell::SizeInMemoryList()
+{
+  size_t size = 0;
+  MathCell *tmp = this;
+  
+  while(tmp != NULL)
+  {
+    size += tmp->SizeInMemory();
+    tmp = tmp->m_next;
+  }
+  return size;
+}
+
 void MathCell::SetParentList(MathCell *parent)
 {
   MathCell *tmp=this;
@@ -176,23 +189,65 @@ MathCell* MathCell::GetParent()
   return m_group;
 }
 
+/*! Collect the cells of the line this cell is part of
+
+  Walks backwards along the drawing order to the beginning of the line and then 
+  forward to its end. What a "line" is differs slightly between the metrics we
+  cache which is why the caller has to tell us where a line begins.
+
+  \param line The vector the cells are appended to, in drawing order.
+  \param startsLine Returns true, if the line ends before the cell it is given.
+ */
+void MathCell::GetLineCells(std::vector<MathCell *> &line, bool (*startsLine)(MathCell *))
+{
+  MathCell *first = this;
+  while((!startsLine(first)) &&
+        (first->m_previousToDraw != NULL) &&
+        (first->m_previousToDraw->m_nextToDraw == first))
+    first = first->m_previousToDraw;
+
+  MathCell *tmp = first;
+  while(tmp != NULL)
+  {
+    line.push_back(tmp);
+    tmp = tmp->m_nextToDraw;
+    if((tmp != NULL) && startsLine(tmp))
+      break;
+  }
+}
+
+bool MathCell::StartsCenterLine(MathCell *cell)
+{
+  return cell->m_breakLine;
+}
+
+bool MathCell::StartsDropLine(MathCell *cell)
+{
+  return cell->m_breakLine && !cell->m_isBroken;
+}
+
+bool MathCell::StartsWidthLine(MathCell *cell)
+{
+  return cell->m_breakLine || (cell->m_type == MC_TYPE_MAIN_PROMPT);
+}
+
 /***
  * Get the maximum drop of the center.
 
+ The value is calculated for the whole line at once so every other cell of the 
+ line can answer this question without scanning the line again.
  */
 int MathCell::GetMaxCenter()
 {
   if (m_maxCenter < 0)
   {
-    MathCell *tmp = this;
-    while(tmp != NULL)
+    std::vector<MathCell *> line;
+    GetLineCells(line, StartsCenterLine);
+    int maxCenter = -1;
+    for(std::vector<MathCell *>::reverse_iterator it = line.rbegin(); it != line.rend(); ++it)
     {
-      m_maxCenter = MAX(m_maxCenter, tmp->m_center);
-      if(tmp->m_nextToDraw == NULL)
-        break;
-      if(tmp->m_nextToDraw->m_breakLine)
-        break;
-      tmp = tmp-> m_nextToDraw;
+      maxCenter = MAX(maxCenter, (*it)->m_center);
+      (*it)->m_maxCenter = maxCenter;
     }
   }
   return m_maxCenter;
@@ -201,22 +256,20 @@ int MathCell::GetMaxCenter()
 /***
  * Get the maximum drop of cell.
 
-\todo Convert this function to not using recursive function calls any more.
+ The value is calculated for the whole line at once so every other cell of the 
+ line can answer this question without scanning the line again.
  */
 int MathCell::GetMaxDrop()
 {
-
   if (m_maxDrop < 0)
   {
-    MathCell *tmp = this;
-    while(tmp != NULL)
+    std::vector<MathCell *> line;
+    GetLineCells(line, StartsDropLine);
+    int maxDrop = -1;
+    for(std::vector<MathCell *>::reverse_iterator it = line.rbegin(); it != line.rend(); ++it)
     {
-      m_maxDrop = MAX(m_maxDrop, tmp->m_isBroken ? 0 : (tmp->m_height - tmp->m_center));
-      if(tmp->m_nextToDraw == NULL)
-        break;
-      if(tmp->m_nextToDraw->m_breakLine && !tmp->m_nextToDraw->m_isBroken)
-        break;
-      tmp = tmp-> m_nextToDraw;
+      maxDrop = MAX(maxDrop, (*it)->m_isBroken ? 0 : ((*it)->m_height - (*it)->m_center));
+      (*it)->m_maxDrop = maxDrop;
     }
   }
   return m_maxDrop;
@@ -252,21 +305,27 @@ int MathCell::GetFullWidth(double scale)
   return m_fullWidth;
 }
 
-/*! Get the width of this line.
+/*! Get the width of the rest of this line.
 
-\todo Convert this function to not using recursive function calls any more.
+  The widths of the rest of the line are calculated for every cell of the line
+  in a single backwards pass.
  */
 int MathCell::GetLineWidth(double scale)
 {
-  int width = m_isBroken ? 0 : m_width;
   if (m_lineWidth == -1)
   {
-    if (m_nextToDraw == NULL || m_nextToDraw->m_breakLine ||
-        m_nextToDraw->m_type == MC_TYPE_MAIN_PROMPT)
-      m_lineWidth = width;
-    else
-      m_lineWidth = width + m_nextToDraw->GetLineWidth(scale) +
-                    SCALE_PX(MC_CELL_SKIP, scale);
+    std::vector<MathCell *> line;
+    GetLineCells(line, StartsWidthLine);
+    int lineWidth = 0;
+    for(std::vector<MathCell *>::reverse_iterator it = line.rbegin(); it != line.rend(); ++it)
+    {
+      int width = (*it)->m_isBroken ? 0 : (*it)->m_width;
+      if(it == line.rbegin())
+        lineWidth = width;
+      else
+        lineWidth += width + SCALE_PX(MC_CELL_SKIP, scale);
+      (*it)->m_lineWidth = lineWidth;
+    }
   }
   return m_lineWidth;
 }
@@ -481,7 +540,7 @@ wxString MathCell::ListToTeX()
   return retval;
 }
 
-wxString MathCell::ToXML()
+wxString MathCell::ToXML(WXMXImageList &images)
 {
   return wxEmptyString;
 }
@@ -556,7 +615,7 @@ wxString MathCell::ListToMathML(bool startofline)
   return retval;
 }
 
-wxString MathCell::ListToXML()
+wxString MathCell::ListToXML(WXMXImageList &images)
 {
   bool highlight=false;
   
@@ -577,7 +636,7 @@ wxString MathCell::ListToXML()
       highlight=false;
     }
     
-    retval+=tmp->ToXML();
+    retval+=tmp->ToXML(images);
     tmp=tmp->m_next;
   }
   
@@ -589,6 +648,23 @@ wxString MathCell::ListToXML()
   return retval;
 }
 
+wxString MathCell::ToWXMX(WXMXImageList &images)
+{
+  wxString xmlText = ToXML(images);
+  // Delete all but one control character from the string.
+  for(wxString::iterator it = xmlText.begin(); it != xmlText.end(); ++it)
+  {
+    wxChar c = *it;
+
+    if(( c <  wxT('\t')) ||
+       ((c >  wxT('\n')) &&(c < wxT(' '))) ||
+       ( c == wxChar((char)0x7F))
+      )
+      *it = wxT(' ');
+  }
+  return xmlText;
+}
+
 /***
  * Get the part for diff tag support - only ExpTag overvrides this.
  */
@@ -55,9 +55,12 @@
 #endif
 
 #include <wx/wx.h>
+#include <vector>
 #include "CellParser.h"
 #include "TextStyle.h"
 
+class WXMXImageList;
+
 /*! The size of a scroll step
 
   Defines the size of a scroll step, but besides that also the accuracy wxScrolledCanvas
@@ -193,6 +196,20 @@ public:
    */
   void ClearCacheList();
 
+  /*! The number of bytes this cell occupies in memory
+
+    This is only an estimate that is used for limiting the size of the undo
+    buffer: Cells that hold big amounts of data (text, images) add the size of
+    this data to their own size.
+   */
+  virtual size_t SizeInMemory() { return sizeof(MathCell); }
+
+  /*! The number of bytes the list of cells starting with this one occupies in memory
+
+    For details see SizeInMemory().
+   */
+  size_t SizeInMemoryList();
+
   /*! Draw this cell
 
     \param point The x and y position this cell is drawn at
@@ -253,6 +270,9 @@ public:
   int GetType() { return m_type; }
   /*! Returns the maximum distance between center and bottom of this line
 
+    The result is cached for every cell of the line at once so asking every cell
+    of a line for it costs O(1) per cell after the first query.
+
     Note that the center doesn't need to be exactly in the middle of an object.
     For a fraction for example the center is exactly at the middle of the 
     horizontal line.
@@ -260,6 +280,9 @@ public:
   int GetMaxDrop();
   /*! Returns the maximum distance between top and center of this line
 
+    The result is cached for every cell of the line at once so asking every cell
+    of a line for it costs O(1) per cell after the first query.
+
     Note that the center doesn't need to be exactly in the middle of an object.
     For a fraction for example the center is exactly at the middle of the 
     horizontal line.
@@ -357,16 +380,27 @@ public:
   virtual wxString ListToString();
   //! Convert this list to its LaTeX representation
   virtual wxString ListToTeX();
-  //! Convert this list to an representation fit for saving in a .wxmx file
-  virtual wxString ListToXML();
+  /*! Convert this list to an representation fit for saving in a .wxmx file
+
+    \param images The list of the images of the .wxmx file that is written.
+    Image cells add their images to it and refer to them by the name it
+    assigns them.
+   */
+  virtual wxString ListToXML(WXMXImageList &images);
   //! Convert this list to an representation fit for saving in a .wxmx file
   virtual wxString ListToMathML(bool startofline = false);
   //! Returns the cell's representation as a string.
   virtual wxString ToString();
   //! Convert this cell to its LaTeX representation
   virtual wxString ToTeX();
-  //! Convert this cell to an representation fit for saving in a .wxmx file
-  virtual wxString ToXML();
+  //! Convert this cell to an representation fit for saving in a .wxmx file. See ListToXML().
+  virtual wxString ToXML(WXMXImageList &images);
+  /*! ToXML() without the control characters xml doesn't allow
+
+    There should be no way for them to enter a cell, anyway. But sometimes they
+    still do...
+  */
+  wxString ToWXMX(WXMXImageList &images);
   //! Convert this cell to an representation fit for saving in a .wxmx file
   virtual wxString ToMathML();
   //! The height of this cell
@@ -516,6 +550,23 @@ public:
 protected:
   static wxRect m_updateRegion;
 
+  /*! Collect all cells of the line this cell is part of in drawing order
+
+    Used for calculating the line metrics (GetMaxCenter(), GetMaxDrop() and 
+    GetLineWidth()) for a whole line in a single pass.
+
+    \param line The vector the cells are appended to.
+    \param startsLine A function that returns true if a new line starts with the cell
+    it is given.
+   */
+  void GetLineCells(std::vector<MathCell *> &line, bool (*startsLine)(MathCell *));
+  //! Where does a line end for the purpose of GetMaxCenter()?
+  static bool StartsCenterLine(MathCell *cell);
+  //! Where does a line end for the purpose of GetMaxDrop()?
+  static bool StartsDropLine(MathCell *cell);
+  //! Where does a line end for the purpose of GetLineWidth()?
+  static bool StartsWidthLine(MathCell *cell);
+
   /*! The GroupCell this list of cells belongs to.
     
     Reads NULL, if no parent cell has been set - which is treated as an Error by GetParent():
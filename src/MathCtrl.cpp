@@ -45,11 +45,15 @@
 #include <wx/zipstrm.h>
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
-#include <wx/filesys.h>
-#include <wx/fs_mem.h>
 
 #define CARET_TIMER_TIMEOUT 500
 #define ANIMATION_TIMER_TIMEOUT 300
+//! How long the window size has to be stable before we re-break the worksheet's lines
+#define RESIZE_TIMER_TIMEOUT 150
+//! How many cells are laid out per idle event
+#define IDLE_LAYOUT_CHUNK 10
+//! How long the zoom factor has to be stable before we lay out the worksheet anew
+#define ZOOM_TIMER_TIMEOUT 250
 
 MathCtrl::MathCtrl(wxWindow* parent, int id, wxPoint position, wxSize size) :
 wxScrolledCanvas(
@@ -78,6 +82,7 @@ wxScrolledCanvas(
   m_tree = NULL;
   m_mainToolBar = NULL;
   m_memory = NULL;
+  m_scrollMemory = NULL;
   m_selectionStart = NULL;
   m_selectionEnd = NULL;
   m_clickType = CLICK_TYPE_NONE;
@@ -95,11 +100,27 @@ wxScrolledCanvas(
   m_timer.SetOwner(this, TIMER_ID);
   m_caretTimer.SetOwner(this, CARET_TIMER_ID);
   m_animationTimer.SetOwner(this, ANIMATION_TIMER_ID);
+  m_resizeTimer.SetOwner(this, RESIZE_TIMER_ID);
+  m_layoutPending = false;
+  m_zoomTimer.SetOwner(this, ZOOM_TIMER_ID);
   AnimationRunning(false);
   m_saved = false;
   wxConfig *config = (wxConfig *)wxConfig::Get();
   m_zoomFactor = 1.0; // Let the zoom factor default to 100%
   config->Read(wxT("ZoomFactor"),&m_zoomFactor);
+  m_layoutZoomFactor = m_zoomFactor;
+  // The number of megabytes the bitmaps of cells drawn recently may occupy
+  int surfaceCacheSize = 32;
+  config->Read(wxT("surfaceCacheSize"), &surfaceCacheSize);
+  GroupCell::SetSurfaceCacheBudget(long(MAX(surfaceCacheSize, 0)) * 1024 * 1024);
+  // The number of kilobytes the undo history of a cell and the number of
+  // megabytes the undo histories of all cells may occupy
+  int cellUndoHistorySize = 1024;
+  int undoHistorySize = 16;
+  config->Read(wxT("cellUndoHistorySize"), &cellUndoHistorySize);
+  config->Read(wxT("undoHistorySize"), &undoHistorySize);
+  EditorCell::SetUndoBudget(long(MAX(cellUndoHistorySize, 0)) * 1024,
+                            long(MAX(undoHistorySize, 0)) * 1024 * 1024);
   m_evaluationQueue = new EvaluationQueue();
   AdjustSize();
   m_autocompleteTemplates = false;
@@ -123,6 +144,8 @@ MathCtrl::~MathCtrl() {
     DestroyTree();
   if (m_memory != NULL)
     delete m_memory;
+  if (m_scrollMemory != NULL)
+    delete m_scrollMemory;
 
   delete m_evaluationQueue;
   wxConfig *config = (wxConfig *)wxConfig::Get();
@@ -141,6 +164,15 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
   wxPaintDC dc(this);
   wxMemoryDC dcm;
 
+  // Cells that only know an estimate of their size have to be laid out before
+  // they can be drawn. If this moves the part of the worksheet we look at we
+  // have to draw everything anew.
+  if (LayOutEstimatedCellsInView())
+  {
+    Refresh();
+    return;
+  }
+
   // Get the font size
   wxConfig *config = (wxConfig *)wxConfig::Get();
 
@@ -148,16 +180,6 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
   wxRect rect = GetUpdateRegion().GetBox();
   // printf("Updating rect [%d, %d] -> [%d, %d]\n", rect.x, rect.y, rect.width, rect.height);
   wxSize sz = GetSize();
-  int xstart, xend, top, bottom, drop;
-  CalcUnscrolledPosition(rect.GetLeft(), rect.GetTop(), &xstart, &top);
-  CalcUnscrolledPosition(rect.GetRight(), rect.GetBottom(), &xend, &bottom);
-  wxRect updateRegion;
-  updateRegion.SetLeft(xstart);
-  updateRegion.SetRight(xend);
-  updateRegion.SetTop(top);
-  updateRegion.SetBottom(bottom);
-  MathCell::SetUpdateRegion(updateRegion);
-
   if(sz.x == 0) sz.x=1;
   if(sz.y == 0) sz.y=1;
   
@@ -165,7 +187,44 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
   if (m_memory == NULL) {
     m_memory = new wxBitmap();
     m_memory->CreateScaled (sz.x, sz.y, -1, dc.GetContentScaleFactor ());
+    m_memoryDirty = wxRegion(0, 0, sz.x, sz.y);
+  }
+
+  // Only the parts of m_memory that are outdated are drawn anew. After
+  // scrolling this is only the strip that has been scrolled into view.
+  m_memoryDirty.Intersect(wxRect(0, 0, sz.x, sz.y));
+  wxRect drawRect = m_memoryDirty.GetBox();
+  m_memoryDirty.Clear();
+  if (drawRect.IsEmpty())
+  {
+    dcm.SelectObject(*m_memory);
+    dc.Blit(0, rect.GetTop(), sz.x, rect.GetBottom() - rect.GetTop() + 1, &dcm,
+            0, rect.GetTop());
+    return;
   }
+
+  int xstart, xend, top, bottom, drop;
+  CalcUnscrolledPosition(drawRect.GetLeft(), drawRect.GetTop(), &xstart, &top);
+  CalcUnscrolledPosition(drawRect.GetRight(), drawRect.GetBottom(), &xend, &bottom);
+  // The part of the worksheet that is visible
+  int viewTop, viewBottom;
+  CalcUnscrolledPosition(0, 0, &virtualsize_x, &viewTop);
+  viewBottom = viewTop + GetClientSize().GetHeight();
+  // While the user is zooming we draw the existing layout scaled.
+  double displayScale = DisplayScale();
+  xstart /= displayScale;
+  xend   /= displayScale;
+  top    /= displayScale;
+  bottom /= displayScale;
+  viewTop    /= displayScale;
+  viewBottom /= displayScale;
+  wxRect updateRegion;
+  updateRegion.SetLeft(xstart);
+  updateRegion.SetRight(xend);
+  updateRegion.SetTop(top);
+  updateRegion.SetBottom(bottom);
+  MathCell::SetUpdateRegion(updateRegion);
+
   // Prepare memory DC
   wxString bgColStr= wxT("white");
   config->Read(wxT("Style/Background/color"), &bgColStr);
@@ -173,15 +232,20 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
 
   dcm.SelectObject(*m_memory);
   dcm.SetBackground(*(wxTheBrushList->FindOrCreateBrush(GetBackgroundColour(), wxBRUSHSTYLE_SOLID)));
-  dcm.Clear();
+  // Don't touch the parts of m_memory that still are up to date.
+  dcm.SetDeviceClippingRegion(wxRegion(drawRect));
+  dcm.SetPen(*wxTRANSPARENT_PEN);
+  dcm.SetBrush(dcm.GetBackground());
+  dcm.DrawRectangle(drawRect);
   PrepareDC(dcm);
   dcm.SetMapMode(wxMM_TEXT);
+  dcm.SetUserScale(displayScale, displayScale);
   dcm.SetBackgroundMode(wxTRANSPARENT);
   dcm.SetLogicalFunction(wxCOPY);
 
   CellParser parser(dcm);
   parser.SetBounds(top, bottom);
-  parser.SetZoomFactor(m_zoomFactor);
+  parser.SetZoomFactor(m_layoutZoomFactor);
   int fontsize = parser.GetDefaultFontSize(); // apply zoomfactor to defaultfontsize
 
   // Draw content
@@ -260,8 +324,8 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
         tmp = dynamic_cast<GroupCell *>(tmp->m_next);
       }
     }
-    m_lastTop = top;
-    m_lastBottom = bottom;
+    m_lastTop = viewTop;
+    m_lastBottom = viewBottom;
     //
     // Draw content over the highlighting we did until now
     //
@@ -279,11 +343,15 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
     config->Read(wxT("changeAsterisk"), &changeAsterisk);
     parser.SetChangeAsterisk(changeAsterisk);
 
+    // Cells nothing else is drawn over can be copied from the bitmap that was
+    // made the last time they were drawn.
+    bool drawCached = (displayScale == 1.0) && (m_selectionStart == NULL);
+
     while (tmp != NULL)
     {
       wxRect rect = tmp->GetRect();        
       // Clear the image cache of all cells above or below the viewport.
-      if((rect.GetTop() >= bottom) || (rect.GetBottom() <= top))
+      if((rect.GetTop() >= viewBottom) || (rect.GetBottom() <= viewTop))
       {
         // Only actually clear the image cache if we did display the
         // image in the last step: Else it most probably isn't actually cached.
@@ -295,7 +363,14 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
       }
 
       if (tmp->DrawThisCell(parser, point))
-        tmp->Draw(parser, point, MAX(fontsize, MC_MIN_SIZE));
+      {
+        if (drawCached && (tmp != m_workingGroup) &&
+            ((m_activeCell == NULL) || (m_activeCell->GetParent() != tmp)) &&
+            !m_evaluationQueue->IsInQueue(tmp))
+          tmp->DrawCached(parser, point, MAX(fontsize, MC_MIN_SIZE));
+        else
+          tmp->Draw(parser, point, MAX(fontsize, MC_MIN_SIZE));
+      }
       if (tmp->m_next != NULL) {
         point.x = MC_GROUP_LEFT_INDENT;
         point.y += drop + tmp->m_next->GetMaxCenter();
@@ -324,11 +399,59 @@ void MathCtrl::OnPaint(wxPaintEvent& event) {
     
   }
   // Blit the memory image to the window
+  dcm.DestroyClippingRegion();
+  dcm.SetUserScale(1.0, 1.0);
   dcm.SetDeviceOrigin(0, 0);
   dc.Blit(0, rect.GetTop(), sz.x, rect.GetBottom() - rect.GetTop() + 1, &dcm,
           0, rect.GetTop());
 }
 
+void MathCtrl::Refresh(bool eraseBackground, const wxRect *rect)
+{
+  if (rect == NULL)
+    m_memoryDirty = wxRegion(wxRect(wxPoint(0, 0), GetSize()));
+  else
+    m_memoryDirty.Union(*rect);
+  wxScrolledCanvas::Refresh(eraseBackground, rect);
+}
+
+void MathCtrl::ScrollWindow(int dx, int dy, const wxRect *rect)
+{
+  wxSize sz = GetSize();
+  if ((m_memory != NULL) && (rect == NULL) && (abs(dx) < sz.x) && (abs(dy) < sz.y))
+  {
+    // Move the contents of m_memory along with the window.
+    if (m_scrollMemory == NULL)
+    {
+      m_scrollMemory = new wxBitmap();
+      m_scrollMemory->CreateScaled(sz.x, sz.y, -1, m_memory->GetScaleFactor());
+    }
+    {
+      wxMemoryDC source(*m_memory);
+      wxMemoryDC target(*m_scrollMemory);
+      target.Blit(dx, dy, sz.x, sz.y, &source, 0, 0);
+    }
+    wxBitmap *memory = m_memory;
+    m_memory = m_scrollMemory;
+    m_scrollMemory = memory;
+
+    // Only the strips that are scrolled into view have to be drawn anew.
+    m_memoryDirty.Offset(dx, dy);
+    if (dy > 0)
+      m_memoryDirty.Union(0, 0, sz.x, dy);
+    if (dy < 0)
+      m_memoryDirty.Union(0, sz.y + dy, sz.x, -dy);
+    if (dx > 0)
+      m_memoryDirty.Union(0, 0, dx, sz.y);
+    if (dx < 0)
+      m_memoryDirty.Union(sz.x + dx, 0, -dx, sz.y);
+  }
+  else
+    m_memoryDirty = wxRegion(0, 0, sz.x, sz.y);
+
+  wxScrolledCanvas::ScrollWindow(dx, dy, rect);
+}
+
 GroupCell *MathCtrl::InsertGroupCells(GroupCell* cells,GroupCell* where)
 {
   return InsertGroupCells(cells,where,&treeUndoActions);
@@ -489,7 +612,7 @@ void MathCtrl::InsertLine(MathCell *newCell, bool forceNewLine)
     
     wxClientDC dc(this);
     CellParser parser(dc);
-    parser.SetZoomFactor(m_zoomFactor);
+    parser.SetZoomFactor(m_layoutZoomFactor);
     parser.SetClientWidth(GetClientSize().GetWidth() - MC_GROUP_LEFT_INDENT - MC_BASE_INDENT);
 
     tmp->RecalculateAppended(parser);
@@ -517,12 +640,35 @@ void MathCtrl::InsertLine(MathCell *newCell, bool forceNewLine)
 }
 
 void MathCtrl::SetZoomFactor(double newzoom, bool recalc)
+{
+  if (!recalc)
+  {
+    m_zoomFactor = m_layoutZoomFactor = newzoom;
+    return;
+  }
+
+  // Keep the top of the view at the same place of the worksheet.
+  int view_x, view_y;
+  GetViewStart(&view_x, &view_y);
+  view_y = view_y * newzoom / m_zoomFactor;
+  m_zoomFactor = newzoom;
+
+  // Until the user stops zooming we only draw the existing layout scaled to
+  // the new zoom factor: Measuring all text anew for every zoom step would
+  // make zooming a big worksheet sluggish.
+  m_zoomTimer.Start(ZOOM_TIMER_TIMEOUT, true);
+  AdjustSize();
+  Scroll(-1, view_y);
+  Refresh();
+}
+
+void MathCtrl::RecalculateForNewZoom()
 {
   // Determine if we have a sane thing we can scroll to.
   MathCell *CellToScrollTo = NULL;
   if(CaretVisibleIs())
   {
-    MathCell *CellToScrollTo = GetHCaret();
+    CellToScrollTo = GetHCaret();
     if(!CellToScrollTo) CellToScrollTo = GetActiveCell();
   }
   if(!CellToScrollTo) CellToScrollTo = GetWorkingGroup();
@@ -530,6 +676,7 @@ void MathCtrl::SetZoomFactor(double newzoom, bool recalc)
   {
     wxPoint topleft;
     CalcUnscrolledPosition(0,0,&topleft.x,&topleft.y);
+    topleft.y /= DisplayScale();
     CellToScrollTo = GetTree();
     while (CellToScrollTo != NULL)
     {
@@ -539,12 +686,9 @@ void MathCtrl::SetZoomFactor(double newzoom, bool recalc)
       CellToScrollTo = CellToScrollTo -> m_next;
     }
   }
-  m_zoomFactor = newzoom;
-  if (recalc)
-  {
-    RecalculateForce();
-    Refresh();
-  }
+  m_layoutZoomFactor = m_zoomFactor;
+  RecalculateForce();
+  Refresh();
   
   if(CellToScrollTo)
     ScrollToCell(CellToScrollTo);
@@ -557,29 +701,158 @@ void MathCtrl::Recalculate(bool force)
   if(m_tree)
     m_tree->SetCanvasSize(GetClientSize());
 
+  // The style might have changed => the cached bitmaps of the cells are outdated.
+  if(force)
+    GroupCell::ClearSurfaceCache();
+
+  // All GroupCells are measured on the GUI thread: wxDC text measurement isn't
+  // thread-safe on wxGTK and wxOSX. What makes a forced recalculation cheap is
+  // the text metrics cache CellParser::GetTextExtent() shares between all passes.
   wxClientDC dc(this);
   CellParser parser(dc);
-  parser.SetZoomFactor(m_zoomFactor);
+  parser.SetZoomFactor(m_layoutZoomFactor);
   parser.SetForceUpdate(force);
   parser.SetClientWidth(GetClientSize().GetWidth() - MC_GROUP_LEFT_INDENT - MC_BASE_INDENT);
   int d_fontsize = parser.GetDefaultFontSize();
   int m_fontsize = parser.GetMathFontSize();
 
+  // Only the cells near the visible part of the worksheet are laid out now.
+  // All other cells that would need to be laid out only get a size estimate that
+  // LayOutEstimatedCellsInView() replaces by their real size as soon as they are
+  // scrolled into view. Cells whose size is still valid are only placed.
+  int viewTop, viewBottom;
+  GetLazyLayoutRange(&viewTop, &viewBottom);
+  int top = MC_BASE_INDENT;
   while (tmp != NULL)
   {
-    tmp->Recalculate(parser, d_fontsize, m_fontsize);
+    // A cell whose height isn't known yet is assumed to begin where it ends.
+    int bottom = top + MAX(tmp->GetHeight(), 0);
+    if (tmp->NeedsRecalculation(parser) &&
+        ((bottom < viewTop) || (top > viewBottom)))
+    {
+      tmp->EstimateSize(parser, d_fontsize, m_fontsize);
+      m_layoutPending = true;
+    }
+    else
+      tmp->Recalculate(parser, d_fontsize, m_fontsize);
+    top = tmp->GetRect().GetBottom() + MC_GROUP_SKIP;
     tmp = dynamic_cast<GroupCell*>(tmp->m_next);
   }
  
   AdjustSize();
 }
 
+void MathCtrl::GetLazyLayoutRange(int *top, int *bottom)
+{
+  int x, clientWidth, clientHeight;
+  GetClientSize(&clientWidth, &clientHeight);
+  CalcUnscrolledPosition(0, 0, &x, top);
+  *top /= DisplayScale();
+  clientHeight /= DisplayScale();
+  *bottom = *top + 2 * clientHeight;
+  *top -= clientHeight;
+}
+
+bool MathCtrl::LayOutEstimatedCellsInView()
+{
+  int viewTop, viewBottom;
+  GetLazyLayoutRange(&viewTop, &viewBottom);
+  bool scrolled = false;
+  LayOutEstimatedCells(viewTop, viewBottom, -1, &scrolled);
+  return scrolled;
+}
+
+int MathCtrl::LayOutEstimatedCells(int top, int bottom, int maxCells, bool *scrolled)
+{
+  *scrolled = false;
+  if (m_tree == NULL)
+    return 0;
+
+  int x, visibleTop;
+  CalcUnscrolledPosition(0, 0, &x, &visibleTop);
+  visibleTop /= DisplayScale();
+
+  wxClientDC dc(this);
+  CellParser parser(dc);
+  parser.SetZoomFactor(m_layoutZoomFactor);
+  parser.SetClientWidth(GetClientSize().GetWidth() - MC_GROUP_LEFT_INDENT - MC_BASE_INDENT);
+  int d_fontsize = parser.GetDefaultFontSize();
+  int m_fontsize = parser.GetMathFontSize();
+
+  int laidOut = 0;
+  int heightChangeAbove = 0;
+  GroupCell *tmp = m_tree;
+  while (tmp != NULL)
+  {
+    // Cells below a cell whose size has changed have moved.
+    tmp->UpdateYPosition();
+    wxRect rect = tmp->GetRect();
+    if (tmp->IsSizeEstimated() && (laidOut != maxCells) &&
+        (rect.GetBottom() >= top) && (rect.GetTop() <= bottom))
+    {
+      int height = tmp->GetHeight();
+      tmp->Recalculate(parser, d_fontsize, m_fontsize);
+      laidOut++;
+      // If the cell is above the visible area the things we see move by the
+      // amount the cell's size has changed.
+      if (rect.GetBottom() < visibleTop)
+        heightChangeAbove += tmp->GetHeight() - height;
+    }
+    else if ((laidOut == 0) && (rect.GetTop() > bottom))
+      break;
+    tmp = dynamic_cast<GroupCell*>(tmp->m_next);
+  }
+
+  if (laidOut == 0)
+    return 0;
+
+  AdjustSize();
+  if (heightChangeAbove / SCROLL_UNIT != 0)
+  {
+    int view_x, view_y;
+    GetViewStart(&view_x, &view_y);
+    Scroll(-1, MAX(view_y + heightChangeAbove / SCROLL_UNIT, 0));
+    *scrolled = true;
+  }
+  return laidOut;
+}
+
+void MathCtrl::OnIdle(wxIdleEvent& event)
+{
+  // Don't walk through the worksheet if no cell is waiting for its layout and
+  // don't interfere with a resize that is still going on.
+  if (!m_layoutPending || m_resizeTimer.IsRunning())
+    return;
+
+  // Lay out the cells that only know an estimate of their size in small chunks
+  // so the user interface stays responsive.
+  bool scrolled = false;
+  if (LayOutEstimatedCells(0, INT_MAX, IDLE_LAYOUT_CHUNK, &scrolled) > 0)
+  {
+    if (scrolled)
+      Refresh();
+    event.RequestMore();
+  }
+  else
+    m_layoutPending = false;
+}
+
 /***
  * Resize the control
  */
 void MathCtrl::OnSize(wxSizeEvent& event) {
   wxDELETE(m_memory);
+  wxDELETE(m_scrollMemory);
+
+  // While the user is still dragging the window border we just draw the old
+  // layout. The lines are re-broken as soon as the size has been stable for a
+  // short while.
+  m_resizeTimer.Start(RESIZE_TIMER_TIMEOUT, true);
+  AdjustSize();
+  Refresh();
+}
 
+void MathCtrl::RecalculateForNewWidth() {
   // Determine if we have a sane thing we can scroll to.
   MathCell *CellToScrollTo = NULL;
   if(CaretVisibleIs())
@@ -605,14 +878,16 @@ void MathCtrl::OnSize(wxSizeEvent& event) {
 
   if (m_tree != NULL) {
     SetSelection(NULL);
-    RecalculateForce();
+    // The text hasn't changed which means we only need to break the lines
+    // anew, not to measure all text again: The GroupCells notice by themselves
+    // that they have been laid out for a different width.
+    Recalculate();
   }
   else
     AdjustSize();
 
   Refresh();
   if(CellToScrollTo)ScrollToCell(CellToScrollTo);
-  //wxScrolledCanvas::OnSize(event);
 }
 
 /***
@@ -635,6 +910,7 @@ void MathCtrl::ClearDocument() {
   m_evaluationQueue->Clear();
   TreeUndo_ClearBuffers();
   DestroyTree();
+  m_wxmxImages.Forget();
 
   EnableEdit(true);
   m_switchDisplayCaret = true;
@@ -1830,6 +2106,7 @@ void MathCtrl::TreeUndo_MergeSubsequentEdits(bool mergeRequest,std::list <TreeUn
     {
       TreeUndoAction *undoAction=new TreeUndoAction(m_currentUndoAction);
       undoList->push_front(undoAction);
+      TreeUndo_LimitUndoBuffer();
       m_currentUndoAction.Clear();
       TreeUndo_ActiveCell = NULL;
       m_TreeUndoMergeStartIsSet = false;
@@ -1872,14 +2149,14 @@ void MathCtrl::DeleteRegion(GroupCell *start,GroupCell *end,std::list <TreeUndoA
     if(tmp==m_lastWorkingGroup)
       m_lastWorkingGroup = NULL;
     
-    if (tmp->IsFoldable() || (tmp->GetGroupType() == GC_TYPE_IMAGE)) {
+    if (tmp->IsFoldable() || (tmp->GetGroupType() == GC_TYPE_IMAGE))
       renumber = true;
-      break;
-    }
 
-    // Don't keep cached versions of scaled images around in the undo buffer.
+    // Don't keep cached versions of scaled images or of the cell itself
+    // around in the undo buffer.
     if(tmp->GetOutput())
       tmp->GetOutput()->ClearCacheList();
+    tmp->InvalidateSurface();
     
     if (tmp == end)
       break;
@@ -2979,6 +3256,9 @@ void MathCtrl::AdjustSize() {
   GetClientSize(&clientWidth, &clientHeight);
   if (m_tree != NULL)
     GetMaxPoint(&width, &height);
+  // While zooming the layout is drawn scaled.
+  width  *= DisplayScale();
+  height *= DisplayScale();
   // when window is scrolled all the way down, document occupies top 1/8 of clientHeight
   height += clientHeight - (int)(1.0/8.0*(float)clientHeight);
   virtualHeight = MAX(clientHeight  + 10 , height); // ensure we always have VSCROLL active
@@ -3054,6 +3334,12 @@ void MathCtrl::OnTimer(wxTimerEvent& event) {
     m_timer.Start(50, true);
   }
   break;
+  case RESIZE_TIMER_ID:
+    RecalculateForNewWidth();
+    break;
+  case ZOOM_TIMER_ID:
+    RecalculateForNewZoom();
+    break;
   case ANIMATION_TIMER_ID:
   {
     if (CanAnimate())
@@ -3176,14 +3462,14 @@ wxSize MathCtrl::CopyToFile(wxString file) {
 }
 
 wxSize MathCtrl::CopyToFile(wxString file, MathCell* start, MathCell* end,
-                            bool asData,int scale)
+                            bool asData,int scale, WorkerPool *pool)
 {
   MathCell* tmp = CopySelection(start, end, asData);
 
   Bitmap bmp(scale);
   bmp.SetData(tmp);
 
-  return bmp.ToFile(file);
+  return bmp.ToFile(file, pool);
 }
 
 /***
@@ -3350,6 +3636,10 @@ bool MathCtrl::ExportToHTML(wxString file) {
   int count = 0;
   GroupCell *tmp = m_tree;
   MarkDownHTML MarkDown;    
+  // Compresses the bitmaps of the equations on all processors
+  WorkerPool pngPool;
+  // false = at least one of the bitmaps couldn't be written
+  bool imagesOK = true;
 
   wxFileName::SplitPath(file, &path, &filename, &ext);
   imgDir_rel = filename + wxT("_htmlimg");
@@ -3909,8 +4199,18 @@ bool MathCtrl::ExportToHTML(wxString file) {
               wxConfig::Get()->Read(wxT("bitmapScale"), &bitmapScale);
               size = CopyToFile(imgDir + wxT("/") + filename + wxString::Format(wxT("_%d.png"), count),
                                 chunk,
-                                NULL, true, bitmapScale);
+                                NULL, true, bitmapScale, &pngPool);
+
+              // Don't keep too many uncompressed bitmaps in memory.
+              if(pngPool.Count() >= 2 * size_t(WorkerPool::GetThreadCount()))
+              {
+                if(!pngPool.Run())
+                  imagesOK = false;
+                pngPool.Clear();
+              }
             }
+            if(size.x < 0)
+              imagesOK = false;
             
             int borderwidth = 0;
             wxString alttext = _("Result");
@@ -4012,6 +4312,11 @@ bool MathCtrl::ExportToHTML(wxString file) {
     tmp = dynamic_cast<GroupCell*>(tmp->m_next);
   }
 
+  // Write the bitmaps that haven't been written yet.
+  if(!pngPool.Run())
+    imagesOK = false;
+  pngPool.Clear();
+
 //////////////////////////////////////////////
 // Footer
 //////////////////////////////////////////////
@@ -4049,36 +4354,32 @@ bool MathCtrl::ExportToHTML(wxString file) {
   outfile.Close();
   cssfile.Close();
   
-  return outfileOK && cssOK;
+  return outfileOK && cssOK && imagesOK;
 }
 
-GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
+GroupCell* MathCtrl::CreateTreeFromWXMCode(const wxString &wxm)
+{
+  WXMReader reader(wxm);
+  return CreateTreeFromWXMCode(reader);
+}
+
+GroupCell* MathCtrl::CreateTreeFromWXMCode(WXMReader &wxm)
 {
   bool hide = false;
   GroupCell* tree = NULL;
   GroupCell* last = NULL;
   GroupCell* cell = NULL;
 
-  while (!wxmLines->IsEmpty())
+  while (!wxm.Eof())
   {
-    if (wxmLines->Item(0) == wxT("/* [wxMaxima: hide output   ] */"))
+    if (wxm.Line() == wxT("/* [wxMaxima: hide output   ] */"))
       hide = true;
 
     // Print title
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: title   start ]"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: title   start ]"))
     {
-      wxmLines->RemoveAt(0);
-
-      wxString line;
-      while ((!wxmLines->IsEmpty()) && (wxmLines->Item(0) != wxT("   [wxMaxima: title   end   ] */")))
-      {
-        if (line.Length() == 0)
-          line += wxmLines->Item(0);
-        else
-          line += wxT("\n") + wxmLines->Item(0);
-
-        wxmLines->RemoveAt(0);
-      }
+      wxm.Next();
+      wxString line = wxm.ReadUntil(wxT("   [wxMaxima: title   end   ] */"));
 
       cell = new GroupCell(GC_TYPE_TITLE, line);
       if (hide) {
@@ -4088,20 +4389,10 @@ GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
     }
 
     // Print section
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: section start ]"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: section start ]"))
     {
-      wxmLines->RemoveAt(0);
-
-      wxString line;
-      while ((!wxmLines->IsEmpty()) && (wxmLines->Item(0) != wxT("   [wxMaxima: section end   ] */")))
-      {
-        if (line.Length() == 0)
-          line += wxmLines->Item(0);
-        else
-          line += wxT("\n") + wxmLines->Item(0);
-
-        wxmLines->RemoveAt(0);
-      }
+      wxm.Next();
+      wxString line = wxm.ReadUntil(wxT("   [wxMaxima: section end   ] */"));
 
       cell = new GroupCell(GC_TYPE_SECTION, line);
       if (hide) {
@@ -4111,20 +4402,10 @@ GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
     }
 
     // Print subsection
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: subsect start ]"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: subsect start ]"))
     {
-      wxmLines->RemoveAt(0);
-
-      wxString line;
-      while ((!wxmLines->IsEmpty()) && (wxmLines->Item(0) != wxT("   [wxMaxima: subsect end   ] */")))
-      {
-        if (line.Length() == 0)
-          line += wxmLines->Item(0);
-        else
-          line += wxT("\n") + wxmLines->Item(0);
-
-        wxmLines->RemoveAt(0);
-      }
+      wxm.Next();
+      wxString line = wxm.ReadUntil(wxT("   [wxMaxima: subsect end   ] */"));
 
       cell = new GroupCell(GC_TYPE_SUBSECTION, line);
       if (hide) {
@@ -4134,20 +4415,10 @@ GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
     }
     
     // print subsubsection
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: subsubsect start ]"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: subsubsect start ]"))
     {
-      wxmLines->RemoveAt(0);
-
-      wxString line;
-      while ((!wxmLines->IsEmpty()) && (wxmLines->Item(0) != wxT("   [wxMaxima: subsubsect end   ] */")))
-      {
-        if (line.Length() == 0)
-          line += wxmLines->Item(0);
-        else
-          line += wxT("\n") + wxmLines->Item(0);
-
-        wxmLines->RemoveAt(0);
-      }
+      wxm.Next();
+      wxString line = wxm.ReadUntil(wxT("   [wxMaxima: subsubsect end   ] */"));
 
       cell = new GroupCell(GC_TYPE_SUBSUBSECTION, line);
       if (hide) {
@@ -4157,20 +4428,10 @@ GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
     }
 
     // Print comment
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: comment start ]"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: comment start ]"))
     {
-      wxmLines->RemoveAt(0);
-
-      wxString line;
-      while ((!wxmLines->IsEmpty()) && (wxmLines->Item(0) != wxT("   [wxMaxima: comment end   ] */")))
-      {
-        if (line.Length() == 0)
-          line += wxmLines->Item(0);
-        else
-          line += wxT("\n") + wxmLines->Item(0);
-
-        wxmLines->RemoveAt(0);
-      }
+      wxm.Next();
+      wxString line = wxm.ReadUntil(wxT("   [wxMaxima: comment end   ] */"));
 
       cell = new GroupCell(GC_TYPE_TEXT, line);
       if (hide) {
@@ -4180,20 +4441,10 @@ GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
     }
 
     // Print input
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: input   start ] */"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: input   start ] */"))
     {
-      wxmLines->RemoveAt(0);
-
-      wxString line;
-      while ((!wxmLines->IsEmpty()) &&(wxmLines->Item(0) != wxT("/* [wxMaxima: input   end   ] */")))
-      {
-        if (line.Length() == 0)
-          line += wxmLines->Item(0);
-        else
-          line += wxT("\n") + wxmLines->Item(0);
-
-        wxmLines->RemoveAt(0);
-      }
+      wxm.Next();
+      wxString line = wxm.ReadUntil(wxT("/* [wxMaxima: input   end   ] */"));
 
       cell = new GroupCell(GC_TYPE_CODE, line);
       if (hide) {
@@ -4202,23 +4453,23 @@ GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
       }
     }
 
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: page break    ] */"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: page break    ] */"))
     {
-      wxmLines->RemoveAt(0);
+      wxm.Next();
 
       cell = new GroupCell(GC_TYPE_PAGEBREAK);
     }
 
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: fold    start ] */"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: fold    start ] */"))
     {
-      wxmLines->RemoveAt(0);
+      wxm.Next();
 
-      last->HideTree(CreateTreeFromWXMCode(wxmLines));
+      last->HideTree(CreateTreeFromWXMCode(wxm));
     }
 
-    else if (wxmLines->Item(0) == wxT("/* [wxMaxima: fold    end   ] */"))
+    else if (wxm.Line() == wxT("/* [wxMaxima: fold    end   ] */"))
     {
-      wxmLines->RemoveAt(0);
+      wxm.Next();
 
       break;
     }
@@ -4237,8 +4488,7 @@ GroupCell* MathCtrl::CreateTreeFromWXMCode(wxArrayString *wxmLines)
       cell = NULL;
     }
 
-    if (!wxmLines->IsEmpty())
-      wxmLines->RemoveAt(0);
+    wxm.Next();
   }
   
   return tree;
@@ -4598,7 +4848,11 @@ bool MathCtrl::ExportToMAC(wxString file)
   }
 
   if(wxm)
+  {
     m_saved = true;
+    // .wxm files don't have a recovery journal.
+    m_journal.Discard();
+  }
   return true;
 }
 
@@ -4610,33 +4864,15 @@ wxString ConvertToUnicode(wxString str)
   return str;
 }
 
-/*
-  Save the data as wxmx file
+/*! Start writing a .wxmx file
 
-  First saves the data to a backup file ending in .wxmx~ so if anything goes 
-  horribly wrong in this stepp all that is lost is the data that was input 
-  since the last save. Then the original .wxmx file is replaced in a 
-  (hopefully) atomic operation.
-*/
-bool MathCtrl::ExportToWXMX(wxString file,bool markAsSaved)
+  Opens the zip archive and writes the entries that don't depend on the 
+  worksheet's contents.
+ */
+static void WriteWXMXHeader(wxZipOutputStream &zip)
 {
-  // delete temp file if it already exists
-  wxString backupfile=file+wxT("~");
-  if(wxFileExists(backupfile))
-  {
-    if(!wxRemoveFile(backupfile))
-      return false;
-  }
-  
-  wxFFileOutputStream out(backupfile);
-  if (!out.IsOk())
-    return false;
-  wxZipOutputStream zip(out);
   wxTextOutputStream output(zip);
 
-  // Show a busy cursor as long as we save.
-  wxBusyCursor crs;
-
   /* The first zip entry is a file named "mimetype": This makes sure that the mimetype 
      is always stored at the same position in the file. This is common practice. One 
      example from an ePub file:
@@ -4665,8 +4901,208 @@ bool MathCtrl::ExportToWXMX(wxString file,bool markAsSaved)
     ".zip archive making the .wxmx file more version-control-friendly.\n"
     "wxMaxima can be downloaded from https://github.com/andrejv/wxmaxima.\n"
     );
+}
 
-  /* We might want to compress the rest of this file, though, if the user doesn't 
+/*! Compresses a file for a zip archive in a background thread
+
+  The result is a zip archive that contains only this file. Its entry can be
+  copied into the actual archive without compressing it again.
+ */
+class ZipEntryJob : public WorkerPool::Job
+{
+public:
+  ZipEntryJob(wxString name, const wxMemoryBuffer &data) : m_data(data)
+    {
+      // We mustn't share string data with the thread that created us.
+      m_name = name.Clone();
+    }
+  virtual void Run()
+    {
+      wxMemoryOutputStream out;
+      {
+        wxZipOutputStream zip(out, 9);
+        m_ok = zip.PutNextEntry(m_name);
+        if(m_ok)
+        {
+          zip.Write(m_data.GetData(), m_data.GetDataLen());
+          m_ok = zip.Close();
+        }
+        if(!m_ok)
+          return;
+      }
+      m_zip.AppendData(out.GetOutputStreamBuffer()->GetBufferStart(), out.GetLength());
+    }
+  /*! Copy the compressed file to the archive
+
+    \return false, if Run() has failed to compress the file or if the file
+    couldn't be written.
+   */
+  bool CopyTo(wxZipOutputStream &zip)
+    {
+      if(!m_ok)
+        return false;
+      wxMemoryInputStream in(m_zip.GetData(), m_zip.GetDataLen());
+      wxZipInputStream zipIn(in);
+      wxZipEntry *entry = zipIn.GetNextEntry();
+      if(entry == NULL)
+        return false;
+      return zip.CopyEntry(entry, zipIn);
+    }
+private:
+  wxString m_name;
+  //! The data that is to be compressed. Is only read so the reference count isn't touched.
+  const wxMemoryBuffer &m_data;
+  //! The zip archive Run() has created
+  wxMemoryBuffer m_zip;
+};
+
+/*! Write the images a .wxmx file contains
+
+  \param images The list of images
+  \param used The indices of the images that are to be written. May contain
+  duplicates.
+  \param compress true means: Compress the images. See WXMXCompressImages().
+  Compressing is done on all processors at once. The images are written in the
+  same order as without compression, though.
+  \param oldFile The version of the file that is to be replaced or an empty
+  string. All images that file contains in the right form are copied from there
+  instead of being written anew.
+  \return false, if an image couldn't be written. The archive is unusable, then.
+ */
+static bool WriteWXMXImages(wxZipOutputStream &zip, WXMXImageList &images,
+                            const std::vector<size_t> &used, bool compress,
+                            wxString oldFile)
+{
+  std::vector<bool> write(images.Count(), false);
+  for (size_t i = 0; i < used.size(); i++)
+    write[used[i]] = true;
+
+  WXMXArchive *old = NULL;
+  if (oldFile != wxEmptyString)
+  {
+    old = new WXMXArchive(oldFile);
+    if (!old->IsOk())
+      wxDELETE(old);
+  }
+
+  // Images that haven't changed since the file was written can be copied
+  // as they are, without compressing them again.
+  std::vector<bool> copy(images.Count(), false);
+  if (old != NULL)
+    for (size_t i = 0; i < images.Count(); i++)
+      copy[i] = write[i] && old->CanCopyEntry(images.GetName(i), images.GetData(i), compress);
+
+  // Compress the images that cannot be copied on all processors at once.
+  WorkerPool pool;
+  std::vector<ZipEntryJob *> jobs(images.Count(), NULL);
+  if(compress)
+  {
+    for (size_t i = 0; i < images.Count(); i++)
+      if (write[i] && !copy[i])
+      {
+        jobs[i] = new ZipEntryJob(images.GetName(i), images.GetData(i));
+        pool.Add(jobs[i]);
+      }
+    pool.Run();
+  }
+
+  bool ok = true;
+  for (size_t i = 0; (i < images.Count()) && ok; i++)
+  {
+    if (!write[i])
+      continue;
+    const wxMemoryBuffer &data = images.GetData(i);
+
+    if (copy[i])
+      ok = old->CopyEntry(images.GetName(i), zip);
+    else if (jobs[i] != NULL)
+      ok = jobs[i]->CopyTo(zip);
+    else
+    {
+      // Write the image directly from the image cells' compressed data
+      zip.SetLevel(compress ? 9 : 0);
+      ok = zip.PutNextEntry(images.GetName(i));
+      if (ok)
+      {
+        zip.Write(data.GetData(), data.GetDataLen());
+        ok = zip.IsOk();
+      }
+    }
+  }
+  wxDELETE(old);
+  return ok;
+}
+
+/*! Replace a .wxmx file by the temporary file the new version has been written to
+
+  This hopefully is an atomic operation.
+ */
+static bool ReplaceWXMXFile(wxString backupfile, wxString file)
+{
+  if(!wxRenameFile(backupfile,file,true))
+  {
+    // We might have failed to move the file because an over-eager virus scanner wants to
+    // scan it and a design decision of a filesystem driver might hinder us from moving
+    // it during this action => Wait for a second and retry.
+    wxSleep(1);
+    if(!wxRenameFile(backupfile,file,true))
+    {
+      wxSleep(1);
+      if(!wxRenameFile(backupfile,file,true))
+        return false;
+    }
+  }
+  return true;
+}
+
+void WXMXFileImages::Loaded(wxString file, WXMXArchive &archive)
+{
+  m_images.Clear();
+  const std::map<wxString, wxMemoryBuffer> &entries = archive.GetEntriesRead();
+  for (std::map<wxString, wxMemoryBuffer>::const_iterator it = entries.begin();
+       it != entries.end(); ++it)
+    m_images.AddFile(it->first, it->second);
+  m_images.ClearUsed();
+  m_file = file;
+  Stamp();
+}
+
+void WXMXFileImages::Saved(wxString file, const std::vector<size_t> &used)
+{
+  // Images that the file doesn't contain can get new names next time.
+  m_images.Retain(used);
+  m_file = file;
+  Stamp();
+}
+
+bool WXMXFileImages::Matches(wxString file)
+{
+  if ((file != m_file) || (!wxFileExists(file)))
+    return false;
+
+  // If the file has been changed by another program the names of the images
+  // might no more match.
+  wxFileName name(file);
+  return (name.GetModificationTime().GetValue() == m_modificationTime) &&
+    (name.GetSize() == m_size);
+}
+
+void WXMXFileImages::Forget()
+{
+  m_images.Clear();
+  m_file = wxEmptyString;
+}
+
+void WXMXFileImages::Stamp()
+{
+  wxFileName name(m_file);
+  m_modificationTime = name.GetModificationTime().GetValue();
+  m_size = name.GetSize();
+}
+
+bool MathCtrl::WXMXCompressImages()
+{
+  /* We might want to compress the images, though, if the user doesn't 
      use a version control system like git or svn:
 
      Compressed files tend to completely change their structure if actually only 
@@ -4680,10 +5116,13 @@ bool MathCtrl::ExportToWXMX(wxString file,bool markAsSaved)
      compression.
   */
   bool VcFriendlyWXMX=true;
+  wxConfig::Get()->Read(wxT("OptimizeForVersionControl"), &VcFriendlyWXMX);
+  return !VcFriendlyWXMX;
+}
 
-  // next zip entry is "content.xml", xml of m_tree
-
-  zip.PutNextEntry(wxT("content.xml"));
+wxString MathCtrl::WXMXDocumentStart()
+{
+  wxString output;
   output << wxT("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
   output << wxT("\n<!--   Created by wxMaxima ") << wxT(VERSION) << wxT("   -->");
   output << wxT("\n<!--http://wxmaxima.sourceforge.net-->\n");
@@ -4739,66 +5178,86 @@ bool MathCtrl::ExportToWXMX(wxString file,bool markAsSaved)
   if(ActiveCellNumber >= 0)
     output << wxString::Format(wxT(" activecell=\"%li\""),ActiveCellNumber);
 
-  output << ">\n";
+  output << wxT(">\n");
+  return output;
+}
 
-  // Reset image counter
-  ImgCell::WXMXResetCounter();
+void MathCtrl::WriteWXMXContent(wxTextOutputStream &output, WXMXImageList &images)
+{
+  output << WXMXDocumentStart();
 
-  wxString xmlText;
-  if(m_tree)
-    xmlText = ConvertToUnicode(m_tree->ListToXML());
-  size_t xmlLen = xmlText.Length();
-  
-  // Delete all but one control character from the string: there should be
-  // no way for them to enter this string, anyway. But sometimes they still
-  // do...
-  for(size_t index = 0;index<xmlLen;index++)
+  // This is what MathCell::ListToXML() does except that each cell is
+  // written to the stream as soon as it has been converted.
+  bool highlight = false;
+  for(MathCell *cell = m_tree; cell != NULL; cell = cell->m_next)
   {
-    wxChar c=xmlText[index];
-
-    if(( c <  wxT('\t')) ||
-       ((c >  wxT('\n')) &&(c < wxT(' '))) ||
-       ( c == wxChar((char)0x7F))
-      )
+    if((cell->GetHighlight())&&(!highlight))
     {
-      xmlText[index] = wxT(' '); 
-    }   
+      output << wxT("<hl>\n");
+      highlight = true;
+    }
+    if((!cell->GetHighlight())&&(highlight))
+    {
+      output << wxT("</hl>\n");
+      highlight = false;
+    }
+    output << ConvertToUnicode(cell->ToWXMX(images));
   }
-  
-  if(m_tree!=NULL)output << xmlText;
+  if(highlight)
+    output << wxT("</hl>\n");
   output << wxT("\n</wxMaximaDocument>");
+}
 
-  wxConfig::Get()->Read(wxT("OptimizeForVersionControl"), &VcFriendlyWXMX);
-  if(!VcFriendlyWXMX)
-    zip.SetLevel(9);
-  
-  // save images from memory to zip file
-  wxFileSystem *fsystem = new wxFileSystem();
-  fsystem->AddHandler(new wxMemoryFSHandler);
-  fsystem->ChangePathTo(wxT("memory:"), true);
+/*
+  Save the data as wxmx file
 
-  for (int i = 1; i<=ImgCell::WXMXImageCount(); i++)
+  First saves the data to a backup file ending in .wxmx~ so if anything goes 
+  horribly wrong in this stepp all that is lost is the data that was input 
+  since the last save. Then the original .wxmx file is replaced in a 
+  (hopefully) atomic operation.
+*/
+bool MathCtrl::ExportToWXMX(wxString file,bool markAsSaved)
+{
+  // delete temp file if it already exists
+  wxString backupfile=file+wxT("~");
+  if(wxFileExists(backupfile))
   {
-    wxString name = wxT("image");
-    name << i << wxT(".*");
-    name = fsystem->FindFirst(name);
-    
-    wxFSFile *fsfile = fsystem->OpenFile(name);
+    if(!wxRemoveFile(backupfile))
+      return false;
+  }
+  
+  wxFFileOutputStream out(backupfile);
+  if (!out.IsOk())
+    return false;
+  wxZipOutputStream zip(out);
 
-    name = name.Right(name.Length() - 7);
-    if (fsfile) {
-      zip.PutNextEntry(name);
-      wxInputStream *imagefile = fsfile->GetStream();
-      
-      while (!(imagefile->Eof()))
-        imagefile->Read(zip);
+  // Show a busy cursor as long as we save.
+  wxBusyCursor crs;
 
-      delete imagefile;
-      wxMemoryFSHandler::RemoveFile(name);
-    }
-  }
+  WriteWXMXHeader(zip);
+
+  // next zip entry is "content.xml", xml of m_tree
+
+  zip.PutNextEntry(wxT("content.xml"));
+  // The xml data is written in many small pieces: Collect them in a buffer
+  // before handing them to the zip stream.
+  wxBufferedOutputStream buffer(zip, 65536);
+  wxTextOutputStream output(buffer);
+
+  // The image cells tell us which images we need to write to the file.
+  // If the file is to become the worksheet's file the images keep the names
+  // they had the last time it was saved.
+  WXMXImageList exportImages;
+  WXMXImageList &images = markAsSaved ? m_wxmxImages.m_images : exportImages;
+  images.ClearUsed();
+  WriteWXMXContent(output, images);
+  if(!buffer.Close())
+    return false;
 
-  delete fsystem;
+  std::vector<size_t> used = images.GetUsed();
+  if(!WriteWXMXImages(zip, images, used, WXMXCompressImages(),
+                      (markAsSaved && m_wxmxImages.Matches(file)) ? file : wxString(wxEmptyString)))
+    return false;
 
   if(!zip.Close())
     return false;
@@ -4806,22 +5265,92 @@ bool MathCtrl::ExportToWXMX(wxString file,bool markAsSaved)
     return false;
   
   // Now that all data is save we can overwrite the actual save file.
-  if(!wxRenameFile(backupfile,file,true))
+  if(!ReplaceWXMXFile(backupfile,file))
+    return false;
+  if(markAsSaved)
   {
-    // We might have failed to move the file because an over-eager virus scanner wants to
-    // scan it and a design decision of a filesystem driver might hinder us from moving
-    // it during this action => Wait for a second and retry.
-    wxSleep(1);
-    if(!wxRenameFile(backupfile,file,true))
+    m_saved = true;
+    m_wxmxImages.Saved(file, used);
+    // The changes the recovery journal contains are now part of the file.
+    m_journal.Restart(file, m_journal.GetState(m_tree));
+  }
+  return true;
+}
+
+WXMXSnapshot *MathCtrl::CreateWXMXSnapshot(wxString file)
+{
+  WXMXSnapshot *snapshot = new WXMXSnapshot;
+  // The snapshot is handed to another thread => it mustn't share any string
+  // data with us.
+  snapshot->m_file = file.Clone();
+  snapshot->m_compressImages = WXMXCompressImages();
+  snapshot->m_journalState = m_journal.GetState(m_tree);
+
+  WXMXImageList &images = m_wxmxImages.m_images;
+  images.ClearUsed();
+  {
+    // Encoded, the xml takes less memory than as a string and the thread
+    // that writes the snapshot doesn't need to convert it any more.
+    wxMemoryOutputStream xml;
     {
-      wxSleep(1);
-      if(!wxRenameFile(backupfile,file,true))
-        return false;
+      wxTextOutputStream output(xml);
+      WriteWXMXContent(output, images);
     }
+    snapshot->m_xml.AppendData(xml.GetOutputStreamBuffer()->GetBufferStart(), xml.GetLength());
   }
-  if(markAsSaved)
-    m_saved = true;
-  return true;
+
+  // The thread that writes the snapshot needs a copy of the images it can
+  // access while we change the original list.
+  images.CopyUsed(snapshot->m_images);
+  snapshot->m_usedImages = images.GetUsed();
+  snapshot->m_imageListId = images.GetId();
+  if(m_wxmxImages.Matches(file))
+    snapshot->m_oldFile = file.Clone();
+  return snapshot;
+}
+
+void MathCtrl::WXMXSnapshotSaved(WXMXSnapshot *snapshot)
+{
+  // If another file has been loaded in the meantime the indices of the
+  // images refer to a list that no more exists.
+  if(snapshot->m_imageListId == m_wxmxImages.m_images.GetId())
+    m_wxmxImages.Saved(snapshot->m_file, snapshot->m_usedImages);
+  m_journal.Restart(snapshot->m_file, snapshot->m_journalState);
+}
+
+bool MathCtrl::WriteWXMXSnapshot(WXMXSnapshot *snapshot)
+{
+  wxString backupfile = snapshot->m_file + wxT("~");
+  if(wxFileExists(backupfile))
+  {
+    if(!wxRemoveFile(backupfile))
+      return false;
+  }
+
+  wxFFileOutputStream out(backupfile);
+  if (!out.IsOk())
+    return false;
+  wxZipOutputStream zip(out);
+
+  WriteWXMXHeader(zip);
+  zip.PutNextEntry(wxT("content.xml"));
+  zip.Write(snapshot->m_xml.GetData(), snapshot->m_xml.GetDataLen());
+  if(!zip.IsOk())
+    return false;
+  // The snapshot contains only the images that are to be written.
+  std::vector<size_t> used;
+  for (size_t i = 0; i < snapshot->m_images.Count(); i++)
+    used.push_back(i);
+  if(!WriteWXMXImages(zip, snapshot->m_images, used, snapshot->m_compressImages,
+                      snapshot->m_oldFile))
+    return false;
+
+  if(!zip.Close())
+    return false;
+  if (!out.Close())
+    return false;
+
+  return ReplaceWXMXFile(backupfile, snapshot->m_file);
 }
 
 /**!
@@ -5141,13 +5670,64 @@ void MathCtrl::TreeUndo_LimitUndoBuffer()
 {
   
   wxConfigBase *config = wxConfig::Get();
-  int undoLimit;
+  int undoLimit = 0;
   config->Read(wxT("undoLimit"),&undoLimit);
 
-  if(undoLimit == 0)
+  if(undoLimit > 0)
+  {
+    while(treeUndoActions.size() > undoLimit)
+      TreeUndo_DiscardAction(&treeUndoActions);
+  }
+
+  int undoMemoryLimit = 64;
+  config->Read(wxT("undoMemoryLimit"),&undoMemoryLimit);
+  if(undoMemoryLimit <= 0)
+    return;
+  long budget = long(undoMemoryLimit) * 1024 * 1024;
+
+  long size = 0;
+  for(std::list <TreeUndoAction *>::iterator it = treeUndoActions.begin();
+      it != treeUndoActions.end(); ++it)
+    size += TreeUndo_ActionSize(*it);
+  if(size <= budget)
     return;
-  while(treeUndoActions.size() > undoLimit)
+
+  // First discard the output of the cells the oldest actions have deleted.
+  // The newest action is kept intact as it is the one that will be undone next.
+  for(std::list <TreeUndoAction *>::reverse_iterator it = treeUndoActions.rbegin();
+      (size > budget) && (*it != treeUndoActions.front()); ++it)
+  {
+    if((*it)->m_oldCells == NULL)
+      continue;
+
+    size -= TreeUndo_ActionSize(*it);
+    GroupCell *tmp = (*it)->m_oldCells;
+    while(tmp != NULL)
+    {
+      tmp->RemoveOutput();
+      tmp = dynamic_cast<GroupCell*>(tmp->m_next);
+    }
+    (*it)->m_size = -1;
+    size += TreeUndo_ActionSize(*it);
+  }
+
+  // If that didn't suffice we have to forget the oldest actions.
+  while((size > budget) && (treeUndoActions.size() > 1))
+  {
+    size -= TreeUndo_ActionSize(treeUndoActions.back());
     TreeUndo_DiscardAction(&treeUndoActions);
+  }
+}
+
+long MathCtrl::TreeUndo_ActionSize(TreeUndoAction *action)
+{
+  if(action->m_size < 0)
+  {
+    action->m_size = sizeof(TreeUndoAction) + action->m_oldText.Length() * sizeof(wxChar);
+    if(action->m_oldCells)
+      action->m_size += action->m_oldCells->SizeInMemoryList();
+  }
+  return action->m_size;
 }
 
 bool MathCtrl::CanTreeUndo(){
@@ -5527,14 +6107,8 @@ void MathCtrl::PasteFromClipboard(bool primary)
       if (inputs.StartsWith(wxT("/* [wxMaxima: ")))
       {
 
-        // Convert the text from the clipboard into an array of lines
-        wxStringTokenizer lines(inputs, wxT("\n"));
-        wxArrayString lines_array;
-        while(lines.HasMoreTokens())
-          lines_array.Add(lines.GetNextToken());
-
-        // Load the array like we would do with a .wxm file
-        GroupCell *contents = CreateTreeFromWXMCode(&lines_array);
+        // Load the text like we would do with a .wxm file
+        GroupCell *contents = CreateTreeFromWXMCode(inputs);
         
         // Add the result of the last operation to the worksheet.
         if(contents)
@@ -6491,6 +7065,7 @@ void MathCtrl::OnFollow()
 BEGIN_EVENT_TABLE(MathCtrl, wxScrolledCanvas)
   EVT_MENU_RANGE(popid_complete_00, popid_complete_00 + AC_MENU_LENGTH, MathCtrl::OnComplete)
   EVT_SIZE(MathCtrl::OnSize)
+  EVT_IDLE(MathCtrl::OnIdle)
   EVT_PAINT(MathCtrl::OnPaint)
   EVT_LEFT_UP(MathCtrl::OnMouseLeftUp)
   EVT_LEFT_DOWN(MathCtrl::OnMouseLeftDown)
@@ -6502,6 +7077,8 @@ BEGIN_EVENT_TABLE(MathCtrl, wxScrolledCanvas)
   EVT_TIMER(TIMER_ID, MathCtrl::OnTimer)
   EVT_TIMER(CARET_TIMER_ID, MathCtrl::OnTimer)
   EVT_TIMER(ANIMATION_TIMER_ID, MathCtrl::OnTimer)
+  EVT_TIMER(RESIZE_TIMER_ID, MathCtrl::OnTimer)
+  EVT_TIMER(ZOOM_TIMER_ID, MathCtrl::OnTimer)
   EVT_KEY_DOWN(MathCtrl::OnKeyDown)
   EVT_CHAR(MathCtrl::OnChar)
   EVT_ERASE_BACKGROUND(MathCtrl::OnEraseBackground)
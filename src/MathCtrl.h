@@ -27,17 +27,84 @@
 #include <wx/aui/aui.h>
 #include <wx/textfile.h>
 #include <wx/fdrepdlg.h>
+#include <wx/txtstrm.h>
 #include <list>
 
 #include "MathCell.h"
 #include "EditorCell.h"
 #include "GroupCell.h"
+#include "ImgCell.h"
+#include "WXMXJournal.h"
+#include "WXMReader.h"
+#include "WorkerPool.h"
 #include "EvaluationQueue.h"
 #include "Autocomplete.h"
 #include "AutocompletePopup.h"
 #include "Structure.h"
 #include "ToolBar.h"
 
+/*! Everything a .wxmx file consists of
+
+  Shares no data with the worksheet that could change while a background thread
+  writes the snapshot to a file.
+ */
+class WXMXSnapshot
+{
+public:
+  //! The file the snapshot is to be written to
+  wxString m_file;
+  //! The contents of content.xml, utf-8 encoded
+  wxMemoryBuffer m_xml;
+  //! The images the file contains
+  WXMXImageList m_images;
+  //! The indices of these images in the list of images of the worksheet's file
+  std::vector<size_t> m_usedImages;
+  //! The id of the list m_usedImages refers to. See WXMXImageList::GetId().
+  long m_imageListId;
+  //! The file the images that haven't changed can be copied from or an empty string
+  wxString m_oldFile;
+  //! Shall the images be compressed?
+  bool m_compressImages;
+  //! The state the recovery journal needs to be restarted with once the file is written
+  WXMXJournal::State m_journalState;
+};
+
+/*! The images of the .wxmx file the worksheet has been loaded from or saved to
+
+  The images keep their names across saves. Images that haven't changed
+  since the file has been written therefore can be copied from the old file
+  instead of being written anew, and the xml of cells that haven't changed can
+  be reused.
+ */
+class WXMXFileImages
+{
+public:
+  WXMXFileImages() : m_images(wxT("image"), true) {}
+  //! All images that have been given a name so far
+  WXMXImageList m_images;
+  //! Remember which images a file that has just been loaded contains
+  void Loaded(wxString file, WXMXArchive &archive);
+  /*! Remember that a file has been written
+
+    \param file The file
+    \param used The indices of the images in m_images the file contains
+   */
+  void Saved(wxString file, const std::vector<size_t> &used);
+  //! Does the file still contain the images Loaded() or Saved() know of?
+  bool Matches(wxString file);
+  //! Forget about the file and its images
+  void Forget();
+private:
+  //! Remember the size and modification time of m_file
+  void Stamp();
+  //! The file
+  wxString m_file;
+  //! The modification time of the file when it was written or loaded
+  wxLongLong m_modificationTime;
+  //! The size of the file when it was written or loaded
+  wxULongLong m_size;
+};
+
 /*! The canvas that contains the spreadsheet the whole program is about.
 
 This canvas contains all the math-, title-, image- input- ("editor-")- etc.- 
@@ -66,6 +133,19 @@ private:
   size_t m_lastTop;
   //! The last ending for the area being drawn
   size_t m_lastBottom;
+  //! Does the user want us to compress the images in .wxmx files?
+  static bool WXMXCompressImages();
+  //! The start of content.xml: Everything up to the worksheet's cells
+  wxString WXMXDocumentStart();
+  /*! Write content.xml, the xml representation of the whole worksheet
+
+    The xml is written cell by cell instead of assembling it in memory first.
+    \param output The stream to write the xml to
+    \param images The list the image cells add the images they contain to
+   */
+  void WriteWXMXContent(wxTextOutputStream &output, WXMXImageList &images);
+  //! Converts the rest of a wxm description into cells. Stops at the end of a fold.
+  GroupCell* CreateTreeFromWXMCode(WXMReader &wxm);
   /*! \defgroup UndoBufferFill
 
     These methods and classes contain the undo functionality for tree changes:
@@ -95,6 +175,7 @@ private:
           m_oldText=wxEmptyString;
           m_newCellsEnd=NULL;
           m_oldCells=NULL;
+          m_size=-1;
         }
       
       TreeUndoAction(){ Clear(); }
@@ -129,6 +210,12 @@ private:
         If this field's value is NULL no cells have to be added to undo this action.
       */
       GroupCell *m_oldCells;
+
+      /*! The number of bytes this action occupies in memory
+
+        -1 = Not known yet. See TreeUndo_ActionSize().
+      */
+      long m_size;
     };
 
   //! The list of tree actions that can be undone
@@ -152,9 +239,19 @@ private:
    */  
   GroupCell *TreeUndo_ActiveCell;
 
-  //! Drop actions from the back of the undo list until itis within the undo limit.
+  /*! Drop actions from the back of the undo list until it is within the undo limit.
+
+    There is a limit for the number of actions (config key undoLimit) and one for
+    the memory the undo list may occupy (undoMemoryLimit, in megabytes). If the
+    latter is exceeded the output of the cells the oldest actions have deleted
+    is discarded first (it can be recreated by re-evaluating these cells) and
+    only if that doesn't suffice the oldest actions are dropped.
+  */
   void TreeUndo_LimitUndoBuffer();
 
+  //! The number of bytes an undo action occupies in memory
+  long TreeUndo_ActionSize(TreeUndoAction *action);
+
   /*! Undo an item from a list of undo actions.
 
     \param actionlist The list to take the undo information from
@@ -268,7 +365,9 @@ private:
   {
     TIMER_ID,
     CARET_TIMER_ID,
-    ANIMATION_TIMER_ID
+    ANIMATION_TIMER_ID,
+    RESIZE_TIMER_ID,
+    ZOOM_TIMER_ID
   };
 
   //! Add a line to a file.
@@ -303,7 +402,23 @@ private:
     of this class.
    */
   void OnPaint(wxPaintEvent& event);
+  /*! Scroll the window contents
+
+    Overrides wxWindow::ScrollWindow() in order to move the contents of 
+    m_memory, too: This way OnPaint() only needs to draw the strip that has
+    been scrolled into view, not the whole window.
+   */
+  void ScrollWindow(int dx, int dy, const wxRect *rect = NULL);
+  /*! Is called when the window size changes
+
+    Only starts m_resizeTimer so a window border that is dragged doesn't cause
+    a relayout for every intermediate size.
+   */
   void OnSize(wxSizeEvent& event);
+  //! Break the lines of the worksheet anew after the window width has changed.
+  void RecalculateForNewWidth();
+  //! Lays out cells that only know an estimate of their size while we are idle.
+  void OnIdle(wxIdleEvent& event);
   void OnMouseRightDown(wxMouseEvent& event);
   void OnMouseLeftUp(wxMouseEvent& event);
   void OnMouseLeftDown(wxMouseEvent& event);
@@ -433,12 +548,34 @@ private:
    */
   bool m_editingEnabled;
   wxTimer m_timer, m_caretTimer, m_animationTimer;
+  //! Runs while the window size still changes
+  wxTimer m_resizeTimer;
+  /*! true = Recalculate() has left cells with only an estimate of their size
+
+    Is reset by OnIdle() as soon as it finds no more such cell.
+   */
+  bool m_layoutPending;
+  //! Runs while the zoom factor still changes
+  wxTimer m_zoomTimer;
   //! True only when an animation is running
   bool m_animate;
+  //! The backing store OnPaint() draws the worksheet to
   wxBitmap *m_memory;
+  //! A spare bitmap of the size of m_memory ScrollWindow() copies the contents of m_memory to
+  wxBitmap *m_scrollMemory;
+  //! The parts of m_memory that need to be drawn anew, in window coordinates
+  wxRegion m_memoryDirty;
   //! True if no changes have to be saved.
   bool m_saved;
   double m_zoomFactor;
+  /*! The zoom factor the current layout of the worksheet has been calculated for
+
+    Differs from m_zoomFactor only while the user is still zooming: In this case
+    the layout is drawn scaled by DisplayScale().
+   */
+  double m_layoutZoomFactor;
+  //! How much the layout has to be scaled in order to display it at the current zoom factor
+  double DisplayScale() { return m_zoomFactor / m_layoutZoomFactor; }
   AutoComplete m_autocomplete;
   wxArrayString m_completions;
   bool m_autocompleteTemplates;
@@ -575,7 +712,41 @@ public:
     the line is appended to m_last, instead.
   */
   void InsertLine(MathCell *newLine, bool forceNewLine = false);
+  /*! Recalculate the size and position of all cells
+
+    Only the cells near the visible part of the worksheet are actually laid
+    out. All others that would need to be laid out only get an estimated size
+    that is replaced by the real one by LayOutEstimatedCellsInView() as soon as
+    they come near the viewport.
+
+    \param force true = lay out the cells even if nothing seems to have changed
+    since the last layout, for example after a font change.
+   */
   void Recalculate(bool force = false);  
+  /*! Request the window (or the part "rect" of it) to be drawn anew
+
+    Overrides wxWindow::Refresh() in order to mark the region as outdated in
+    the backing store OnPaint() draws to. RefreshRect() calls this function, too.
+   */
+  void Refresh(bool eraseBackground = true, const wxRect *rect = NULL);
+  /*! Replace the estimated sizes of all cells near the viewport by their real sizes
+
+    \return true, if this has changed the vertical position of what is visible in
+    the viewport and the view has been scrolled in order to compensate for that.
+   */
+  bool LayOutEstimatedCellsInView();
+  /*! Replace the estimated sizes of cells by their real sizes
+
+    \param top The top of the area of the worksheet the cells to lay out are in
+    \param bottom The bottom of this area
+    \param maxCells The maximum number of cells to lay out, -1 = no limit
+    \param scrolled Is set to true, if the view had to be scrolled in order to keep
+    the visible part of the worksheet in place
+    \return The number of cells that have been laid out
+   */
+  int LayOutEstimatedCells(int top, int bottom, int maxCells, bool *scrolled);
+  //! The part of the worksheet that Recalculate() actually lays out
+  void GetLazyLayoutRange(int *top, int *bottom);
   void RecalculateForce() {
     Recalculate(true);
   }
@@ -675,7 +846,13 @@ public:
   //! Copy a bitmap of the current selection to the clipboard
   bool CopyBitmap();
   wxSize CopyToFile(wxString file);
-  wxSize CopyToFile(wxString file, MathCell* start, MathCell* end, bool asData = false,int scale=1);
+  /*! Export a part of the worksheet to a bitmap file
+
+    \param pool If not NULL: Leave compressing a .png file to this pool. See
+    Bitmap::ToFile().
+   */
+  wxSize CopyToFile(wxString file, MathCell* start, MathCell* end, bool asData = false,int scale=1,
+                    WorkerPool *pool = NULL);
   void CalculateReorderedCellIndices(MathCell *tree, int &cellIndex, std::vector<int>& cellMap);
   //! Export the file to an html document
   bool ExportToHTML(wxString file);
@@ -688,7 +865,34 @@ public:
     \param markAsSaved false means that this action doesn't clear the 
                              worksheet's "modified" status.
   */
-  bool ExportToWXMX(wxString file, bool markAsSaved = true);	
+  bool ExportToWXMX(wxString file, bool markAsSaved = true);
+  /*! Create a copy of everything a .wxmx file of the worksheet would contain
+
+    Converting the worksheet to xml is fast compared to compressing and writing
+    it => This allows to do the slow part in a background thread.
+    The caller is responsible for deleting the snapshot.
+  */
+  WXMXSnapshot *CreateWXMXSnapshot(wxString file);
+  /*! Write a snapshot CreateWXMXSnapshot() has created to its file
+
+    Doesn't access the worksheet and therefore can be called from a background
+    thread.
+  */
+  static bool WriteWXMXSnapshot(WXMXSnapshot *snapshot);
+  /*! To be called after a snapshot has successfully been written
+
+    Restarts the recovery journal relative to the new file contents and
+    remembers which images the file now contains.
+  */
+  void WXMXSnapshotSaved(WXMXSnapshot *snapshot);
+  //! To be called after a .wxmx file has been loaded into the worksheet
+  void WXMXLoaded(wxString file, WXMXArchive &archive) { m_wxmxImages.Loaded(file, archive); }
+  //! The recovery journal of the current .wxmx file
+  WXMXJournal m_journal;	
+private:
+  //! The images of the current .wxmx file
+  WXMXFileImages m_wxmxImages;
+public:
   //! export to a LaTeX file
   bool ExportToTeX(wxString file);
   /*! Convert the current selection to a string 
@@ -839,7 +1043,16 @@ public:
   GroupCell *TearOutTree(GroupCell *start, GroupCell *end);
   // methods for zooming the document in and out
   double GetZoomFactor() { return m_zoomFactor; }
+  /*! Set the zoom factor
+
+    \param newzoom The new zoom factor
+    \param recalc true = lay out the worksheet for the new zoom factor as soon as
+    the zoom factor has stopped changing. Until then the existing layout is 
+    drawn scaled.
+   */
   void SetZoomFactor(double newzoom, bool recalc = true);
+  //! Lay out the worksheet for the current zoom factor
+  void RecalculateForNewZoom();
   void CommentSelection();
   //! Called if the user is scrolling through the document.
   void OnScrollChanged(wxScrollEvent &ev);
@@ -885,7 +1098,7 @@ public:
   */
   bool QuestionPending(){return m_questionPrompt;}
   //! Converts a wxm description into individual cells
-  GroupCell* CreateTreeFromWXMCode(wxArrayString *wxmLines);
+  GroupCell* CreateTreeFromWXMCode(const wxString &wxm);
 
     /*! Does maxima wait for the answer of a question?
 
@@ -72,24 +72,17 @@ wxXmlNode* MathParser::GetNextTag(wxXmlNode* node)
   return SkipWhitespaceNode(node);
 }
 
-MathParser::MathParser(wxString zipfile)
+MathParser::MathParser(WXMXArchive *archive)
 {
   m_workingDirectory = wxEmptyString;
   m_ParserStyle = MC_TYPE_DEFAULT;
   m_FracStyle = FracCell::FC_NORMAL;
   m_highlight = false;
-  if (zipfile.Length() > 0) {
-    m_fileSystem = new wxFileSystem();
-    m_fileSystem->ChangePathTo(zipfile + wxT("#zip:/"), true);
-  }
-  else
-    m_fileSystem = NULL;
+  m_archive = archive;
 }
 
 MathParser::~MathParser()
 {
-  if (m_fileSystem)
-    delete m_fileSystem;
 }
 
 // ParseCellTag
@@ -908,8 +901,8 @@ MathCell* MathParser::ParseTag(wxXmlNode* node, bool all)
         filename = filename1;
 #endif
 
-        if (m_fileSystem) // loading from zip
-          imageCell = new ImgCell(filename, false, m_fileSystem);
+        if (m_archive) // loading from zip
+          imageCell = new ImgCell(filename, false, m_archive);
         else
         {
           if (node->GetAttribute(wxT("del"), wxT("yes")) != wxT("no"))
@@ -936,7 +929,7 @@ MathCell* MathParser::ParseTag(wxXmlNode* node, bool all)
       }
       else if (tagName == wxT("slide"))
       {
-        SlideShow *slideShow = new SlideShow(m_fileSystem);
+        SlideShow *slideShow = new SlideShow(m_archive);
         wxString str(node->GetChildren()->GetContent());
         wxArrayString images;
         wxString framerate;
@@ -29,8 +29,7 @@ The header file for the xml cell parser
 
 #include <wx/xml/xml.h>
 
-#include <wx/filesys.h>
-#include <wx/fs_arc.h>
+#include "WXMXArchive.h"
 
 #include "MathCell.h"
 #include "TextCell.h"
@@ -43,7 +42,12 @@ inside a wxmx file
 class MathParser
 {
 public:
-  MathParser(wxString zipfile = wxEmptyString);
+  /*! The constructor
+
+    \param archive The .wxmx archive the images are to be read from or NULL.
+    It is owned by the caller and has to outlive the parser.
+   */
+  MathParser(WXMXArchive *archive = NULL);
   void SetWorkingDirectory(wxString dir) {m_workingDirectory = dir;};
   ~MathParser();
   MathCell* ParseLine(wxString s, int style = MC_TYPE_DEFAULT);
@@ -104,7 +108,7 @@ private:
   //! The maximum number of digits of a number that is to be displayed
   int m_displayedDigits;
   bool m_highlight;
-  wxFileSystem *m_fileSystem; // used for loading pictures in <img> and <slide>
+  WXMXArchive *m_archive; // used for loading pictures in <img> and <slide>
 };
 
 #endif // MATHPARSER_H
@@ -284,7 +284,7 @@ wxString MatrCell::ToMathML()
   return retval;
 }
 
-wxString MatrCell::ToXML()
+wxString MatrCell::ToXML(WXMXImageList &images)
 {
   wxString s = wxEmptyString;
   if (m_specialMatrix)
@@ -300,7 +300,7 @@ for (int i = 0; i < m_matHeight; i++)
   {
     s += wxT("<mtr>");
     for (int j = 0; j < m_matWidth; j++)
-      s += wxT("<mtd>") + m_cells[i * m_matWidth + j]->ListToXML() + wxT("</mtd>");
+      s += wxT("<mtd>") + m_cells[i * m_matWidth + j]->ListToXML(images) + wxT("</mtd>");
     s += wxT("</mtr>");
   }
   s += wxT("</tb>");
@@ -55,7 +55,7 @@ public:
   wxString ToString();
   wxString ToTeX();
   wxString ToMathML();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   void SetSpecialFlag(bool special) { m_specialMatrix = special; }
   void SetInferenceFlag(bool inference) { m_inferenceMatrix = inference; }
   void SetParent(MathCell *parent);
@@ -466,11 +466,11 @@ wxString ParenCell::ToMathML()
     );
 }
 
-wxString ParenCell::ToXML()
+wxString ParenCell::ToXML(WXMXImageList &images)
 {
 //  if( m_isBroken )
 //    return wxEmptyString;
-  wxString s = m_innerCell->ListToXML();
+  wxString s = m_innerCell->ListToXML(images);
   return ( ( m_print )? _T("<p>") + s + _T("</p>") : s );
 }
 
@@ -21,21 +21,20 @@
 
 #include "SlideShowCell.h"
 #include "ImgCell.h"
+#include "GroupCell.h"
 
 #include <wx/file.h>
 #include <wx/filename.h>
-#include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <wx/utils.h>
 #include <wx/clipbrd.h>
 #include <wx/config.h>
 #include "wx/config.h"
 
-SlideShow::SlideShow(wxFileSystem *filesystem,int framerate) : MathCell()
+SlideShow::SlideShow(WXMXArchive *archive,int framerate) : MathCell()
 {
   m_size = m_displayed = 0;
   m_type = MC_TYPE_SLIDE;
-  m_fileSystem = filesystem; // NULL when not loading from wxmx
+  m_archive = archive; // NULL when not loading from wxmx
   m_framerate = framerate;
   m_imageBorderWidth = 1;
   m_drawBoundingBox = false;
@@ -85,13 +84,13 @@ void SlideShow::LoadImages(wxArrayString images)
 {
   m_size = images.GetCount();
 
-  if (m_fileSystem) {
+  if (m_archive) {
     for (int i=0; i<m_size; i++)
     {
-      Image *image =new Image(images[i],false,m_fileSystem);
+      Image *image =new Image(images[i],false,m_archive);
       m_images.push_back(image);
     }
-    m_fileSystem = NULL;
+    m_archive = NULL;
   }
   else
     for (int i=0; i<m_size; i++)
@@ -136,6 +135,11 @@ void SlideShow::SetDisplayedIndex(int ind)
     m_displayed = ind;
   else
     m_displayed = m_size - 1;
+
+  // The cached rendering of our cell now shows the wrong image.
+  GroupCell *group = dynamic_cast<GroupCell *>(m_group);
+  if (group != NULL)
+    group->InvalidateSurface();
 }
 
 void SlideShow::RecalculateWidths(CellParser& parser, int fontsize)
@@ -204,29 +208,18 @@ wxString SlideShow::ToTeX()
   return wxT(" << Graphics >> ");
 }
 
-wxString SlideShow::ToXML()
+wxString SlideShow::ToXML(WXMXImageList &images)
 {
-  wxString images;
+  wxString files;
 
   for (int i=0; i<m_size; i++) {
-    wxString basename = ImgCell::WXMXGetNewFileName();
-    // add the file to memory
-    if(m_images[i])
-    {
-      if(m_images[i]->GetCompressedImage())
-        wxMemoryFSHandler::AddFile(basename+m_images[i] -> GetExtension(),
-                                   m_images[i]->GetCompressedImage().GetData(),
-                                   m_images[i]->GetCompressedImage().GetDataLen()
-          );
-    }
-
-    images += basename + m_images[i] -> GetExtension()+wxT(";");
+    files += images.Add(m_images[i]) + wxT(";");
   }
 
   if(m_framerate<0)
-    return wxT("\n<slide>") + images + wxT("</slide>");
+    return wxT("\n<slide>") + files + wxT("</slide>");
   else
-    return wxT("\n<slide fr=\"")+ wxString::Format(wxT("%i\">"),GetFrameRate()) + images + wxT("</slide>");
+    return wxT("\n<slide fr=\"")+ wxString::Format(wxT("%i\">"),GetFrameRate()) + files + wxT("</slide>");
 }
 
 wxSize SlideShow::ToImageFile(wxString file)
@@ -297,6 +290,15 @@ void SlideShow::ClearCache()
       m_images[i]->ClearCache();
 }
 
+size_t SlideShow::SizeInMemory()
+{
+  size_t size = sizeof(SlideShow);
+  for(int i=0;i<m_images.size();i++)
+    if(m_images[i] != NULL)
+      size += m_images[i]->SizeInMemory();
+  return size;
+}
+
 bool SlideShow::CopyToClipboard()
 {
   if (wxTheClipboard->Open())
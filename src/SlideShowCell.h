@@ -26,8 +26,7 @@
 #include "Image.h"
 #include <wx/image.h>
 
-#include <wx/filesys.h>
-#include <wx/fs_arc.h>
+#include "WXMXArchive.h"
 
 #include <vector>
 
@@ -38,11 +37,12 @@ class SlideShow : public MathCell
 public:
   /*! The constructor
 
+    \param archive The .wxmx archive the images are to be read from or NULL
     \param framerate The individual frame rate that has to be set for this cell only. 
     If the default frame rate from the config is to be used instead this parameter 
     has to be set to -1.
    */
-  SlideShow(wxFileSystem *filesystem = NULL,int framerate = -1);
+  SlideShow(WXMXArchive *archive = NULL,int framerate = -1);
   ~SlideShow();
   /*! Remove all cached scaled images from memory
 
@@ -50,6 +50,7 @@ public:
     of the screen; The bitmaps will be re-generated when needed.
    */
   virtual void ClearCache();
+  size_t SizeInMemory();
   void Destroy();
   void LoadImages(wxArrayString images);
   MathCell* Copy();
@@ -86,14 +87,15 @@ protected:
   int m_framerate;
   int m_size;
   int m_displayed;
-  wxFileSystem *m_fileSystem;
+  //! The archive LoadImages() reads the images from. NULL when not loading from wxmx.
+  WXMXArchive *m_archive;
   vector<Image*> m_images;
   void RecalculateSize(CellParser& parser, int fontsize);
   void RecalculateWidths(CellParser& parser, int fontsize);
   void Draw(CellParser& parser, wxPoint point, int fontsize);
   wxString ToString();
   wxString ToTeX();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   virtual void DrawBoundingBox(wxDC& dc, bool all = false)
     {
       m_drawBoundingBox = true;
@@ -262,11 +262,11 @@ wxString SqrtCell::ToMathML()
   return wxT("<msqrt>") + m_innerCell->ListToMathML() +wxT("</msqrt>\n");
 }
 
-wxString SqrtCell::ToXML()
+wxString SqrtCell::ToXML(WXMXImageList &images)
 {
 //  if (m_isBroken)
 //    return wxEmptyString;
-  return _T("<q>") + m_innerCell->ListToXML() + _T("</q>");
+  return _T("<q>") + m_innerCell->ListToXML(images) + _T("</q>");
 }
 
 void SqrtCell::SelectInner(wxRect& rect, MathCell **first, MathCell **last)
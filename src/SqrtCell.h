@@ -41,7 +41,7 @@ public:
   wxString ToString();
   wxString ToTeX();
   wxString ToMathML();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   void SetParent(MathCell *parent);
 protected:
   MathCell *m_innerCell;
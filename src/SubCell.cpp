@@ -166,15 +166,15 @@ wxString SubCell::ToMathML()
     wxT("</msub>\n");
 }
 
-wxString SubCell::ToXML()
+wxString SubCell::ToXML(WXMXImageList &images)
 {
   if (m_altCopyText == wxEmptyString)
   {
-    return _T("<i><r>") + m_baseCell->ListToXML() + _T("</r><r>") +
-      m_indexCell->ListToXML() + _T("</r></i>");
+    return _T("<i><r>") + m_baseCell->ListToXML(images) + _T("</r><r>") +
+      m_indexCell->ListToXML(images) + _T("</r></i>");
   }
-  return _T("<i altCopy=\"" + m_altCopyText + "\"><r>") + m_baseCell->ListToXML() + _T("</r><r>") +
-      m_indexCell->ListToXML() + _T("</r></i>");
+  return _T("<i altCopy=\"" + m_altCopyText + "\"><r>") + m_baseCell->ListToXML(images) + _T("</r><r>") +
+      m_indexCell->ListToXML(images) + _T("</r></i>");
 }
 
 void SubCell::SelectInner(wxRect& rect, MathCell **first, MathCell **last)
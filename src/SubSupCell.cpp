@@ -208,11 +208,11 @@ wxString SubSupCell::ToMathML()
     wxT("</msubsup>\n");
 }
 
-wxString SubSupCell::ToXML()
+wxString SubSupCell::ToXML(WXMXImageList &images)
 {
-  return _T("<ie><r>") + m_baseCell->ListToXML()
-    + _T("</r><r>") + m_exptCell->ListToXML()
-    + _T("</r><r>") + m_indexCell->ListToXML()
+  return _T("<ie><r>") + m_baseCell->ListToXML(images)
+    + _T("</r><r>") + m_exptCell->ListToXML(images)
+    + _T("</r><r>") + m_indexCell->ListToXML(images)
     + _T("</r></ie>");
 }
 
@@ -319,7 +319,7 @@ wxString SumCell::ToTeX()
   return s;
 }
 
-wxString SumCell::ToXML()
+wxString SumCell::ToXML(WXMXImageList &images)
 {
   wxString type(wxT("sum"));
 
@@ -328,9 +328,9 @@ wxString SumCell::ToXML()
   else if (m_over->ListToString() == wxEmptyString)
     type = wxT("lsum");
 
-  return _T("<sm type=\"") + type + wxT("\"><r>") + m_under->ListToXML() + _T("</r><r>") +
-    m_over->ListToXML() + _T("</r><r>") +
-    m_base->ListToXML() + _T("</r></sm>");
+  return _T("<sm type=\"") + type + wxT("\"><r>") + m_under->ListToXML(images) + _T("</r><r>") +
+    m_over->ListToXML(images) + _T("</r><r>") +
+    m_base->ListToXML(images) + _T("</r></sm>");
 }
 
 wxString SumCell::ToMathML()
@@ -103,13 +103,13 @@ void TextCell::RecalculateWidths(CellParser& parser, int fontsize)
     if ((m_textStyle == TS_LABEL) || (m_textStyle == TS_USERLABEL) || (m_textStyle == TS_MAIN_PROMPT)) {
 	  // Check for output annotations (/R/ for CRE and /T/ for Taylor expressions)
       if (m_text.Right(2) != wxT("/ "))
-        dc.GetTextExtent(wxT("(\%o")+LabelWidthText()+wxT(")"), &m_width, &m_height);
+        parser.GetTextExtent(wxT("(\%o")+LabelWidthText()+wxT(")"), &m_width, &m_height);
       else
-        dc.GetTextExtent(wxT("(\%o")+LabelWidthText()+wxT(")/R/"), &m_width, &m_height);
+        parser.GetTextExtent(wxT("(\%o")+LabelWidthText()+wxT(")/R/"), &m_width, &m_height);
       m_fontSizeLabel = m_fontSize;
       wxASSERT_MSG((m_width>0)||(m_text==wxEmptyString),_("The letter \"X\" is of width zero. Installing http://www.math.union.edu/~dpvc/jsmath/download/jsMath-fonts.html and checking \"Use JSmath fonts\" in the configuration dialogue should fix it."));
       if(m_width < 1) m_width = 10;
-      dc.GetTextExtent(m_text, &m_labelWidth, &m_labelHeight);
+      parser.GetTextExtent(m_text, &m_labelWidth, &m_labelHeight);
       wxASSERT_MSG((m_labelWidth>0)||(m_text==wxEmptyString),_("Seems like something is broken with the maths font. Installing http://www.math.union.edu/~dpvc/jsmath/download/jsMath-fonts.html and checking \"Use JSmath fonts\" in the configuration dialogue should fix it."));
       while ((m_labelWidth >= m_width)&&(m_fontSizeLabel > 2)) {
         int fontsize1 = (int) (((double) --m_fontSizeLabel) * scale + 0.5);
@@ -119,14 +119,14 @@ void TextCell::RecalculateWidths(CellParser& parser, int fontsize)
               false, //parser.IsUnderlined(m_textStyle),
               parser.GetFontName(m_textStyle),
               parser.GetFontEncoding()));
-        dc.GetTextExtent(m_text, &m_labelWidth, &m_labelHeight);
+        parser.GetTextExtent(m_text, &m_labelWidth, &m_labelHeight);
       }
     }
 
     /// Check if we are using jsMath and have jsMath character
     else if (m_altJs && parser.CheckTeXFonts())
     {
-      dc.GetTextExtent(m_altJsText, &m_width, &m_height);
+      parser.GetTextExtent(m_altJsText, &m_width, &m_height);
 
       if (m_texFontname == wxT("jsMath-cmsy10"))
         m_height = m_height / 2;
@@ -135,19 +135,19 @@ void TextCell::RecalculateWidths(CellParser& parser, int fontsize)
     /// We are using a special symbol
     else if (m_alt)
     {
-      dc.GetTextExtent(m_altText, &m_width, &m_height);
+      parser.GetTextExtent(m_altText, &m_width, &m_height);
     }
 
     /// Empty string has height of X
     else if (m_text == wxEmptyString)
     {
-      dc.GetTextExtent(wxT("X"), &m_width, &m_height);
+      parser.GetTextExtent(wxT("X"), &m_width, &m_height);
       m_width = 0;
     }
 
     /// This is the default.
     else
-      dc.GetTextExtent(m_text, &m_width, &m_height);
+      parser.GetTextExtent(m_text, &m_width, &m_height);
 
     m_width = m_width + 2 * SCALE_PX(MC_TEXT_PADDING, scale);
     m_height = m_height + 2 * SCALE_PX(MC_TEXT_PADDING, scale);
@@ -803,7 +803,7 @@ wxString TextCell::ToMathML()
   }
 }
 
-wxString TextCell::ToXML()
+wxString TextCell::ToXML(WXMXImageList &images)
 {
   wxString tag;
   wxString flags;
@@ -44,7 +44,7 @@ public:
   wxString ToString();
   wxString ToTeX();
   wxString ToMathML();
-  wxString ToXML();
+  wxString ToXML(WXMXImageList &images);
   wxString GetDiffPart();
   bool IsOperator();
   wxString GetValue() { return m_text; }
@@ -58,6 +58,11 @@ public:
   wxString GetSymbolSymbol(bool keepPercent);
 #endif
   bool IsShortNum();
+  size_t SizeInMemory()
+    {
+      return sizeof(TextCell) +
+        (m_text.Length() + m_altText.Length() + m_altJsText.Length()) * sizeof(wxChar);
+    }
 protected:
   void SetAltText(CellParser& parser);
   wxString m_text;
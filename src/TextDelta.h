@@ -0,0 +1,73 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef TEXTDELTA_H
+#define TEXTDELTA_H
+
+#include <wx/string.h>
+
+/*! The difference between two versions of a text
+
+  Only stores the part of the text that differs: Everything before m_pos and
+  everything after the changed part is the same in both versions. Used for
+  the undo history of editor cells.
+ */
+class TextDelta
+{
+public:
+  //! A difference that doesn't change anything
+  TextDelta() : m_pos(0) {}
+  //! The difference between oldText and newText
+  TextDelta(const wxString &oldText, const wxString &newText)
+    {
+      size_t oldLength = oldText.Length(), newLength = newText.Length();
+      size_t prefix = 0;
+      while ((prefix < oldLength) && (prefix < newLength) &&
+             (oldText[prefix] == newText[prefix]))
+        prefix++;
+      size_t suffix = 0;
+      while ((suffix < oldLength - prefix) && (suffix < newLength - prefix) &&
+             (oldText[oldLength - 1 - suffix] == newText[newLength - 1 - suffix]))
+        suffix++;
+      m_pos = prefix;
+      m_removed = oldText.Mid(prefix, oldLength - prefix - suffix);
+      m_inserted = newText.Mid(prefix, newLength - prefix - suffix);
+    }
+  //! Turn the old version of the text into the new one
+  void Apply(wxString &text) const
+    {
+      text.replace(m_pos, m_removed.Length(), m_inserted);
+    }
+  //! Turn the new version of the text into the old one
+  void Revert(wxString &text) const
+    {
+      text.replace(m_pos, m_inserted.Length(), m_removed);
+    }
+  //! The number of characters the difference stores
+  size_t Length() const { return m_removed.Length() + m_inserted.Length(); }
+  //! Where the versions of the text start to differ
+  size_t m_pos;
+  //! The text the old version has at m_pos
+  wxString m_removed;
+  //! The text the new version has at m_pos
+  wxString m_inserted;
+};
+
+#endif // TEXTDELTA_H
@@ -0,0 +1,97 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef WXMREADER_H
+#define WXMREADER_H
+
+#include <wx/string.h>
+
+/*! Reads the contents of a .wxm file line by line
+
+  Only remembers how far the text has been read instead of removing each line
+  that has been read from a list of lines: Doing so would move all lines that
+  follow which made loading a big file take quadratic time.
+ */
+class WXMReader
+{
+public:
+  WXMReader(const wxString &wxm) : m_pos(wxm.begin()), m_end(wxm.end())
+    {
+      m_eof = false;
+      Next();
+    }
+  //! Have all lines been read?
+  bool Eof() { return m_eof; }
+  //! The current line
+  const wxString &Line() { return m_line; }
+  //! Advance to the next line. Understands unix, dos and mac line endings.
+  void Next()
+    {
+      if (m_pos == m_end)
+      {
+        m_eof = true;
+        m_line = wxEmptyString;
+        return;
+      }
+      wxString::const_iterator lineStart = m_pos;
+      while ((m_pos != m_end) && (*m_pos != wxT('\n')) && (*m_pos != wxT('\r')))
+        ++m_pos;
+      m_line = wxString(lineStart, m_pos);
+      if (m_pos != m_end)
+      {
+        if (*m_pos == wxT('\r'))
+        {
+          ++m_pos;
+          if ((m_pos != m_end) && (*m_pos == wxT('\n')))
+            ++m_pos;
+        }
+        else
+          ++m_pos;
+      }
+    }
+  /*! Read all lines up to the line endMarker
+
+    \return The lines that have been read, separated by newlines. Empty lines
+    at the start are dropped.
+   */
+  wxString ReadUntil(wxString endMarker)
+    {
+      wxString text;
+      while ((!m_eof) && (m_line != endMarker))
+      {
+        if (text.Length() == 0)
+          text = m_line;
+        else
+        {
+          text += wxT("\n");
+          text += m_line;
+        }
+        Next();
+      }
+      return text;
+    }
+private:
+  wxString::const_iterator m_pos;
+  wxString::const_iterator m_end;
+  wxString m_line;
+  bool m_eof;
+};
+
+#endif // WXMREADER_H
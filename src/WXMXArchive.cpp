@@ -0,0 +1,241 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "WXMXArchive.h"
+
+#include <string.h>
+
+WXMXArchive::WXMXArchive(wxString file) : m_mappedFile(file)
+{
+  m_zip = NULL;
+  m_file = NULL;
+  m_storedEntry = NULL;
+  if ((!m_mappedFile.IsOk()) || (m_mappedFile.GetSize() == 0))
+    return;
+
+  m_file = new wxMemoryInputStream(m_mappedFile.GetData(), m_mappedFile.GetSize());
+
+  m_zip = new wxZipInputStream(*m_file);
+
+  // As the file is seekable this reads the zip's central directory instead of
+  // the whole file.
+  wxZipEntry *entry;
+  while ((entry = m_zip->GetNextEntry()) != NULL)
+  {
+    wxString name = entry->GetName(wxPATH_UNIX);
+    std::map<wxString, wxZipEntry *>::iterator it = m_entries.find(name);
+    if (it != m_entries.end())
+      delete it->second;
+    m_entries[name] = entry;
+  }
+
+  // A file that isn't a zip archive doesn't contain any entries.
+  if (m_entries.empty())
+    wxDELETE(m_zip);
+}
+
+WXMXArchive::~WXMXArchive()
+{
+  for (std::map<wxString, wxZipEntry *>::iterator it = m_entries.begin();
+       it != m_entries.end(); ++it)
+    delete it->second;
+  wxDELETE(m_storedEntry);
+  wxDELETE(m_zip);
+  wxDELETE(m_file);
+}
+
+bool WXMXArchive::Contains(wxString name)
+{
+  if (name.StartsWith(wxT("/")))
+    name = name.Mid(1);
+  return (m_entries.find(name) != m_entries.end()) ||
+    (m_memoryFiles.find(name) != m_memoryFiles.end());
+}
+
+wxInputStream *WXMXArchive::OpenEntry(wxString name)
+{
+  if (m_zip == NULL)
+    return NULL;
+
+  if (name.StartsWith(wxT("/")))
+    name = name.Mid(1);
+  std::map<wxString, wxZipEntry *>::iterator it = m_entries.find(name);
+  if (it == m_entries.end())
+    return NULL;
+
+  const char *data;
+  size_t size;
+  if (GetStoredEntry(name, data, size))
+  {
+    wxDELETE(m_storedEntry);
+    m_storedEntry = new wxMemoryInputStream(data, size);
+    return m_storedEntry;
+  }
+
+  if (!m_zip->OpenEntry(*it->second))
+    return NULL;
+  return m_zip;
+}
+
+//! Read a little-endian 16 bit number from a zip header
+static size_t ZipHeaderWord(const char *data)
+{
+  return size_t((unsigned char) data[0]) + (size_t((unsigned char) data[1]) << 8);
+}
+
+bool WXMXArchive::GetStoredEntry(wxString name, const char *&data, size_t &size)
+{
+  if (m_zip == NULL)
+    return false;
+
+  if (name.StartsWith(wxT("/")))
+    name = name.Mid(1);
+  std::map<wxString, wxZipEntry *>::iterator it = m_entries.find(name);
+  if (it == m_entries.end())
+    return false;
+  wxZipEntry *entry = it->second;
+  if ((entry->GetMethod() != wxZIP_METHOD_STORE) ||
+      (entry->GetCompressedSize() != entry->GetSize()) ||
+      (entry->GetOffset() == wxInvalidOffset))
+    return false;
+
+  // The file's data follows its local header which consists of 30 bytes,
+  // the file name and an extra field.
+  wxFileOffset header = entry->GetOffset();
+  const char *archive = m_mappedFile.GetData();
+  wxFileOffset archiveSize = m_mappedFile.GetSize();
+  if ((header < 0) || (header + 30 > archiveSize) ||
+      (memcmp(archive + header, "PK\x03\x04", 4) != 0))
+    return false;
+  wxFileOffset start = header + 30 +
+    ZipHeaderWord(archive + header + 26) + ZipHeaderWord(archive + header + 28);
+  if (start + entry->GetSize() > archiveSize)
+    return false;
+
+  data = archive + start;
+  size = entry->GetSize();
+  return true;
+}
+
+bool WXMXArchive::ReadEntry(wxString name, wxMemoryBuffer &data)
+{
+  if (name.StartsWith(wxT("/")))
+    name = name.Mid(1);
+
+  std::map<wxString, wxMemoryBuffer>::iterator file = m_memoryFiles.find(name);
+  if (file != m_memoryFiles.end())
+  {
+    data = file->second;
+    return true;
+  }
+
+  // Files that are stored uncompressed can be copied directly.
+  const char *stored;
+  size_t storedSize;
+  if (GetStoredEntry(name, stored, storedSize))
+  {
+    data.AppendData(stored, storedSize);
+    m_entriesRead[name] = data;
+    return true;
+  }
+
+  wxInputStream *entry = OpenEntry(name);
+  if (entry == NULL)
+    return false;
+
+  // The directory tells us how big the file is so we can read it in one go.
+  wxFileOffset size = entry->GetLength();
+  if (size == wxInvalidOffset)
+  {
+    char *buf = new char[8192];
+    while (entry->CanRead())
+    {
+      entry->Read(buf, 8192);
+      data.AppendData(buf, entry->LastRead());
+    }
+    delete [] buf;
+  }
+  else
+  {
+    entry->Read(data.GetAppendBuf(size), size);
+    data.UngetAppendBuf(entry->LastRead());
+    if (entry->LastRead() != size_t(size))
+      return false;
+  }
+  m_zip->CloseEntry();
+  m_entriesRead[name] = data;
+  return true;
+}
+
+/*! The CRC-32 zip archives store for each file
+
+  Computed the same way zlib's crc32() does.
+ */
+static wxUint32 ZipCrc32(const wxMemoryBuffer &data)
+{
+  static wxUint32 table[256];
+  static bool tableValid = false;
+  if (!tableValid)
+  {
+    for (wxUint32 i = 0; i < 256; i++)
+    {
+      wxUint32 c = i;
+      for (int bit = 0; bit < 8; bit++)
+        c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+      table[i] = c;
+    }
+    tableValid = true;
+  }
+
+  const unsigned char *buf = (const unsigned char *) data.GetData();
+  wxUint32 crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < data.GetDataLen(); i++)
+    crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+bool WXMXArchive::CanCopyEntry(wxString name, const wxMemoryBuffer &data, bool compressed)
+{
+  if (m_zip == NULL)
+    return false;
+
+  std::map<wxString, wxZipEntry *>::iterator it = m_entries.find(name);
+  if (it == m_entries.end())
+    return false;
+  wxZipEntry *entry = it->second;
+  if ((entry->GetSize() != wxFileOffset(data.GetDataLen())) ||
+      ((entry->GetMethod() == wxZIP_METHOD_STORE) == compressed))
+    return false;
+
+  // The name might have been given to a different image of the same size
+  // since the file was written: Only the checksum tells if the old file
+  // still contains this image.
+  return entry->GetCrc() == ZipCrc32(data);
+}
+
+bool WXMXArchive::CopyEntry(wxString name, wxZipOutputStream &zip)
+{
+  std::map<wxString, wxZipEntry *>::iterator it = m_entries.find(name);
+  if ((m_zip == NULL) || (it == m_entries.end()))
+    return false;
+
+  // CopyEntry() takes ownership of the entry.
+  return zip.CopyEntry(new wxZipEntry(*it->second), *m_zip);
+}
@@ -0,0 +1,122 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef WXMXARCHIVE_H
+#define WXMXARCHIVE_H
+
+#include <wx/wx.h>
+#include <wx/buffer.h>
+#include <wx/mstream.h>
+#include <wx/zipstrm.h>
+
+#include "MappedFile.h"
+
+#include <map>
+
+/*! Read access to the files a .wxmx archive contains
+
+  wxFileSystem's zip handler searches the archive for the file that is to be
+  opened each time a file is opened. For documents that contain hundreds of
+  images this means that the archive's directory is read hundreds of times.
+
+  This class reads the zip's central directory only once when the archive is
+  opened and then directly seeks to the entries that are requested.
+
+  The archive file is mapped into memory: Files that are stored in the archive
+  uncompressed are read directly from the mapping instead of being copied
+  through the zip stream first.
+ */
+class WXMXArchive
+{
+public:
+  //! Open the archive file and read its directory
+  WXMXArchive(wxString file);
+  ~WXMXArchive();
+  //! Could the archive be opened?
+  bool IsOk() { return m_zip != NULL; }
+  //! Does the archive contain a file of this name?
+  bool Contains(wxString name);
+  /*! Open a file inside the archive for reading
+
+    \return A stream the file can be read from that is valid until the next 
+    call to OpenEntry() or ReadEntry() or NULL, if there is no such file.
+   */
+  wxInputStream *OpenEntry(wxString name);
+  /*! Get a file the archive contains uncompressed without copying it
+
+    \param name The name of the file
+    \param data Is set to the start of the file inside the mapped archive.
+    Is valid as long as the archive is open.
+    \param size Is set to the size of the file.
+    \return false, if there is no such file or it is compressed.
+   */
+  bool GetStoredEntry(wxString name, const char *&data, size_t &size);
+  /*! Read a file inside the archive into a memory buffer
+
+    \return false, if there is no such file or it could not be read.
+   */
+  bool ReadEntry(wxString name, wxMemoryBuffer &data);
+  /*! Make a file ReadEntry() can read that isn't part of the archive file
+
+    Used for the images a recovery journal contains.
+   */
+  void AddFile(wxString name, const wxMemoryBuffer &data) { m_memoryFiles[name] = data; }
+  //! The files AddFile() has added, by their name
+  const std::map<wxString, wxMemoryBuffer> &GetAddedFiles() { return m_memoryFiles; }
+  /*! The files ReadEntry() has read from the archive file, by their name
+
+    Doesn't contain the files AddFile() has added.
+   */
+  const std::map<wxString, wxMemoryBuffer> &GetEntriesRead() { return m_entriesRead; }
+  /*! Can CopyEntry() copy this file?
+
+    \param name The name of the file
+    \param data The contents the file is expected to have. Only its size and
+    CRC are compared to the archive's directory: The file itself isn't read.
+    \param compressed Is the file expected to be compressed? Files that
+    aren't stored the way that is expected aren't copied.
+   */
+  bool CanCopyEntry(wxString name, const wxMemoryBuffer &data, bool compressed);
+  /*! Copy a file to another archive without uncompressing and compressing it again
+
+    Only to be used for files CanCopyEntry() has accepted.
+    \param name The name of the file
+    \param zip The archive to copy the file to
+    \return false, if the file wasn't copied.
+   */
+  bool CopyEntry(wxString name, wxZipOutputStream &zip);
+private:
+  //! The files ReadEntry() has read from the archive file
+  std::map<wxString, wxMemoryBuffer> m_entriesRead;
+  //! The files AddFile() has added
+  std::map<wxString, wxMemoryBuffer> m_memoryFiles;
+  //! The contents of the archive file
+  MappedFile m_mappedFile;
+  //! Reads the archive file from m_mappedFile
+  wxMemoryInputStream *m_file;
+  //! The stream OpenEntry() returns for files that are stored uncompressed
+  wxMemoryInputStream *m_storedEntry;
+  //! The archive, or NULL if it cannot be read
+  wxZipInputStream *m_zip;
+  //! The directory of the archive: All entries by their name
+  std::map<wxString, wxZipEntry *> m_entries;
+};
+
+#endif // WXMXARCHIVE_H
@@ -0,0 +1,212 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef WXMXIMAGELIST_H
+#define WXMXIMAGELIST_H
+
+#include <wx/wx.h>
+#include <wx/buffer.h>
+#include "Image.h"
+
+#include <vector>
+#include <map>
+#include <set>
+
+/*! The images a .wxmx file that is being written will contain
+
+  While the worksheet is converted to xml the image cells add their images to
+  this list and get the name of the file inside the archive in exchange.
+  The images aren't copied in this step as the image data is reference counted.
+  Images that share their data are added only once.
+
+  A list that is used for more than one save keeps the names of its images
+  stable. Such a list can be marked as cacheable: GroupCells then may remember
+  the xml they have generated for it and reuse it as long as they don't change.
+ */
+class WXMXImageList
+{
+public:
+  /*! \param prefix The file names of the images start with this string
+      \param cacheable true means: The GroupCells may cache the xml they generate
+      for this list. See IsCacheable().
+   */
+  WXMXImageList(wxString prefix = wxT("image"), bool cacheable = false)
+    {
+      m_prefix = prefix;
+      m_counter = 0;
+      m_cacheable = cacheable;
+      m_id = ++s_lists;
+    }
+  //! Add an image and return the name it will get in the .wxmx archive
+  wxString Add(Image *image)
+    {
+      return Add(image->GetCompressedImage(), image->GetExtension());
+    }
+  /*! Add the compressed data of an image and return the name it will get in the .wxmx archive
+
+    \param data The data
+    \param extension The file name extension that matches the format of the data
+   */
+  wxString Add(const wxMemoryBuffer &data, wxString extension)
+    {
+      std::map<void *, size_t>::iterator known = m_byData.find(data.GetData());
+      if((data.GetData() != NULL) && (known != m_byData.end()))
+      {
+        m_used.push_back(known->second);
+        return m_images[known->second].m_name;
+      }
+
+      // Don't reuse the name of an image AddFile() has added.
+      wxString name;
+      do
+      {
+        name = m_prefix;
+        name << ++m_counter << wxT(".") << extension;
+      } while(m_names.find(name) != m_names.end());
+      AddFile(name, data);
+      return name;
+    }
+  //! Add an image that already has got a name, for example in a file that has been loaded.
+  void AddFile(wxString name, const wxMemoryBuffer &data)
+    {
+      ImageFile file;
+      file.m_name = name;
+      file.m_data = data;
+      if(data.GetData() != NULL)
+        m_byData[data.GetData()] = m_images.size();
+      m_names.insert(name);
+      m_used.push_back(m_images.size());
+      m_images.push_back(file);
+    }
+  /*! Mark an image the list already contains as used, as Add() would do
+
+    \param data The address of the image's data
+    \param name The name the image is expected to have
+    \return false, if the list doesn't contain this image by this name.
+   */
+  bool MarkUsed(const void *data, const wxString &name)
+    {
+      std::map<void *, size_t>::iterator known = m_byData.find(const_cast<void *>(data));
+      if((data == NULL) || (known == m_byData.end()) ||
+         (m_images[known->second].m_name != name))
+        return false;
+      m_used.push_back(known->second);
+      return true;
+    }
+  /*! The indices of the images Add() has been called for since the last ClearUsed()
+
+    Tells which images a part of the worksheet refers to.
+   */
+  const std::vector<size_t> &GetUsed() { return m_used; }
+  //! Forget which images Add() has been called for.
+  void ClearUsed() { m_used.clear(); }
+  /*! Copy the images that are used at the moment to another list
+
+    The names are copied, not shared, so the copy can be handed to another thread.
+   */
+  void CopyUsed(WXMXImageList &dest)
+    {
+      std::vector<bool> copied(m_images.size(), false);
+      for(size_t i = 0; i < m_used.size(); i++)
+      {
+        if(copied[m_used[i]])
+          continue;
+        copied[m_used[i]] = true;
+        dest.AddFile(m_images[m_used[i]].m_name.Clone(), m_images[m_used[i]].m_data);
+      }
+      dest.ClearUsed();
+    }
+  /*! Drop all images but the ones with the given indices from the list
+
+    The remaining images keep their names but not necessarily their indices.
+   */
+  void Retain(const std::vector<size_t> &indices)
+    {
+      std::vector<bool> keep(m_images.size(), false);
+      for(size_t i = 0; i < indices.size(); i++)
+        if(indices[i] < keep.size())
+          keep[indices[i]] = true;
+
+      std::vector<ImageFile> images;
+      m_byData.clear();
+      m_names.clear();
+      for(size_t i = 0; i < m_images.size(); i++)
+        if(keep[i])
+        {
+          if(m_images[i].m_data.GetData() != NULL)
+            m_byData[m_images[i].m_data.GetData()] = images.size();
+          m_names.insert(m_images[i].m_name);
+          images.push_back(m_images[i]);
+        }
+      m_images = images;
+      m_used.clear();
+    }
+  /*! Drop all images
+
+    Xml that has been cached for this list before is no more valid afterwards.
+   */
+  void Clear()
+    {
+      m_images.clear();
+      m_byData.clear();
+      m_names.clear();
+      m_used.clear();
+      m_counter = 0;
+      m_id = ++s_lists;
+    }
+  //! The number of images in the list
+  size_t Count() { return m_images.size(); }
+  //! The file name of the nth image
+  const wxString &GetName(size_t n) { return m_images[n].m_name; }
+  /*! The compressed data of the nth image
+
+    Is returned as a reference so reading the data from another thread doesn't
+    touch the reference count of the buffer.
+   */
+  const wxMemoryBuffer &GetData(size_t n) { return m_images[n].m_data; }
+  //! May the GroupCells cache the xml they generate for this list?
+  bool IsCacheable() { return m_cacheable; }
+  /*! Identifies the list and the names it gives the images
+
+    Never is the same for two lists.
+   */
+  long GetId() { return m_id; }
+private:
+  struct ImageFile
+  {
+    wxString m_name;
+    wxMemoryBuffer m_data;
+  };
+  std::vector<ImageFile> m_images;
+  //! The index of each image in m_images by the address of its data
+  std::map<void *, size_t> m_byData;
+  //! The names of all images in m_images
+  std::set<wxString> m_names;
+  std::vector<size_t> m_used;
+  wxString m_prefix;
+  //! The number of names Add() has created
+  long m_counter;
+  bool m_cacheable;
+  long m_id;
+  //! The number of lists that have been created
+  static long s_lists;
+};
+
+#endif // WXMXIMAGELIST_H
@@ -0,0 +1,239 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "WXMXJournal.h"
+
+#include <wx/filename.h>
+#include <wx/wfstream.h>
+#include <wx/mstream.h>
+#include <wx/datstrm.h>
+
+#include <map>
+#include <algorithm>
+
+WXMXJournal::WXMXJournal() : m_images(wxT("journal_image"), true)
+{
+}
+
+WXMXJournal::CellVersion WXMXJournal::GetVersion(GroupCell *cell)
+{
+  EditorCell *editor = cell->GetEditable();
+  return CellVersion(cell->GetXMLVersion(), (editor == NULL) ? -1 : editor->GetTextVersion());
+}
+
+WXMXJournal::State WXMXJournal::GetState(GroupCell *tree)
+{
+  State state;
+  m_images.ClearUsed();
+  for (GroupCell *cell = tree; cell != NULL; cell = dynamic_cast<GroupCell *>(cell->m_next))
+  {
+    // Only determines which images the cells use.
+    cell->ToWXMX(m_images);
+    state.m_cells.push_back(GetVersion(cell));
+  }
+  state.m_images = m_images.GetUsed();
+  return state;
+}
+
+void WXMXJournal::Restart(wxString wxmxFile, const State &state)
+{
+  Discard();
+  // A journal that belongs to an older state of the file is of no use.
+  if (wxFileExists(JournalFile(wxmxFile)))
+    wxRemoveFile(JournalFile(wxmxFile));
+  m_file = wxmxFile;
+  m_cells = state.m_cells;
+
+  // Forget the images of cells that no more exist.
+  m_images.Retain(state.m_images);
+
+  // The file names of the images in the .wxmx file differ from the ones in
+  // the journal => A changed cell needs to append its images to the journal.
+  m_imageWritten.clear();
+  m_imageWritten.resize(m_images.Count(), false);
+}
+
+void WXMXJournal::Continue(wxString wxmxFile, GroupCell *tree, WXMXArchive &archive)
+{
+  if (m_file != wxmxFile)
+    Discard();
+
+  // The images of the journal are written already. GetState() assigns the
+  // images that are new to the journal names it doesn't use yet.
+  m_images.Clear();
+  AddReplayedImages(archive, m_images);
+  m_imageWritten.clear();
+  m_imageWritten.resize(m_images.Count(), true);
+  State state = GetState(tree);
+  m_imageWritten.resize(m_images.Count(), false);
+
+  m_file = wxmxFile;
+  m_cells = state.m_cells;
+}
+
+void WXMXJournal::Discard()
+{
+  if (m_file != wxEmptyString)
+  {
+    wxString journal = JournalFile(m_file);
+    if (wxFileExists(journal))
+      wxRemoveFile(journal);
+  }
+  m_file = wxEmptyString;
+  m_cells.clear();
+}
+
+bool WXMXJournal::WriteHeader()
+{
+  wxFileName source(m_file);
+  wxFFileOutputStream output(JournalFile(m_file));
+  if (!output.IsOk())
+    return false;
+  wxDataOutputStream data(output);
+  data.WriteString(JOURNAL_MAGIC);
+  data.Write32(JOURNAL_VERSION);
+  data.Write64(wxUint64(source.GetModificationTime().GetValue().GetValue()));
+  data.Write64(wxUint64(source.GetSize().GetValue()));
+  return output.Close();
+}
+
+bool WXMXJournal::Append(GroupCell *tree)
+{
+  if (!IsActive())
+    return false;
+
+  // The position of each cell in the last record. Only needed if cells have
+  // moved since then.
+  std::map<CellVersion, wxUint32> lastCells;
+
+  // The records for the new images
+  wxMemoryOutputStream images;
+  wxDataOutputStream imageData(images);
+  std::vector<size_t> newImages;
+  // The cells of the record that lists the cells
+  wxMemoryOutputStream cells;
+  wxDataOutputStream cellData(cells);
+
+  std::vector<CellVersion> newCells;
+  bool changed = false;
+  for (GroupCell *cell = tree; cell != NULL; cell = dynamic_cast<GroupCell *>(cell->m_next))
+  {
+    size_t pos = newCells.size();
+    newCells.push_back(GetVersion(cell));
+
+    // Changes of folded cells don't change the version of the cell they are
+    // folded into => Cells that contain folded cells are always written.
+    if (cell->GetHiddenTree() == NULL)
+    {
+      long last = -1;
+      if ((pos < m_cells.size()) && (m_cells[pos] == newCells[pos]))
+        last = pos;
+      else
+      {
+        if (lastCells.empty())
+          for (size_t i = 0; i < m_cells.size(); i++)
+            lastCells.insert(std::make_pair(m_cells[i], wxUint32(i)));
+        std::map<CellVersion, wxUint32>::iterator it = lastCells.find(newCells[pos]);
+        if (it != lastCells.end())
+        {
+          last = it->second;
+          changed = true;
+        }
+      }
+      if (last >= 0)
+      {
+        cellData.Write8(JOURNAL_CELL_UNCHANGED);
+        cellData.Write32(last);
+        continue;
+      }
+    }
+
+    changed = true;
+    m_images.ClearUsed();
+    cellData.Write8(JOURNAL_CELL_XML);
+    cellData.WriteString(cell->ToWXMX(m_images));
+
+    // Each image is written to the journal only once.
+    const std::vector<size_t> &used = m_images.GetUsed();
+    m_imageWritten.resize(m_images.Count(), false);
+    for (size_t i = 0; i < used.size(); i++)
+    {
+      if (m_imageWritten[used[i]] ||
+          (std::find(newImages.begin(), newImages.end(), used[i]) != newImages.end()))
+        continue;
+      newImages.push_back(used[i]);
+
+      const wxMemoryBuffer &image = m_images.GetData(used[i]);
+      wxMemoryOutputStream record;
+      wxDataOutputStream recordData(record);
+      recordData.Write8(JOURNAL_RECORD_IMAGE);
+      recordData.WriteString(m_images.GetName(used[i]));
+      recordData.Write32(image.GetDataLen());
+      record.Write(image.GetData(), image.GetDataLen());
+      imageData.Write32(record.GetLength());
+      images.Write(record.GetOutputStreamBuffer()->GetBufferStart(), record.GetLength());
+    }
+  }
+  m_images.ClearUsed();
+
+  if (newCells.size() != m_cells.size())
+    changed = true;
+  if (!changed)
+    return true;
+
+  wxMemoryOutputStream cellRecord;
+  wxDataOutputStream cellRecordData(cellRecord);
+  cellRecordData.Write8(JOURNAL_RECORD_CELLS);
+  cellRecordData.Write32(newCells.size());
+  cellRecord.Write(cells.GetOutputStreamBuffer()->GetBufferStart(), cells.GetLength());
+
+  wxLogNull logNull;
+  wxString journal = JournalFile(m_file);
+  if (!wxFileExists(journal))
+  {
+    if (!WriteHeader())
+      return false;
+  }
+
+  // Every record is preceded by its length so a record that is incomplete
+  // because we crashed while writing it can be detected.
+  wxFFileOutputStream output(journal, wxT("ab"));
+  if (!output.IsOk())
+    return false;
+  wxDataOutputStream data(output);
+  output.Write(images.GetOutputStreamBuffer()->GetBufferStart(), images.GetLength());
+  data.Write32(cellRecord.GetLength());
+  output.Write(cellRecord.GetOutputStreamBuffer()->GetBufferStart(), cellRecord.GetLength());
+  if (!output.Close())
+    return false;
+
+  for (size_t i = 0; i < newImages.size(); i++)
+    m_imageWritten[newImages[i]] = true;
+  m_cells = newCells;
+  return true;
+}
+
+wxFileOffset WXMXJournal::GetSize()
+{
+  wxString journal = JournalFile(m_file);
+  if ((!IsActive()) || (!wxFileExists(journal)))
+    return 0;
+  return wxFileName(journal).GetSize().GetValue();
+}
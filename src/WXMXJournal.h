@@ -0,0 +1,159 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef WXMXJOURNAL_H
+#define WXMXJOURNAL_H
+
+#include <wx/wx.h>
+#include <wx/xml/xml.h>
+
+#include "GroupCell.h"
+#include "WXMXImageList.h"
+#include "WXMXArchive.h"
+
+#include <vector>
+
+//! The first thing that is written to a journal
+#define JOURNAL_MAGIC wxT("wxMaxima recovery journal")
+//! Needs to be increased each time the format of the journal changes
+#define JOURNAL_VERSION 1
+//! A record that contains an image
+#define JOURNAL_RECORD_IMAGE 'I'
+//! A record that contains the list of cells the worksheet consists of
+#define JOURNAL_RECORD_CELLS 'C'
+//! The cell is the same as the cell with the given index in the last record
+#define JOURNAL_CELL_UNCHANGED 0
+//! The cell's xml representation follows
+#define JOURNAL_CELL_XML 1
+
+/*! A recovery journal for a .wxmx file
+
+  Rewriting a whole .wxmx file including all of its images in order to protect
+  a few keystrokes against a crash is slow. Instead this journal is kept next to
+  the file. Each time Append() is called it appends a record that tells which
+  cells the worksheet consists of now:
+   - Cells that haven't changed since the last record are referenced by their
+     position in the last record. They are recognized by their version (see
+     GroupCell::GetXMLVersion()) so they don't need to be converted to xml.
+   - Cells that have changed are stored as xml.
+   - The images changed cells contain are appended only once.
+
+  The first record is relative to the cells of the .wxmx file. If the file is
+  saved the journal is deleted and a new one is started relative to the saved
+  state.
+ */
+class WXMXJournal
+{
+public:
+  WXMXJournal();
+  //! The name of the journal that belongs to a .wxmx file
+  static wxString JournalFile(wxString wxmxFile);
+  /*! Does a journal exist for this .wxmx file?
+
+    Journals that were started for an older version of the file are ignored.
+   */
+  static bool Exists(wxString wxmxFile);
+  /*! Apply the journal of a .wxmx file to the file's contents
+
+    \param wxmxFile The name of the .wxmx file
+    \param archive The .wxmx file. The images from the journal are added to it.
+    \param root The root node of the file's content.xml. Its children are
+    replaced by the cells the journal ends with.
+    \return false, if the journal couldn't be read.
+   */
+  static bool Replay(wxString wxmxFile, WXMXArchive &archive, wxXmlNode *root);
+  /*! Add the images Replay() has found in a journal to a list of images
+
+    A journal that is continued after it has been replayed must not give a
+    new image the name of an image it already contains: The next replay
+    would replace the old image by the new one in all cells that refer to it.
+    \param archive The archive Replay() has added the images to
+    \param images The list. The images are added by the names the journal
+    uses for them.
+   */
+  static void AddReplayedImages(WXMXArchive &archive, WXMXImageList &images);
+
+  /*! The version of a cell
+
+    GroupCell::GetXMLVersion() and EditorCell::GetTextVersion() of the cell's
+    editor: Two cells with the same version have the same xml representation.
+   */
+  typedef std::pair<long, long> CellVersion;
+  //! The state of a worksheet as the journal sees it
+  struct State
+  {
+    //! The version of each cell
+    std::vector<CellVersion> m_cells;
+    //! The images the cells contain, as indices into m_images
+    std::vector<size_t> m_images;
+  };
+  //! Determine the state of a worksheet in a form that can be passed to Restart() later
+  State GetState(GroupCell *tree);
+  /*! Start a new journal for a .wxmx file
+
+    Deletes the journal of the file that currently is journaled and an old
+    journal of wxmxFile.
+    \param wxmxFile The .wxmx file.
+    \param state The state of the worksheet the file contains, from GetState()
+   */
+  void Restart(wxString wxmxFile, const State &state);
+  /*! Keep appending to the journal a worksheet has been recovered from
+
+    Deletes the journal of the file that currently is journaled, if that is
+    another file. The images the journal contains keep their names and
+    aren't written again.
+    \param wxmxFile The .wxmx file
+    \param tree The worksheet Replay() has recovered
+    \param archive The archive Replay() has added the journal's images to
+   */
+  void Continue(wxString wxmxFile, GroupCell *tree, WXMXArchive &archive);
+  //! Stop journaling and delete the journal.
+  void Discard();
+  /*! Append the changes since the last call to the journal
+
+    Only the cells that have changed since then are converted to xml.
+    \return false, if the journal couldn't be written.
+   */
+  bool Append(GroupCell *tree);
+  //! The size of the journal in bytes
+  wxFileOffset GetSize();
+  //! Is a journal being kept at the moment?
+  bool IsActive() { return m_file != wxEmptyString; }
+  //! The .wxmx file the journal is kept for
+  wxString GetFile() { return m_file; }
+private:
+  //! Write the header of the journal file
+  bool WriteHeader();
+  //! The version of a cell, see CellVersion
+  static CellVersion GetVersion(GroupCell *cell);
+  //! The .wxmx file we keep the journal for
+  wxString m_file;
+  //! The versions of the cells as they were when the last record was written
+  std::vector<CellVersion> m_cells;
+  /*! The images the journaled cells contain
+
+    Keeps the names of the images stable across the records.
+   */
+  WXMXImageList m_images;
+  //! Which images of m_images have already been written to the journal?
+  std::vector<bool> m_imageWritten;
+};
+
+#endif // WXMXJOURNAL_H
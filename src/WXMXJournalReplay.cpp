@@ -0,0 +1,174 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+/*! \file
+
+  The part of WXMXJournal that reads journals
+
+  Is kept apart from the part that writes them as it doesn't need to know
+  about the cells of a worksheet.
+ */
+
+#include "WXMXJournal.h"
+
+#include <wx/filename.h>
+#include <wx/wfstream.h>
+#include <wx/mstream.h>
+#include <wx/sstream.h>
+#include <wx/datstrm.h>
+
+wxString WXMXJournal::JournalFile(wxString wxmxFile)
+{
+  return wxmxFile + wxT(".journal");
+}
+
+/*! Read the header of a journal and check if it belongs to the current wxmxFile
+
+  The file's size and modification time are stored in the header: If they
+  have changed the file has been saved after the journal has been started.
+ */
+static bool ReadJournalHeader(wxString wxmxFile, wxDataInputStream &data)
+{
+  wxFileName source(wxmxFile);
+  if (data.ReadString() != JOURNAL_MAGIC)
+    return false;
+  if (data.Read32() != JOURNAL_VERSION)
+    return false;
+  if (data.Read64() != wxUint64(source.GetModificationTime().GetValue().GetValue()))
+    return false;
+  if (data.Read64() != wxUint64(source.GetSize().GetValue()))
+    return false;
+  return true;
+}
+
+bool WXMXJournal::Exists(wxString wxmxFile)
+{
+  wxString journal = JournalFile(wxmxFile);
+  if ((!wxFileExists(journal)) || (!wxFileExists(wxmxFile)))
+    return false;
+
+  wxLogNull logNull;
+  wxFFileInputStream input(journal);
+  if (!input.IsOk())
+    return false;
+  wxDataInputStream data(input);
+  return ReadJournalHeader(wxmxFile, data) && input.IsOk();
+}
+
+bool WXMXJournal::Replay(wxString wxmxFile, WXMXArchive &archive, wxXmlNode *root)
+{
+  wxLogNull logNull;
+  wxFFileInputStream input(JournalFile(wxmxFile));
+  if (!input.IsOk())
+    return false;
+  wxDataInputStream header(input);
+  if (!ReadJournalHeader(wxmxFile, header))
+    return false;
+
+  // The cells as the file contains them
+  std::vector<wxXmlNode *> cells;
+  wxXmlNode *node = root->GetChildren();
+  while (node != NULL)
+  {
+    wxXmlNode *next = node->GetNext();
+    root->RemoveChild(node);
+    if (node->GetType() == wxXML_ELEMENT_NODE)
+      cells.push_back(node);
+    else
+      delete node;
+    node = next;
+  }
+
+  wxFileOffset length = input.GetLength();
+  while (input.IsOk() && (input.TellI() + 4 <= length))
+  {
+    wxUint32 recordLength = header.Read32();
+
+    // A record that is incomplete is what was being written while wxMaxima
+    // crashed.
+    if (input.TellI() + wxFileOffset(recordLength) > length)
+      break;
+    wxMemoryBuffer record;
+    input.Read(record.GetAppendBuf(recordLength), recordLength);
+    record.UngetAppendBuf(input.LastRead());
+    if (input.LastRead() != recordLength)
+      break;
+
+    wxMemoryInputStream recordStream(record.GetData(), record.GetDataLen());
+    wxDataInputStream data(recordStream);
+    wxUint8 type = data.Read8();
+    if (type == JOURNAL_RECORD_IMAGE)
+    {
+      wxString name = data.ReadString();
+      wxUint32 size = data.Read32();
+      wxMemoryBuffer image;
+      recordStream.Read(image.GetAppendBuf(size), size);
+      image.UngetAppendBuf(recordStream.LastRead());
+      archive.AddFile(name, image);
+    }
+    else if (type == JOURNAL_RECORD_CELLS)
+    {
+      std::vector<wxXmlNode *> newCells;
+      wxUint32 count = data.Read32();
+      bool ok = true;
+      for (wxUint32 i = 0; (i < count) && ok; i++)
+      {
+        if (data.Read8() == JOURNAL_CELL_UNCHANGED)
+        {
+          wxUint32 index = data.Read32();
+          if (index < cells.size())
+            newCells.push_back(new wxXmlNode(*cells[index]));
+          else
+            ok = false;
+        }
+        else
+        {
+          wxStringInputStream xml(data.ReadString());
+          wxXmlDocument doc;
+          if (doc.Load(xml, wxT("UTF-8"), wxXMLDOC_KEEP_WHITESPACE_NODES))
+            newCells.push_back(doc.DetachRoot());
+          else
+            ok = false;
+        }
+      }
+      if (!recordStream.IsOk())
+        ok = false;
+
+      // A record we cannot read completely is ignored.
+      std::vector<wxXmlNode *> &obsolete = ok ? cells : newCells;
+      for (size_t i = 0; i < obsolete.size(); i++)
+        delete obsolete[i];
+      if (ok)
+        cells = newCells;
+    }
+  }
+
+  for (size_t i = 0; i < cells.size(); i++)
+    root->AddChild(cells[i]);
+  return true;
+}
+
+void WXMXJournal::AddReplayedImages(WXMXArchive &archive, WXMXImageList &images)
+{
+  const std::map<wxString, wxMemoryBuffer> &files = archive.GetAddedFiles();
+  for (std::map<wxString, wxMemoryBuffer>::const_iterator it = files.begin(); it != files.end(); ++it)
+    images.AddFile(it->first, it->second);
+  images.ClearUsed();
+}
@@ -0,0 +1,116 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "WorkerPool.h"
+
+class WorkerPool::WorkerThread : public wxThread
+{
+public:
+  WorkerThread(WorkerPool *pool) : wxThread(wxTHREAD_JOINABLE)
+    {
+      m_pool = pool;
+    }
+protected:
+  virtual ExitCode Entry()
+    {
+      m_pool->Work();
+      return 0;
+    }
+private:
+  WorkerPool *m_pool;
+};
+
+WorkerPool::WorkerPool()
+{
+  m_next = 0;
+}
+
+WorkerPool::~WorkerPool()
+{
+  Clear();
+}
+
+void WorkerPool::Add(Job *job)
+{
+  m_jobs.push_back(job);
+}
+
+void WorkerPool::Clear()
+{
+  for (size_t i = 0; i < m_jobs.size(); i++)
+    delete m_jobs[i];
+  m_jobs.clear();
+  m_next = 0;
+}
+
+int WorkerPool::GetThreadCount()
+{
+  int cpus = wxThread::GetCPUCount();
+  if (cpus < 1)
+    cpus = 1;
+  return cpus;
+}
+
+void WorkerPool::Work()
+{
+  while (true)
+  {
+    Job *job;
+    {
+      wxCriticalSectionLocker lock(m_lock);
+      if (m_next >= m_jobs.size())
+        return;
+      job = m_jobs[m_next++];
+    }
+    job->Run();
+  }
+}
+
+bool WorkerPool::Run()
+{
+  // The calling thread works, too => We need one thread less than we have
+  // processors.
+  std::vector<WorkerThread *> threads;
+  int jobsLeft = m_jobs.size() - m_next;
+  for (int i = 1; (i < GetThreadCount()) && (i < jobsLeft); i++)
+  {
+    WorkerThread *thread = new WorkerThread(this);
+    if ((thread->Create() != wxTHREAD_NO_ERROR) ||
+        (thread->Run() != wxTHREAD_NO_ERROR))
+    {
+      delete thread;
+      break;
+    }
+    threads.push_back(thread);
+  }
+
+  Work();
+
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i]->Wait();
+    delete threads[i];
+  }
+
+  for (size_t i = 0; i < m_jobs.size(); i++)
+    if (!m_jobs[i]->IsOk())
+      return false;
+  return true;
+}
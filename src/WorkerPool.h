@@ -0,0 +1,85 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <wx/wx.h>
+#include <wx/thread.h>
+
+#include <vector>
+
+/*! Runs a list of independent jobs on all processors at once
+
+  Used for compressing images which would take long if done one after another.
+  The jobs mustn't access the worksheet or anything else that isn't thread-safe:
+  Everything a job needs has to be copied into it before Run() is called.
+ */
+class WorkerPool
+{
+public:
+  //! A job the pool can run
+  class Job
+  {
+  public:
+    Job() { m_ok = true; }
+    virtual ~Job(){}
+    //! Do the work. Is called from a background thread.
+    virtual void Run() = 0;
+    //! false, if Run() has failed
+    bool IsOk() { return m_ok; }
+  protected:
+    //! Is set to false by Run() if the job has failed
+    bool m_ok;
+  };
+
+  WorkerPool();
+  //! Deletes all jobs
+  ~WorkerPool();
+  //! Add a job. The pool takes ownership of it.
+  void Add(Job *job);
+  //! The number of jobs that have been added since the last Clear()
+  size_t Count() { return m_jobs.size(); }
+  //! The nth job
+  Job *Get(size_t n) { return m_jobs[n]; }
+  /*! Run all jobs that haven't been run yet and wait until they are finished
+
+    If no thread can be started the jobs are run by the calling thread.
+    \return false, if any of the jobs that have been added since the last Clear()
+    has failed.
+   */
+  bool Run();
+  //! Delete all jobs
+  void Clear();
+  //! The number of jobs that can run in parallel
+  static int GetThreadCount();
+private:
+  class WorkerThread;
+  //! Run jobs until there are no more jobs left
+  void Work();
+  //! The jobs
+  std::vector<Job *> m_jobs;
+  //! The index of the next job that is to be run
+  size_t m_next;
+  //! Guards m_next
+  wxCriticalSection m_lock;
+};
+
+#endif // WORKERPOOL_H
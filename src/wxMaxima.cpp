@@ -42,6 +42,7 @@
 #include "MyTipProvider.h"
 #include "EditorCell.h"
 #include "SlideShowCell.h"
+#include "MappedFile.h"
 #include "PlotFormatWiz.h"
 #include "Dirstructure.h"
 
@@ -64,7 +65,6 @@
 #include <wx/zipstrm.h>
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
-#include <wx/fs_mem.h>
 
 #include <wx/url.h>
 #include <wx/sstream.h>
@@ -155,8 +155,6 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, const wxString title,
   m_isConnected = false;
   m_isRunning = false;
 
-  wxFileSystem::AddHandler(new wxMemoryFSHandler); // for saving wxmx
-
   LoadRecentDocuments();
   UpdateRecentDocuments();
 
@@ -170,6 +168,10 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, const wxString title,
 
   m_autoSaveIntervalExpired = false;
   m_autoSaveTimer.SetOwner(this,AUTO_SAVE_TIMER_ID);
+  m_autoSaveThread = NULL;
+  m_autoSaveSnapshot = NULL;
+  m_autoSaveNumber = 0;
+  m_autoSavePending = false;
   
 #if wxUSE_DRAG_AND_DROP
   m_console->SetDropTarget(new MyDropTarget(this));
@@ -187,6 +189,8 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, const wxString title,
 
 wxMaxima::~wxMaxima()
 {
+  WaitForAutoSave();
+
   if (m_client != NULL)
     m_client->Destroy();
   m_client  = NULL;
@@ -290,6 +294,8 @@ void wxMaxima::FirstOutput(wxString s)
   m_lastPrompt = wxT("(%i1) ");
   
   /// READ FUNCTIONS FOR AUTOCOMPLETION
+  /// (in the background: We don't want to wait for this before we can start
+  /// working)
   m_console->LoadSymbols(dirstructure.AutocompleteFile());
 
   m_console->SetFocus();
@@ -1385,11 +1391,14 @@ bool wxMaxima::OpenWXMFile(wxString file, MathCtrl *document, bool clearDocument
   SetStatusText(_("Opening file"), 1);
   document->Freeze();
 
-  // open wxm file
-  wxTextFile inputFile(file);
-  wxArrayString *wxmLines = NULL;
+  // open wxm file. The file is mapped into memory and converted to a string
+  // directly from there.
+  MappedFile inputFile(file);
+  wxString wxm;
+  if (inputFile.IsOk())
+    wxm = wxString(inputFile.GetData(), wxConvAuto(), inputFile.GetSize());
 
-  if (!inputFile.Open()) {
+  if (!inputFile.IsOk()) {
     document->Thaw();
     wxMessageBox(_("wxMaxima encountered an error loading ") + file, _("Error"), wxOK | wxICON_EXCLAMATION);
     StatusMaximaBusy(waiting);
@@ -1400,29 +1409,14 @@ bool wxMaxima::OpenWXMFile(wxString file, MathCtrl *document, bool clearDocument
   // Show a busy cursor as long as we open a file.
   wxBusyCursor crs;
 
-  if (inputFile.GetFirstLine() !=
-      wxT("/* [wxMaxima batch file version 1] [ DO NOT EDIT BY HAND! ]*/"))
+  if (!wxm.StartsWith(wxT("/* [wxMaxima batch file version 1] [ DO NOT EDIT BY HAND! ]*/")))
   {
-    inputFile.Close();
     document->Thaw();
     wxMessageBox(_("wxMaxima encountered an error loading ") + file, _("Error"), wxOK | wxICON_EXCLAMATION);
     return false;
   }
 
-  wxmLines = new wxArrayString();
-  wxString line;
-  for (line = inputFile.GetFirstLine();
-       !inputFile.Eof();
-       line = inputFile.GetNextLine()) {
-    wxmLines->Add(line);
-  }
-  wxmLines->Add(line);
-
-  inputFile.Close();
-
-  GroupCell *tree = m_console->CreateTreeFromWXMCode(wxmLines);
-
-  delete wxmLines;
+  GroupCell *tree = m_console->CreateTreeFromWXMCode(wxm);
 
   // from here on code is identical for wxm and wxmx
   if (clearDocument)
@@ -1434,6 +1428,8 @@ bool wxMaxima::OpenWXMFile(wxString file, MathCtrl *document, bool clearDocument
     m_console->m_currentFile = file;
     ResetTitle(true,true);
     document->SetSaved(true);
+    // .wxm files don't have a recovery journal.
+    document->m_journal.Discard();
   }
   else
     ResetTitle(false);
@@ -1452,6 +1448,29 @@ bool wxMaxima::OpenWXMFile(wxString file, MathCtrl *document, bool clearDocument
   return true;
 }
 
+/*! Replaces the character of ascii code 27 by a "|" while a stream is read
+
+  The xml parser would reject this character that old wxMaxima versions
+  sometimes wrote to content.xml.
+ */
+class ESCFilterInputStream : public wxFilterInputStream
+{
+public:
+  ESCFilterInputStream(wxInputStream &stream) : wxFilterInputStream(stream) {}
+protected:
+  virtual size_t OnSysRead(void *buffer, size_t size)
+    {
+      m_parent_i_stream->Read(buffer, size);
+      size_t read = m_parent_i_stream->LastRead();
+      char *chars = (char *)buffer;
+      for (size_t i = 0; i < read; i++)
+        if (chars[i] == '\x1b')
+          chars[i] = '|';
+      m_lasterror = m_parent_i_stream->GetLastError();
+      return read;
+    }
+};
+
 bool wxMaxima::OpenWXMXFile(wxString file, MathCtrl *document, bool clearDocument)
 {
   SetStatusText(_("Opening file"), 1);
@@ -1478,6 +1497,7 @@ bool wxMaxima::OpenWXMXFile(wxString file, MathCtrl *document, bool clearDocumen
     m_console->m_currentFile = file;
     ResetTitle(true,true);
     document->SetSaved(true);
+    document->m_journal.Restart(file, document->m_journal.GetState(NULL));
     document->Thaw();
     return true;
   }
@@ -1485,54 +1505,26 @@ bool wxMaxima::OpenWXMXFile(wxString file, MathCtrl *document, bool clearDocumen
   // open wxmx file
   wxXmlDocument xmldoc;
 
-  wxFileSystem fs;
-  wxString wxmxURI = wxURI(wxT("file://") + file).BuildURI();
-  wxString filename = wxmxURI + wxT("#zip:content.xml");
-  wxFSFile *fsfile = fs.OpenFile(filename);
-  if(fsfile)
+  // Read the archive's directory only once instead of once for every image
+  // that is loaded.
+  WXMXArchive archive(file);
+  wxInputStream *content = archive.OpenEntry(wxT("content.xml"));
+  if(content)
   {
-    // Let's see if we can open this file.
-    if(!xmldoc.Load(*(fsfile->GetStream()),wxT("UTF-8"),wxXMLDOC_KEEP_WHITESPACE_NODES))
-    {
-      // If we cannot read the file a typical error in old wxMaxima versions was to include
-      // a letter of ascii code 27 in content.xml. Let's filter this char out.
-
-      // Re-open the file.
-      delete fsfile;
-      fsfile = fs.OpenFile(filename);
-      if(fsfile)
-      {
-        // Read the file into a string
-        wxString s;
-        wxTextInputStream istream1(*fsfile->GetStream());
-        while(!fsfile->GetStream()->Eof())
-          s += istream1.ReadLine()+wxT("\n");
-
-        // Remove the illegal character
-        s.Replace(wxT('\x1b'),wxT("|"));
-
-        // Write the string into a memory buffer
-        wxMemoryOutputStream ostream;
-        wxTextOutputStream txtstrm(ostream);
-        txtstrm.WriteString(s);
-        wxMemoryInputStream istream(ostream);
-
-        // Try to load the file from the memory buffer.
-        xmldoc.Load(istream,wxT("UTF-8"),wxXMLDOC_KEEP_WHITESPACE_NODES);
-      }
-    }
+    // A typical error in old wxMaxima versions was to include a letter of
+    // ascii code 27 in content.xml. It is filtered out while the file is read.
+    ESCFilterInputStream filtered(*content);
+    xmldoc.Load(filtered,wxT("UTF-8"),wxXMLDOC_KEEP_WHITESPACE_NODES);
   }
   if (!xmldoc.IsOk())
   {
     document->Thaw();
-    delete fsfile;
     wxMessageBox(_("wxMaxima encountered an error loading ") + file, _("Error"),
                  wxOK | wxICON_EXCLAMATION);
     StatusMaximaBusy(waiting);
     SetStatusText(_("File could not be opened"), 1);
     return false;
   }
-  delete fsfile;
 
   // start processing the XML file
   if (xmldoc.GetRoot()->GetName() != wxT("wxMaximaDocument")) {
@@ -1577,7 +1569,19 @@ bool wxMaxima::OpenWXMXFile(wxString file, MathCtrl *document, bool clearDocumen
 
   // Read the worksheet's contents.
   wxXmlNode *xmlcells = xmldoc.GetRoot();
-  GroupCell *tree = CreateTreeFromXMLNode(xmlcells, wxmxURI);
+
+  // If wxMaxima has crashed while the file was open the recovery journal
+  // contains the changes made since the file was saved the last time.
+  bool recovered = false;
+  if (clearDocument && WXMXJournal::Exists(file))
+  {
+    if (wxMessageBox(_("Document ") + file +
+                     _(" has unsaved changes that were kept in case wxMaxima crashes. Restore them?"),
+                     _("Recover unsaved changes"), wxYES_NO | wxICON_QUESTION) == wxYES)
+      recovered = WXMXJournal::Replay(file, archive, xmlcells);
+  }
+
+  GroupCell *tree = CreateTreeFromXMLNode(xmlcells, &archive);
 
   // from here on code is identical for wxm and wxmx
   if (clearDocument) {
@@ -1586,14 +1590,22 @@ bool wxMaxima::OpenWXMXFile(wxString file, MathCtrl *document, bool clearDocumen
     if (!(doczoom.ToLong(&zoom)))
       zoom = 100;
     document->SetZoomFactor( double(zoom) / 100.0, false); // Set zoom if opening, don't recalculate
+    // Allows to copy the images from this file when it is saved the next time.
+    document->WXMXLoaded(file, archive);
   }
 
   document->InsertGroupCells(tree); // this also recalculates
 
   if (clearDocument) {
     m_console->m_currentFile = file;
-    ResetTitle(true,true);
-    document->SetSaved(true);
+    ResetTitle(!recovered,true);
+    document->SetSaved(!recovered);
+    // Keep appending to the journal we have recovered from: Its changes still
+    // aren't saved.
+    if (recovered)
+      document->m_journal.Continue(file, document->GetTree(), archive);
+    else
+      document->m_journal.Restart(file, document->m_journal.GetState(document->GetTree()));
   }
   else
     ResetTitle(false);
@@ -1627,9 +1639,9 @@ bool wxMaxima::OpenWXMXFile(wxString file, MathCtrl *document, bool clearDocumen
   return true;
 }
 
-GroupCell* wxMaxima::CreateTreeFromXMLNode(wxXmlNode *xmlcells, wxString wxmxfilename)
+GroupCell* wxMaxima::CreateTreeFromXMLNode(wxXmlNode *xmlcells, WXMXArchive *archive)
 {
-  MathParser mp(wxmxfilename);
+  MathParser mp(archive);
   GroupCell *tree = NULL;
   GroupCell *last = NULL;
 
@@ -2413,6 +2425,9 @@ void wxMaxima::OpenFile(wxString file, wxString cmd)
 
 bool wxMaxima::SaveFile(bool forceSave)
 {  
+  // Don't let an autosave that is still in progress overwrite what we save now.
+  WaitForAutoSave();
+
   wxString file = m_console->m_currentFile;
   wxString fileExt=wxT("wxmx");
   int ext=0;
@@ -2593,17 +2608,22 @@ void wxMaxima::OnTimerEvent(wxTimerEvent& event)
     m_console->m_keyboardInactive = true;
     if((m_autoSaveIntervalExpired) && (m_console->m_currentFile.Length() > 0) && SaveNecessary())
     {
-      SaveFile(false);
+      AutoSave();
       m_autoSaveIntervalExpired = false;
       if(m_autoSaveInterval > 10000)
         m_autoSaveTimer.StartOnce(m_autoSaveInterval);
     }
+    // Appending the latest changes to the recovery journal is cheap enough
+    // to be done each time the user pauses typing.
+    else if((m_autoSaveInterval > 10000) && (m_console->m_currentFile.Length() > 0) &&
+            (m_console->m_journal.GetFile() == m_console->m_currentFile) && SaveNecessary())
+      m_console->m_journal.Append(m_console->GetTree());
     break;
   case AUTO_SAVE_TIMER_ID:
     m_autoSaveIntervalExpired = true;
     if((m_console->m_keyboardInactive) && (m_console->m_currentFile.Length() > 0) && SaveNecessary())
     {
-      SaveFile(false);
+      AutoSave();
 	
       if(m_autoSaveInterval > 10000)
         m_autoSaveTimer.StartOnce(m_autoSaveInterval);
@@ -2613,6 +2633,123 @@ void wxMaxima::OnTimerEvent(wxTimerEvent& event)
   }
 }
 
+class wxMaxima::AutoSaveThread : public wxThread
+{
+public:
+  AutoSaveThread(wxMaxima *frame, WXMXSnapshot *snapshot, int number) :
+    wxThread(wxTHREAD_JOINABLE)
+    {
+      m_frame = frame;
+      m_snapshot = snapshot;
+      m_number = number;
+      m_success = false;
+    }
+  //! Has the file been written successfully? Only valid after Wait() has returned.
+  bool Succeeded() { return m_success; }
+protected:
+  virtual ExitCode Entry()
+    {
+      // Errors are reported in the status bar instead.
+      wxLogNull logNull;
+      m_success = MathCtrl::WriteWXMXSnapshot(m_snapshot);
+
+      wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, AUTO_SAVE_TIMER_ID);
+      event->SetInt(m_number);
+      wxQueueEvent(m_frame, event);
+      return 0;
+    }
+private:
+  wxMaxima *m_frame;
+  WXMXSnapshot *m_snapshot;
+  int m_number;
+  bool m_success;
+};
+
+void wxMaxima::AutoSave()
+{
+  wxString file = m_console->m_currentFile;
+
+  // .wxm files contain only text and are written fast enough.
+  if(file.Right(5) != wxT(".wxmx"))
+  {
+    SaveFile(false);
+    return;
+  }
+
+  // Appending the changes to the recovery journal is much faster than writing
+  // the whole file. Only if the journal has grown too big we need to do that.
+  long journalLimit = 16;
+  wxConfig::Get()->Read(wxT("autoSaveJournalLimit"), &journalLimit);
+  WXMXJournal &journal = m_console->m_journal;
+  if((journal.GetFile() == file) &&
+     (journal.GetSize() < journalLimit * 1024 * 1024) &&
+     journal.Append(m_console->GetTree()))
+    return;
+
+  // Saving the current state will have to wait until the last autosave is
+  // written.
+  if(m_autoSaveThread != NULL)
+  {
+    m_autoSavePending = true;
+    return;
+  }
+  m_autoSavePending = false;
+
+  StatusSaveStart();
+  m_autoSaveSnapshot = m_console->CreateWXMXSnapshot(file);
+  // If the worksheet is changed while the snapshot is written it will be marked
+  // as unsaved again.
+  m_console->SetSaved(true);
+
+  m_autoSaveThread = new AutoSaveThread(this, m_autoSaveSnapshot, ++m_autoSaveNumber);
+  if ((m_autoSaveThread->Create() != wxTHREAD_NO_ERROR) ||
+      (m_autoSaveThread->Run() != wxTHREAD_NO_ERROR))
+  {
+    // If we cannot start a thread we have to write the file ourself.
+    delete m_autoSaveThread;
+    m_autoSaveThread = NULL;
+    AutoSaveFinished(MathCtrl::WriteWXMXSnapshot(m_autoSaveSnapshot));
+  }
+}
+
+void wxMaxima::WaitForAutoSave()
+{
+  if(m_autoSaveThread == NULL)
+    return;
+  m_autoSaveThread->Wait();
+  bool success = m_autoSaveThread->Succeeded();
+  delete m_autoSaveThread;
+  m_autoSaveThread = NULL;
+  AutoSaveFinished(success);
+}
+
+void wxMaxima::AutoSaveFinished(bool success)
+{
+  if(success)
+    m_console->WXMXSnapshotSaved(m_autoSaveSnapshot);
+  wxDELETE(m_autoSaveSnapshot);
+  if(success)
+    StatusSaveFinished();
+  else
+  {
+    m_console->SetSaved(false);
+    StatusSaveFailed();
+  }
+}
+
+void wxMaxima::OnAutoSaveFinished(wxThreadEvent& event)
+{
+  // The event might stem from an autosave we already have waited for.
+  if((m_autoSaveThread == NULL) || (event.GetInt() != m_autoSaveNumber))
+    return;
+
+  WaitForAutoSave();
+
+  if(m_autoSavePending && (m_console->m_currentFile.Length() > 0) && SaveNecessary())
+    AutoSave();
+  m_autoSavePending = false;
+}
+
 void wxMaxima::FileMenu(wxCommandEvent& event)
 {
   wxString expr = GetDefaultEntry();
@@ -2861,6 +2998,7 @@ void wxMaxima::EditMenu(wxCommandEvent& event)
       // Write the changes in the configuration to the disk.
       config->Flush();
       // Refresh the display as the settings that affect it might have changed.
+      CellParser::ClearTextExtentCache();
       m_console->RecalculateForce();
       m_console->Refresh();
       ConfigChanged();
@@ -5110,116 +5248,7 @@ void wxMaxima::EvaluateEvent(wxCommandEvent& event)
 
 wxString wxMaxima::GetUnmatchedParenthesisState(wxString text)
 {
-  int len=text.Length();
-  int index=0;
-
-  std::list<wxChar> delimiters;
-
-  if(text.Right(1) == wxT("\\"))
-    return(_("Cell ends in a backslash"));
-
-  bool lisp = false;
-
-  wxChar lastC=wxT(';');
-  wxChar lastnonWhitespace=wxT(',');
-  while(index<len)
-  {
-    wxChar c=text[index];
-
-    switch(c)
-    {
-    case wxT('('):
-      delimiters.push_back(wxT(')'));
-      lastC=c;
-      break;
-    case wxT('['):
-      delimiters.push_back(wxT(']'));
-      lastC=c;
-      break;
-    case wxT('{'):
-      delimiters.push_back(wxT('}'));
-      lastC=c;
-      break;
-
-    case wxT(')'):
-    case wxT(']'):
-    case wxT('}'):
-      if(c!=delimiters.back()) return(_("Mismatched parenthesis"));
-      delimiters.pop_back();
-      lastC=c;
-      if(lastnonWhitespace==wxT(','))
-        return(_("Comma directly followed by a closing parenthesis"));
-      break;
-
-    case wxT('\\'):
-      index++;
-      lastC=c;
-      break;
-
-    case wxT('\"'):
-      index++;
-      while((index<len)&&(c=text[index])!=wxT('\"'))
-      {
-        if(c==wxT('\\'))
-          index++;
-        index++;
-      }
-      if(text[index]!=wxT('\"')) return(_("Unterminated string."));
-      lastC=c;
-      break;
-
-    case wxT(':'):
-      if(text.find(wxT("lisp"),index + 1) == index + 1)
-        lisp = true;
-      lastC=c;
-      break;
-      
-    case wxT(';'):
-    case wxT('$'):
-      if((!lisp) && (!delimiters.empty()))
-      {
-        return _("Un-closed parenthesis on encountering ; or $");
-      }
-      lastC=c;
-      break;      
-      
-    case wxT('/'):
-      if(index<len-1)
-      {
-        if(text[index + 1]==wxT('*'))
-        {
-          index=text.find(wxT("*/"),index);
-          if(index==wxNOT_FOUND)
-            return(_("Unterminated comment."));
-        }
-        else lastC=c;
-      }
-    default:
-      if((c!=wxT('\n')) && (c!=wxT(' '))&& (c!=wxT('\t')))
-        lastC=c;
-    }
-
-    if(
-      (c!=wxT(' ')) &&
-      (c!=wxT('\t')) &&
-      (c!=wxT('\n')) &&
-      (c!=wxT('\r'))
-      )
-      lastnonWhitespace = c;
-
-    index++;
-  }
-  if(!delimiters.empty())
-  {
-    return _("Un-closed parenthesis");
-  }
-
-  if((!lisp))
-  {
-    if((lastC!=wxT(';'))&&(lastC!=wxT('$')))
-      return _("No dollar ($) or semicolon (;) at the end of command");      
-  }
-  return wxEmptyString;
+  return Delimiters::Scan(text);
 }
 
 void wxMaxima::TriggerEvaluation()
@@ -5297,7 +5326,9 @@ void wxMaxima::TryEvaluateNextInQueue()
 
   if((text != wxEmptyString) && (text != wxT(";")) && (text != wxT("$")))
   {
-    wxString parenthesisError=GetUnmatchedParenthesisState(tmp->GetEditable()->ToString());
+    // The cell keeps track of its parenthesis so they only need to be
+    // checked again if the cell has changed since the last check.
+    wxString parenthesisError=tmp->GetEditable()->GetUnmatchedParenthesisState();
     if(parenthesisError==wxEmptyString)
     {          
       if(m_console->FollowEvaluation())
@@ -5311,7 +5342,7 @@ void wxMaxima::TryEvaluateNextInQueue()
       }
       
       m_console->SetWorkingGroup(tmp);
-      tmp->GetPrompt()->SetValue(m_lastPrompt);
+      tmp->SetPrompt(m_lastPrompt);
       // Clear the monitor that shows the xml representation of the output of the
       // current maxima command.
       if(m_xmlInspector)
@@ -5760,7 +5791,12 @@ int wxMaxima::SaveDocumentP()
   dialog.SetExtendedMessage(_("Your changes will be lost if you don't save them."));
   dialog.SetYesNoCancelLabels(_("Save"), _("Don't save"), _("Cancel"));
 
-  return dialog.ShowModal();
+  int result = dialog.ShowModal();
+  // The changes the user doesn't want to keep shouldn't be offered for
+  // recovery the next time the file is opened.
+  if(result == wxID_NO)
+    m_console->m_journal.Discard();
+  return result;
 }
 
 BEGIN_EVENT_TABLE(wxMaxima, wxFrame)
@@ -5772,6 +5808,7 @@ EVT_MENU(menu_check_updates, wxMaxima::HelpMenu)
 EVT_TIMER(KEYBOARD_INACTIVITY_TIMER_ID, wxMaxima::OnTimerEvent)
 EVT_TIMER(MAXIMA_STDOUT_POLL_ID, wxMaxima::OnTimerEvent)
 EVT_TIMER(AUTO_SAVE_TIMER_ID, wxMaxima::OnTimerEvent)
+EVT_THREAD(AUTO_SAVE_TIMER_ID, wxMaxima::OnAutoSaveFinished)
 EVT_TIMER(wxID_ANY, wxMaxima::OnTimerEvent)
 EVT_COMMAND_SCROLL(ToolBar::plot_slider_id, wxMaxima::SliderEvent)
 EVT_MENU(MathCtrl::popid_copy, wxMaxima::PopupMenu)
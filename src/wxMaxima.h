@@ -31,6 +31,7 @@
 #include <wx/regex.h>
 #include <wx/html/htmlwin.h>
 #include <wx/dnd.h>
+#include <wx/thread.h>
 
 #if defined (__WXMSW__)
  #include <wx/msw/helpchm.h>
@@ -153,6 +154,30 @@ private:
     If text doesn't contain any error this function returns wxEmptyString
    */
   wxString GetUnmatchedParenthesisState(wxString text);
+  //! The thread AutoSave() writes the file in
+  class AutoSaveThread;
+  /*! Save the current .wxmx file without blocking the user interface
+
+    Creates a snapshot of the worksheet and writes it to disk in a background 
+    thread. If an autosave is requested while the last one still is running
+    it is postponed until the last one has finished and saves the then-current 
+    state of the worksheet.
+   */
+  void AutoSave();
+  //! Is called when the thread AutoSave() has started has finished
+  void OnAutoSaveFinished(wxThreadEvent& event);
+  //! Wait until the thread AutoSave() has started has written its file
+  void WaitForAutoSave();
+  //! Delete the snapshot an autosave has written and show its outcome
+  void AutoSaveFinished(bool success);
+  //! The thread that currently writes an autosave or NULL
+  AutoSaveThread *m_autoSaveThread;
+  //! The snapshot m_autoSaveThread writes to disk
+  WXMXSnapshot *m_autoSaveSnapshot;
+  //! The number of autosaves that have been started. Identifies the events of m_autoSaveThread.
+  int m_autoSaveNumber;
+  //! Has an autosave been requested while m_autoSaveThread was still busy?
+  bool m_autoSavePending;
 protected:
   //! Is called on start and whenever the configuration changes
   void ConfigChanged();
@@ -336,8 +361,11 @@ protected:
   bool OpenWXMFile(wxString file, MathCtrl *document, bool clearDocument = true);
   //! Opens a wxmx file
   bool OpenWXMXFile(wxString file, MathCtrl *document, bool clearDocument = true);
-  //! Loads a wxmx description
-  GroupCell* CreateTreeFromXMLNode(wxXmlNode *xmlcells, wxString wxmxfilename = wxEmptyString);
+  /*! Loads a wxmx description
+
+    \param archive The .wxmx archive images are read from, or NULL
+   */
+  GroupCell* CreateTreeFromXMLNode(wxXmlNode *xmlcells, WXMXArchive *archive = NULL);
   /*! Saves the current file
 
     \param forceSave true means: Always ask for a file name before saving.
@@ -0,0 +1,161 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+// Tests for the sorted word lists of AutoComplete
+
+#include "Test.h"
+#include "Autocomplete.h"
+
+//! Is words sorted and free of duplicates?
+static bool IsSortedAndUnique(const wxArrayString &words)
+{
+  for (size_t i = 1; i < words.GetCount(); i++)
+    if (words[i - 1].Cmp(words[i]) >= 0)
+      return false;
+  return true;
+}
+
+static void TestLowerBound()
+{
+  wxArrayString words;
+  CHECK(AutoComplete::LowerBound(words, wxT("a")) == 0);
+
+  words.Add(wxT("a"));
+  words.Add(wxT("b"));
+  words.Add(wxT("b2"));
+  words.Add(wxT("c"));
+  CHECK(AutoComplete::LowerBound(words, wxEmptyString) == 0);
+  CHECK(AutoComplete::LowerBound(words, wxT("a")) == 0);
+  CHECK(AutoComplete::LowerBound(words, wxT("b")) == 1);
+  CHECK(AutoComplete::LowerBound(words, wxT("b1")) == 2);
+  CHECK(AutoComplete::LowerBound(words, wxT("b2")) == 2);
+  CHECK(AutoComplete::LowerBound(words, wxT("b3")) == 3);
+  CHECK(AutoComplete::LowerBound(words, wxT("d")) == 4);
+
+  // Upper case letters sort before lower case ones
+  CHECK(AutoComplete::LowerBound(words, wxT("B")) == 0);
+}
+
+static void TestSortAndUnique()
+{
+  wxArrayString empty;
+  AutoComplete::SortAndUnique(empty);
+  CHECK(empty.GetCount() == 0);
+
+  wxArrayString words;
+  words.Add(wxT("c"));
+  words.Add(wxT("a"));
+  words.Add(wxT("c"));
+  words.Add(wxT("b"));
+  words.Add(wxT("a"));
+  words.Add(wxT("c"));
+  AutoComplete::SortAndUnique(words);
+  CHECK(words.GetCount() == 3);
+  CHECK(IsSortedAndUnique(words));
+  if (words.GetCount() == 3)
+  {
+    CHECK(words[0] == wxT("a"));
+    CHECK(words[1] == wxT("b"));
+    CHECK(words[2] == wxT("c"));
+  }
+
+  // A list that only contains duplicates
+  wxArrayString same;
+  same.Add(wxT("x"));
+  same.Add(wxT("x"));
+  same.Add(wxT("x"));
+  AutoComplete::SortAndUnique(same);
+  CHECK(same.GetCount() == 1);
+
+  // LowerBound() agrees with the order SortAndUnique() sorts in
+  wxArrayString mixed;
+  mixed.Add(wxT("sin"));
+  mixed.Add(wxT("Sin"));
+  mixed.Add(wxT("_sin"));
+  mixed.Add(wxT("%pi"));
+  mixed.Add(wxT("sinh"));
+  mixed.Add(wxT("asin"));
+  AutoComplete::SortAndUnique(mixed);
+  CHECK(IsSortedAndUnique(mixed));
+  for (size_t i = 0; i < mixed.GetCount(); i++)
+    CHECK(AutoComplete::LowerBound(mixed, mixed[i]) == i);
+}
+
+static void TestComplete()
+{
+  AutoComplete autocomplete;
+  autocomplete.AddSymbol(wxT("sinh"));
+  autocomplete.AddSymbol(wxT("sin"));
+  autocomplete.AddSymbol(wxT("cos"));
+  autocomplete.AddSymbol(wxT("sin"));
+  autocomplete.AddSymbol(wxT("FUNCTION: asin"));
+
+  wxArrayString all = autocomplete.CompleteSymbol(wxEmptyString);
+  CHECK(all.GetCount() == 4);
+  CHECK(IsSortedAndUnique(all));
+
+  wxArrayString sin = autocomplete.CompleteSymbol(wxT("sin"));
+  CHECK(sin.GetCount() == 2);
+  if (sin.GetCount() == 2)
+  {
+    CHECK(sin[0] == wxT("sin"));
+    CHECK(sin[1] == wxT("sinh"));
+  }
+  CHECK(autocomplete.CompleteSymbol(wxT("x")).GetCount() == 0);
+  CHECK(autocomplete.CompleteSymbol(wxT("sinhx")).GetCount() == 0);
+
+  // The lists of the different types of words are separate
+  autocomplete.AddSymbol(wxT("UNIT: s"));
+  CHECK(autocomplete.CompleteSymbol(wxT("s")).GetCount() == 2);
+  CHECK(autocomplete.CompleteSymbol(wxT("s"), AutoComplete::unit).GetCount() == 1);
+}
+
+static void TestTemplates()
+{
+  AutoComplete autocomplete;
+  autocomplete.AddSymbol(wxT("TEMPLATE: integrate(<expr>, <x>)"));
+  autocomplete.AddSymbol(wxT("TEMPLATE: integrate(<expr>, <x>, <a>, <b>)"));
+  // Only one template per number of arguments is kept
+  autocomplete.AddSymbol(wxT("TEMPLATE: integrate(<f>, <y>)"));
+  autocomplete.AddSymbol(wxT("TEMPLATE: integrate_use_rootsof(<bool>)"));
+
+  // A function name that matches exactly only completes to its own templates
+  wxArrayString integrate = autocomplete.CompleteSymbol(wxT("integrate"), AutoComplete::tmplte);
+  CHECK(integrate.GetCount() == 2);
+  CHECK(IsSortedAndUnique(integrate));
+  if (integrate.GetCount() == 2)
+  {
+    CHECK(integrate[0] == wxT("integrate(<expr>,<x>)"));
+    CHECK(integrate[1] == wxT("integrate(<expr>,<x>,<a>,<b>)"));
+  }
+
+  CHECK(autocomplete.CompleteSymbol(wxT("integ"), AutoComplete::tmplte).GetCount() == 3);
+}
+
+int main()
+{
+  wxInitializer initializer;
+  TestLowerBound();
+  TestSortAndUnique();
+  TestComplete();
+  TestTemplates();
+  return TEST_RESULT;
+}
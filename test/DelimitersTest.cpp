@@ -0,0 +1,120 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+// Tests for Delimiters::Scan(): Finding matching parenthesis and quotes
+
+#include "Test.h"
+#include "Delimiters.h"
+
+//! Scan text and check that it contains the delimiters at the given positions
+static void CheckDelimiters(const wxString &text, const wxString &error,
+                            size_t count, const size_t *positions, const long *matches)
+{
+  std::vector<size_t> foundPositions;
+  std::vector<long> foundMatches;
+  CHECK(Delimiters::Scan(text, &foundPositions, &foundMatches) == error);
+  CHECK(foundPositions.size() == count);
+  CHECK(foundMatches.size() == count);
+  if ((foundPositions.size() != count) || (foundMatches.size() != count))
+    return;
+  for (size_t i = 0; i < count; i++)
+  {
+    CHECK(foundPositions[i] == positions[i]);
+    CHECK(foundMatches[i] == matches[i]);
+  }
+
+  // The problems don't depend on whether the positions are asked for
+  CHECK(Delimiters::Scan(text) == error);
+}
+
+static void TestMatches()
+{
+  // Nested delimiters of all types
+  const size_t positions[] = {1, 3, 5, 6, 8, 9};
+  const long matches[] = {9, 5, 3, 8, 6, 1};
+  CheckDelimiters(wxT("f(a[b]{c});"), wxEmptyString, 6, positions, matches);
+
+  // A text without delimiters
+  CheckDelimiters(wxT("a:1;"), wxEmptyString, 0, NULL, NULL);
+
+  // Quotes match each other
+  const size_t quotePositions[] = {0, 5};
+  const long quoteMatches[] = {5, 0};
+  CheckDelimiters(wxT("\"a\\\"b\";"), wxEmptyString, 2, quotePositions, quoteMatches);
+}
+
+static void TestIgnored()
+{
+  // Parenthesis inside strings are part of the string
+  const size_t stringPositions[] = {2, 4};
+  const long stringMatches[] = {4, 2};
+  CheckDelimiters(wxT("s:\"(\";"), wxEmptyString, 2, stringPositions, stringMatches);
+
+  // Parenthesis inside comments aren't code
+  CheckDelimiters(wxT("/* ( */ a;"), wxEmptyString, 0, NULL, NULL);
+
+  // Escaped parenthesis are part of a symbol name
+  CheckDelimiters(wxT("a\\(;"), wxEmptyString, 0, NULL, NULL);
+}
+
+static void TestProblems()
+{
+  // After a mismatch the remaining delimiters are still matched
+  const size_t mismatchPositions[] = {0, 1, 3, 5};
+  const long mismatchMatches[] = {-1, -1, 5, 3};
+  CheckDelimiters(wxT("(];(a);"), _("Mismatched parenthesis"),
+                  4, mismatchPositions, mismatchMatches);
+
+  const size_t unclosedPositions[] = {1};
+  const long unclosedMatches[] = {-1};
+  CheckDelimiters(wxT("f(a;"), _("Un-closed parenthesis on encountering ; or $"),
+                  1, unclosedPositions, unclosedMatches);
+  CheckDelimiters(wxT("f(a"), _("Un-closed parenthesis"),
+                  1, unclosedPositions, unclosedMatches);
+
+  const size_t stringPositions[] = {0};
+  const long stringMatches[] = {-1};
+  CheckDelimiters(wxT("\"abc"), _("Unterminated string."), 1, stringPositions, stringMatches);
+
+  CheckDelimiters(wxT("/* a"), _("Unterminated comment."), 0, NULL, NULL);
+  CHECK(Delimiters::Scan(wxT("f(a,);")) == _("Comma directly followed by a closing parenthesis"));
+  CHECK(Delimiters::Scan(wxT("a;\\")) == _("Cell ends in a backslash"));
+}
+
+static void TestCommandEndings()
+{
+  CHECK(Delimiters::Scan(wxT("a")) == _("No dollar ($) or semicolon (;) at the end of command"));
+  CHECK(Delimiters::Scan(wxT("a$")) == wxEmptyString);
+  CHECK(Delimiters::Scan(wxT("a;\n")) == wxEmptyString);
+
+  // Lisp code doesn't need to end in a semicolon
+  CHECK(Delimiters::Scan(wxT(":lisp (print 1)")) == wxEmptyString);
+}
+
+int main()
+{
+  wxInitializer initializer;
+  TestMatches();
+  TestIgnored();
+  TestProblems();
+  TestCommandEndings();
+  return TEST_RESULT;
+}
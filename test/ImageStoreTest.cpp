@@ -0,0 +1,131 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+// Tests for ImageStore: Sharing and reference counting the data of images
+
+#include "Test.h"
+#include "ImageStore.h"
+
+#include <string.h>
+
+//! A buffer that contains a copy of text
+static wxMemoryBuffer Buffer(const char *text)
+{
+  wxMemoryBuffer buffer;
+  buffer.AppendData(text, strlen(text));
+  return buffer;
+}
+
+static void TestSharing()
+{
+  size_t count = ImageStore::GetCount();
+
+  // Images with the same contents share their data
+  wxMemoryBuffer a = ImageStore::Add(Buffer("image a"));
+  wxMemoryBuffer a2 = ImageStore::Add(Buffer("image a"));
+  CHECK(a.GetData() == a2.GetData());
+  CHECK(ImageStore::GetUsers(a) == 2);
+  CHECK(ImageStore::GetCount() == count + 1);
+
+  // Images with different contents don't, even if they are of the same size
+  wxMemoryBuffer b = ImageStore::Add(Buffer("image b"));
+  CHECK(a.GetData() != b.GetData());
+  CHECK(ImageStore::GetUsers(b) == 1);
+  CHECK(ImageStore::GetCount() == count + 2);
+
+  ImageStore::Release(a);
+  ImageStore::Release(a2);
+  ImageStore::Release(b);
+  CHECK(ImageStore::GetCount() == count);
+}
+
+static void TestCounting()
+{
+  size_t count = ImageStore::GetCount();
+
+  wxMemoryBuffer image = ImageStore::Add(Buffer("image"));
+  ImageStore::AddUser(image);
+  ImageStore::AddUser(image);
+  CHECK(ImageStore::GetUsers(image) == 3);
+
+  ImageStore::Release(image);
+  CHECK(ImageStore::GetUsers(image) == 2);
+  ImageStore::Release(image);
+  CHECK(ImageStore::GetUsers(image) == 1);
+  CHECK(ImageStore::GetCount() == count + 1);
+
+  // The last user releasing the image removes it from the store
+  ImageStore::Release(image);
+  CHECK(ImageStore::GetUsers(image) == 0);
+  CHECK(ImageStore::GetCount() == count);
+
+  // An image that has been removed is added anew
+  wxMemoryBuffer again = ImageStore::Add(Buffer("image"));
+  CHECK(ImageStore::GetUsers(again) == 1);
+  CHECK(ImageStore::GetCount() == count + 1);
+  ImageStore::Release(again);
+  CHECK(ImageStore::GetCount() == count);
+}
+
+static void TestEmpty()
+{
+  size_t count = ImageStore::GetCount();
+
+  // Empty images aren't stored
+  wxMemoryBuffer empty = ImageStore::Add(wxMemoryBuffer());
+  CHECK(empty.GetDataLen() == 0);
+  CHECK(ImageStore::GetUsers(empty) == 0);
+  CHECK(ImageStore::GetCount() == count);
+  ImageStore::AddUser(empty);
+  ImageStore::Release(empty);
+  CHECK(ImageStore::GetCount() == count);
+}
+
+static void TestManyImages()
+{
+  size_t count = ImageStore::GetCount();
+
+  // Many images that are added and released in a different order
+  const size_t n = 100;
+  wxMemoryBuffer images[n];
+  char name[] = "image 0";
+  for (size_t i = 0; i < n; i++)
+  {
+    name[6] = '0' + i % 10;
+    images[i] = ImageStore::Add(Buffer(name));
+  }
+  CHECK(ImageStore::GetCount() == count + 10);
+  for (size_t i = 0; i < 10; i++)
+    CHECK(ImageStore::GetUsers(images[i]) == 10);
+
+  for (size_t i = n; i > 0; i--)
+    ImageStore::Release(images[(i * 37) % n]);
+  CHECK(ImageStore::GetCount() == count);
+}
+
+int main()
+{
+  wxInitializer initializer;
+  TestSharing();
+  TestCounting();
+  TestEmpty();
+  TestManyImages();
+  return TEST_RESULT;
+}
@@ -0,0 +1,54 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef TEST_H
+#define TEST_H
+
+/*! \file
+
+  What the tests "make check" runs need
+
+  Each test is a program of its own that only links the parts of wxMaxima it
+  tests. It reports every check that fails and returns a non-zero exit code if
+  there was one.
+ */
+
+#include <wx/wx.h>
+#include <wx/init.h>
+#include <iostream>
+
+//! The number of checks that have failed so far
+static int testFailures = 0;
+
+//! Report that condition doesn't hold
+#define CHECK(condition)                                                \
+  do {                                                                  \
+    if (!(condition))                                                   \
+    {                                                                   \
+      std::cerr << __FILE__ << ":" << __LINE__                          \
+                << ": check failed: " << #condition << std::endl;       \
+      testFailures++;                                                   \
+    }                                                                   \
+  } while (0)
+
+//! The exit code of the test
+#define TEST_RESULT ((testFailures == 0) ? 0 : 1)
+
+#endif // TEST_H
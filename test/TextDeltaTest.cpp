@@ -0,0 +1,150 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+// Tests for TextDelta: The differences the undo history of editor cells stores
+
+#include "Test.h"
+#include "TextDelta.h"
+
+#include <vector>
+
+//! Check that the delta between oldText and newText converts them into each other
+static void CheckDelta(const wxString &oldText, const wxString &newText)
+{
+  TextDelta delta(oldText, newText);
+  wxString text = oldText;
+  delta.Apply(text);
+  CHECK(text == newText);
+  delta.Revert(text);
+  CHECK(text == oldText);
+
+  // The delta doesn't store more than the part that differs.
+  CHECK(delta.m_pos <= oldText.Length());
+  CHECK(delta.m_pos <= newText.Length());
+  CHECK(delta.m_removed.Length() <= oldText.Length() - delta.m_pos);
+  CHECK(delta.m_inserted.Length() <= newText.Length() - delta.m_pos);
+}
+
+static void TestEdits()
+{
+  // Typing at the end, at the start and in the middle
+  TextDelta append(wxT("abc"), wxT("abcd"));
+  CHECK(append.m_pos == 3);
+  CHECK(append.m_removed == wxEmptyString);
+  CHECK(append.m_inserted == wxT("d"));
+
+  TextDelta prepend(wxT("abc"), wxT("xabc"));
+  CHECK(prepend.m_pos == 0);
+  CHECK(prepend.m_inserted == wxT("x"));
+
+  TextDelta insert(wxT("abc"), wxT("abxc"));
+  CHECK(insert.m_pos == 2);
+  CHECK(insert.m_removed == wxEmptyString);
+  CHECK(insert.m_inserted == wxT("x"));
+
+  // Deleting and replacing
+  TextDelta remove(wxT("sin(x)+cos(x)"), wxT("sin(x)"));
+  CHECK(remove.m_pos == 6);
+  CHECK(remove.m_removed == wxT("+cos(x)"));
+  CHECK(remove.m_inserted == wxEmptyString);
+
+  TextDelta replace(wxT("f(a,b)"), wxT("f(c,b)"));
+  CHECK(replace.m_pos == 2);
+  CHECK(replace.m_removed == wxT("a"));
+  CHECK(replace.m_inserted == wxT("c"));
+
+  CheckDelta(wxT("abc"), wxT("abcd"));
+  CheckDelta(wxT("abc"), wxT("xabc"));
+  CheckDelta(wxT("abc"), wxT("abxc"));
+  CheckDelta(wxT("sin(x)+cos(x)"), wxT("sin(x)"));
+  CheckDelta(wxT("f(a,b)"), wxT("f(c,b)"));
+  CheckDelta(wxT("line 1\nline 2"), wxT("line 1\nnew line\nline 2"));
+}
+
+static void TestCornerCases()
+{
+  // Identical texts don't differ at all
+  TextDelta same(wxT("abc"), wxT("abc"));
+  CHECK(same.Length() == 0);
+  CheckDelta(wxT("abc"), wxT("abc"));
+
+  // The common start and end of the texts must not overlap
+  TextDelta repeated(wxT("aaa"), wxT("aaaa"));
+  CHECK(repeated.Length() == 1);
+  CheckDelta(wxT("aaa"), wxT("aaaa"));
+  CheckDelta(wxT("aaaa"), wxT("aaa"));
+  CheckDelta(wxT("abab"), wxT("ab"));
+  CheckDelta(wxT("ab"), wxT("abab"));
+  CheckDelta(wxT("aba"), wxT("a"));
+
+  // Empty texts
+  CheckDelta(wxEmptyString, wxT("abc"));
+  CheckDelta(wxT("abc"), wxEmptyString);
+  CheckDelta(wxEmptyString, wxEmptyString);
+
+  // A delta that doesn't change anything
+  wxString text(wxT("abc"));
+  TextDelta none;
+  none.Apply(text);
+  CHECK(text == wxT("abc"));
+  none.Revert(text);
+  CHECK(text == wxT("abc"));
+}
+
+static void TestHistory()
+{
+  // Walk through a history of versions the way undo and redo do: Only the
+  // newest version is kept, each other one is reached by applying the deltas.
+  std::vector<wxString> versions;
+  versions.push_back(wxEmptyString);
+  versions.push_back(wxT("a"));
+  versions.push_back(wxT("a:1"));
+  versions.push_back(wxT("a:1;"));
+  versions.push_back(wxT("a:12;"));
+  versions.push_back(wxT("b:12;"));
+  versions.push_back(wxT("b:12;\nb:12;"));
+  versions.push_back(wxT("b;"));
+
+  std::vector<TextDelta> deltas;
+  for (size_t i = 1; i < versions.size(); i++)
+    deltas.push_back(TextDelta(versions[i - 1], versions[i]));
+
+  wxString text = versions.back();
+  for (size_t i = deltas.size(); i > 0; i--)
+  {
+    deltas[i - 1].Revert(text);
+    CHECK(text == versions[i - 1]);
+  }
+  for (size_t i = 0; i < deltas.size(); i++)
+  {
+    deltas[i].Apply(text);
+    CHECK(text == versions[i + 1]);
+  }
+}
+
+int main()
+{
+  wxInitializer initializer;
+  TestEdits();
+  TestCornerCases();
+  TestHistory();
+  return TEST_RESULT;
+}
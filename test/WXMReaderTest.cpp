@@ -0,0 +1,129 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+// Tests for WXMReader: Splitting .wxm files into lines
+
+#include "Test.h"
+#include "WXMReader.h"
+
+#include <vector>
+
+//! All lines WXMReader finds in text
+static std::vector<wxString> Lines(const wxString &text)
+{
+  std::vector<wxString> lines;
+  WXMReader reader(text);
+  while (!reader.Eof())
+  {
+    lines.push_back(reader.Line());
+    reader.Next();
+  }
+  return lines;
+}
+
+static void TestLineEndings()
+{
+  // Unix, dos and mac line endings split the text into the same lines
+  wxString endings[] = {wxT("\n"), wxT("\r\n"), wxT("\r")};
+  for (size_t i = 0; i < 3; i++)
+  {
+    std::vector<wxString> lines =
+      Lines(wxT("a") + endings[i] + wxT("bc") + endings[i] + endings[i] + wxT("d"));
+    CHECK(lines.size() == 4);
+    if (lines.size() == 4)
+    {
+      CHECK(lines[0] == wxT("a"));
+      CHECK(lines[1] == wxT("bc"));
+      CHECK(lines[2] == wxEmptyString);
+      CHECK(lines[3] == wxT("d"));
+    }
+  }
+
+  // A mac line ending followed by a unix one are two line endings
+  CHECK(Lines(wxT("a\n\rb")).size() == 3);
+}
+
+static void TestEnd()
+{
+  // An empty text doesn't contain any line. The reader refers to the text
+  // it reads => It has to outlive the reader.
+  wxString emptyText;
+  WXMReader empty(emptyText);
+  CHECK(empty.Eof());
+  CHECK(empty.Line() == wxEmptyString);
+
+  // A line ending at the end of the text doesn't start a new line
+  CHECK(Lines(wxT("a\n")).size() == 1);
+  CHECK(Lines(wxT("a\r\n")).size() == 1);
+  CHECK(Lines(wxT("a")).size() == 1);
+
+  // Reading past the end does no harm
+  wxString text(wxT("a"));
+  WXMReader reader(text);
+  reader.Next();
+  reader.Next();
+  CHECK(reader.Eof());
+  CHECK(reader.Line() == wxEmptyString);
+}
+
+static void TestReadUntil()
+{
+  wxString wxm =
+    wxT("/* [wxMaxima: input   start ] */\n")
+    wxT("\n")
+    wxT("a:1;\r\n")
+    wxT("\n")
+    wxT("b:2;\n")
+    wxT("/* [wxMaxima: input   end   ] */\n")
+    wxT("c");
+  WXMReader reader(wxm);
+  CHECK(reader.Line() == wxT("/* [wxMaxima: input   start ] */"));
+  reader.Next();
+
+  // Empty lines at the start are dropped, the other ones are kept
+  CHECK(reader.ReadUntil(wxT("/* [wxMaxima: input   end   ] */")) == wxT("a:1;\n\nb:2;"));
+  CHECK(reader.Line() == wxT("/* [wxMaxima: input   end   ] */"));
+  reader.Next();
+
+  // Without the end marker everything up to the end of the text is read
+  CHECK(reader.ReadUntil(wxT("missing")) == wxT("c"));
+  CHECK(reader.Eof());
+}
+
+static void TestNonAscii()
+{
+  std::vector<wxString> lines = Lines(wxString::FromUTF8("\xc3\xa4\xc3\xb6\n\xe2\x88\x9e"));
+  CHECK(lines.size() == 2);
+  if (lines.size() == 2)
+  {
+    CHECK(lines[0] == wxString::FromUTF8("\xc3\xa4\xc3\xb6"));
+    CHECK(lines[1] == wxString::FromUTF8("\xe2\x88\x9e"));
+  }
+}
+
+int main()
+{
+  wxInitializer initializer;
+  TestLineEndings();
+  TestEnd();
+  TestReadUntil();
+  TestNonAscii();
+  return TEST_RESULT;
+}
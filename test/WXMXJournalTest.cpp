@@ -0,0 +1,360 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2016 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+// Tests for replaying recovery journals, including ones that end in a record
+// that was being written when wxMaxima crashed
+
+#include "Test.h"
+#include "WXMXJournal.h"
+
+#include <wx/filename.h>
+#include <wx/wfstream.h>
+#include <wx/mstream.h>
+#include <wx/datstrm.h>
+
+#include <string.h>
+
+//! A record that lists the cells of a worksheet
+class CellsRecord
+{
+public:
+  CellsRecord() : m_data(m_stream), m_count(0) {}
+  //! The cell is the cell with the given index in the last record
+  CellsRecord &Unchanged(wxUint32 index)
+    {
+      m_data.Write8(JOURNAL_CELL_UNCHANGED);
+      m_data.Write32(index);
+      m_count++;
+      return *this;
+    }
+  //! The cell is a new one with the id id
+  CellsRecord &Cell(wxString id)
+    {
+      return Xml(wxT("<cell id=\"") + id + wxT("\"/>"));
+    }
+  //! The cell is a new one with this xml representation
+  CellsRecord &Xml(wxString xml)
+    {
+      m_data.Write8(JOURNAL_CELL_XML);
+      m_data.WriteString(xml);
+      m_count++;
+      return *this;
+    }
+  //! The record, the way it is written to the journal
+  wxMemoryBuffer Get()
+    {
+      wxMemoryOutputStream record;
+      wxDataOutputStream data(record);
+      data.Write8(JOURNAL_RECORD_CELLS);
+      data.Write32(m_count);
+      record.Write(m_stream.GetOutputStreamBuffer()->GetBufferStart(), m_stream.GetLength());
+      wxMemoryBuffer buffer;
+      buffer.AppendData(record.GetOutputStreamBuffer()->GetBufferStart(), record.GetLength());
+      return buffer;
+    }
+private:
+  wxMemoryOutputStream m_stream;
+  wxDataOutputStream m_data;
+  wxUint32 m_count;
+};
+
+//! A record that contains an image
+static wxMemoryBuffer ImageRecord(wxString name, const char *contents)
+{
+  wxMemoryOutputStream record;
+  wxDataOutputStream data(record);
+  data.Write8(JOURNAL_RECORD_IMAGE);
+  data.WriteString(name);
+  data.Write32(strlen(contents));
+  record.Write(contents, strlen(contents));
+  wxMemoryBuffer buffer;
+  buffer.AppendData(record.GetOutputStreamBuffer()->GetBufferStart(), record.GetLength());
+  return buffer;
+}
+
+//! Writes a journal for a .wxmx file
+class JournalWriter
+{
+public:
+  //! \param append true means: Append to the journal the file already has
+  JournalWriter(wxString wxmxFile, bool append = false) :
+    m_output(WXMXJournal::JournalFile(wxmxFile), append ? wxT("ab") : wxT("w+b")),
+    m_data(m_output)
+    {
+      if (append)
+        return;
+      wxFileName source(wxmxFile);
+      m_data.WriteString(JOURNAL_MAGIC);
+      m_data.Write32(JOURNAL_VERSION);
+      m_data.Write64(wxUint64(source.GetModificationTime().GetValue().GetValue()));
+      m_data.Write64(wxUint64(source.GetSize().GetValue()));
+    }
+  /*! Append a record
+
+    \param record The record
+    \param truncate If not -1: Write only this many bytes of the record, the
+    way a crash while writing it would have left it.
+   */
+  void Write(const wxMemoryBuffer &record, long truncate = -1)
+    {
+      m_data.Write32(record.GetDataLen());
+      size_t length = record.GetDataLen();
+      if (truncate >= 0)
+        length = truncate;
+      m_output.Write(record.GetData(), length);
+    }
+  //! Write only the first bytes of the length of a record
+  void WriteTruncatedLength()
+    {
+      m_data.Write8(42);
+      m_data.Write8(0);
+    }
+  bool Close() { return m_output.Close(); }
+private:
+  wxFFileOutputStream m_output;
+  wxDataOutputStream m_data;
+};
+
+//! A .wxmx file and its journal that are deleted as soon as the test is done
+class TestFiles
+{
+public:
+  TestFiles()
+    {
+      m_file = wxFileName::CreateTempFileName(wxT("wxmxjournal"));
+      wxFFileOutputStream output(m_file);
+      output.Write("not a zip archive", 17);
+      output.Close();
+    }
+  ~TestFiles()
+    {
+      wxRemoveFile(m_file);
+      if (wxFileExists(WXMXJournal::JournalFile(m_file)))
+        wxRemoveFile(WXMXJournal::JournalFile(m_file));
+    }
+  wxString m_file;
+};
+
+//! The content.xml of a .wxmx file that contains the cells "a", "b" and "c"
+static wxXmlNode *Document()
+{
+  wxXmlNode *root = new wxXmlNode(wxXML_ELEMENT_NODE, wxT("wxMaximaDocument"));
+  wxString ids = wxT("abc");
+  for (size_t i = 0; i < ids.Length(); i++)
+  {
+    wxXmlNode *cell = new wxXmlNode(wxXML_ELEMENT_NODE, wxT("cell"));
+    cell->AddAttribute(wxT("id"), ids.Mid(i, 1));
+    root->AddChild(cell);
+  }
+  return root;
+}
+
+//! Replay the journal of file and return the ids of the cells the document consists of then
+static wxString Replay(wxString file)
+{
+  wxLogNull logNull;
+  WXMXArchive archive(file);
+  wxXmlNode *root = Document();
+  wxString ids;
+  if (!WXMXJournal::Replay(file, archive, root))
+    ids = wxT("failed");
+  else
+    for (wxXmlNode *cell = root->GetChildren(); cell != NULL; cell = cell->GetNext())
+      ids += cell->GetAttribute(wxT("id"), wxT("?"));
+  delete root;
+  return ids;
+}
+
+static void TestComplete()
+{
+  TestFiles files;
+  JournalWriter journal(files.m_file);
+  journal.Write(CellsRecord().Unchanged(1).Unchanged(0).Cell(wxT("d")).Get());
+  // The indices refer to the cells of the last record
+  journal.Write(CellsRecord().Unchanged(2).Unchanged(0).Get());
+  CHECK(journal.Close());
+
+  CHECK(WXMXJournal::Exists(files.m_file));
+  CHECK(Replay(files.m_file) == wxT("db"));
+}
+
+static void TestTruncated()
+{
+  wxMemoryBuffer last = CellsRecord().Cell(wxT("x")).Cell(wxT("y")).Get();
+
+  // A record of which only a part has been written is ignored
+  {
+    TestFiles files;
+    JournalWriter journal(files.m_file);
+    journal.Write(CellsRecord().Unchanged(2).Get());
+    journal.Write(last, last.GetDataLen() / 2);
+    CHECK(journal.Close());
+    CHECK(Replay(files.m_file) == wxT("c"));
+  }
+
+  // ...even if it lacks only the last byte
+  {
+    TestFiles files;
+    JournalWriter journal(files.m_file);
+    journal.Write(CellsRecord().Unchanged(2).Get());
+    journal.Write(last, last.GetDataLen() - 1);
+    CHECK(journal.Close());
+    CHECK(Replay(files.m_file) == wxT("c"));
+  }
+
+  // ...or if it ends in the middle of its length
+  {
+    TestFiles files;
+    JournalWriter journal(files.m_file);
+    journal.Write(CellsRecord().Unchanged(2).Get());
+    journal.WriteTruncatedLength();
+    CHECK(journal.Close());
+    CHECK(Replay(files.m_file) == wxT("c"));
+  }
+
+  // A journal that only consists of its header leaves the document as it is
+  {
+    TestFiles files;
+    JournalWriter journal(files.m_file);
+    CHECK(journal.Close());
+    CHECK(Replay(files.m_file) == wxT("abc"));
+  }
+}
+
+static void TestInvalid()
+{
+  // A record that cannot be read is ignored, the records after it aren't
+  TestFiles files;
+  JournalWriter journal(files.m_file);
+  journal.Write(CellsRecord().Unchanged(1).Get());
+  journal.Write(CellsRecord().Unchanged(7).Get());
+  journal.Write(CellsRecord().Xml(wxT("<cell")).Get());
+  journal.Write(CellsRecord().Unchanged(0).Cell(wxT("e")).Get());
+  CHECK(journal.Close());
+  CHECK(Replay(files.m_file) == wxT("be"));
+}
+
+static void TestImages()
+{
+  TestFiles files;
+  JournalWriter journal(files.m_file);
+  journal.Write(ImageRecord(wxT("journal_image1.png"), "image 1"));
+  journal.Write(CellsRecord().Cell(wxT("i")).Get());
+  wxMemoryBuffer image = ImageRecord(wxT("journal_image2.png"), "image 2");
+  journal.Write(image, image.GetDataLen() - 1);
+  CHECK(journal.Close());
+
+  wxLogNull logNull;
+  WXMXArchive archive(files.m_file);
+  wxXmlNode *root = Document();
+  CHECK(WXMXJournal::Replay(files.m_file, archive, root));
+  delete root;
+
+  wxMemoryBuffer data;
+  CHECK(archive.ReadEntry(wxT("journal_image1.png"), data));
+  CHECK((data.GetDataLen() == 7) && (memcmp(data.GetData(), "image 1", 7) == 0));
+  wxMemoryBuffer missing;
+  CHECK(!archive.ReadEntry(wxT("journal_image2.png"), missing));
+}
+
+static void TestContinued()
+{
+  // Recover, edit, recover again
+  TestFiles files;
+  {
+    JournalWriter journal(files.m_file);
+    journal.Write(ImageRecord(wxT("journal_image1.png"), "image 1"));
+    journal.Write(CellsRecord().Cell(wxT("i")).Get());
+    CHECK(journal.Close());
+  }
+
+  wxString name;
+  {
+    wxLogNull logNull;
+    WXMXArchive archive(files.m_file);
+    wxXmlNode *root = Document();
+    CHECK(WXMXJournal::Replay(files.m_file, archive, root));
+    delete root;
+
+    // A continued journal must not give a new image the name of an image it
+    // already contains...
+    WXMXImageList images(wxT("journal_image"));
+    WXMXJournal::AddReplayedImages(archive, images);
+    wxMemoryBuffer newImage;
+    newImage.AppendData("image 2", 7);
+    name = images.Add(newImage, wxT("png"));
+    CHECK(name != wxT("journal_image1.png"));
+
+    // ...but the images it already contains keep their names.
+    wxMemoryBuffer oldImage;
+    CHECK(archive.ReadEntry(wxT("journal_image1.png"), oldImage));
+    CHECK(images.Add(oldImage, wxT("png")) == wxT("journal_image1.png"));
+  }
+
+  // The old cell is kept and a new one that shows the new image is added.
+  {
+    JournalWriter journal(files.m_file, true);
+    journal.Write(ImageRecord(name, "image 2"));
+    journal.Write(CellsRecord().Unchanged(0).Cell(wxT("j")).Get());
+    CHECK(journal.Close());
+  }
+  CHECK(Replay(files.m_file) == wxT("ij"));
+
+  wxLogNull logNull;
+  WXMXArchive archive(files.m_file);
+  wxXmlNode *root = Document();
+  CHECK(WXMXJournal::Replay(files.m_file, archive, root));
+  delete root;
+
+  wxMemoryBuffer data;
+  CHECK(archive.ReadEntry(wxT("journal_image1.png"), data));
+  CHECK((data.GetDataLen() == 7) && (memcmp(data.GetData(), "image 1", 7) == 0));
+  CHECK(archive.ReadEntry(name, data));
+  CHECK((data.GetDataLen() == 7) && (memcmp(data.GetData(), "image 2", 7) == 0));
+}
+
+static void TestOutdated()
+{
+  // A journal that was started for an older version of the file is of no use
+  TestFiles files;
+  JournalWriter journal(files.m_file);
+  journal.Write(CellsRecord().Unchanged(0).Get());
+  CHECK(journal.Close());
+
+  wxFFileOutputStream output(files.m_file, wxT("ab"));
+  output.Write("saved again", 11);
+  output.Close();
+
+  CHECK(!WXMXJournal::Exists(files.m_file));
+  CHECK(Replay(files.m_file) == wxT("failed"));
+}
+
+int main()
+{
+  wxInitializer initializer;
+  TestComplete();
+  TestTruncated();
+  TestInvalid();
+  TestImages();
+  TestContinued();
+  TestOutdated();
+  return TEST_RESULT;
+}